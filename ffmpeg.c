@@ -93,6 +93,11 @@
 #include <conio.h>
 #endif
 
+#if HAVE_FORK
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
 #if HAVE_PTHREADS
 #include <pthread.h>
 #endif
@@ -120,6 +125,7 @@ const char *const forced_keyframes_const_names[] = {
 
 static void do_video_stats(OutputStream *ost, int frame_size);
 static int64_t getutime(void);
+static int64_t getthreadtime(void);
 static int64_t getmaxrss(void);
 
 static int run_as_daemon  = 0;
@@ -129,12 +135,23 @@ static int64_t decode_error_stat[2];
 
 static int current_time;
 AVIOContext *progress_avio = NULL;
+AVIOContext *benchmark_json_avio = NULL;
 
 static uint8_t *subtitle_out;
 
 #if HAVE_PTHREADS
-/* signal to input threads that they should exit; set by the main thread */
-static int transcoding_finished;
+/* number of filtergraphs filtered and encoded in their own thread */
+static int nb_filter_threads;
+/* number of output files muxed in their own thread */
+static int nb_mux_threads;
+/* protects the state of the output streams that the filter and muxing
+ * threads share with the main loop, see lock_output_state() */
+static pthread_mutex_t output_state_lock = PTHREAD_MUTEX_INITIALIZER;
+/* set while exiting with filter or muxing threads running, interrupts the
+ * writes they may be blocked in; protected by output_state_lock */
+static int threads_io_aborted;
+/* protects the BenchmarkTimers, updated by all the threads */
+static pthread_mutex_t benchmark_lock = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
 #define DEFAULT_PASS_LOGFILENAME_PREFIX "ffmpeg2pass"
@@ -160,6 +177,55 @@ static int restore_tty;
 #endif
 
 static void free_input_threads(void);
+static void abort_filter_threads(void);
+static int free_filter_threads(void);
+static void abort_mux_threads(void);
+static void free_mux_threads(void);
+
+static void lock_output_file(OutputFile *of)
+{
+#if HAVE_PTHREADS
+    if (nb_filter_threads || nb_mux_threads)
+        pthread_mutex_lock(&of->mux_lock);
+#endif
+}
+
+static void unlock_output_file(OutputFile *of)
+{
+#if HAVE_PTHREADS
+    if (nb_filter_threads || nb_mux_threads)
+        pthread_mutex_unlock(&of->mux_lock);
+#endif
+}
+
+/* Lock the finished state, the frame counter and the published encoder and
+ * muxer state of the output streams. Unlike the output file lock, it is
+ * never held across encoding or I/O, so the main loop can always read them. */
+static void lock_output_state(void)
+{
+#if HAVE_PTHREADS
+    if (nb_filter_threads || nb_mux_threads)
+        pthread_mutex_lock(&output_state_lock);
+#endif
+}
+
+static void unlock_output_state(void)
+{
+#if HAVE_PTHREADS
+    if (nb_filter_threads || nb_mux_threads)
+        pthread_mutex_unlock(&output_state_lock);
+#endif
+}
+
+static OSTFinished output_stream_finished(OutputStream *ost)
+{
+    OSTFinished finished;
+
+    lock_output_state();
+    finished = ost->finished;
+    unlock_output_state();
+    return finished;
+}
 
 
 /* sub2video hack:
@@ -422,6 +488,15 @@ static int read_key(void)
 
 static int decode_interrupt_cb(void *ctx)
 {
+#if HAVE_PTHREADS
+    int aborted;
+
+    lock_output_state();
+    aborted = threads_io_aborted;
+    unlock_output_state();
+    if (aborted)
+        return 1;
+#endif
     return received_nb_signals > 1;
 }
 
@@ -436,6 +511,15 @@ static void ffmpeg_cleanup(int ret)
         printf("bench: maxrss=%ikB\n", maxrss);
     }
 
+#if HAVE_PTHREADS
+    /* only the main thread exits, the others are stopped and joined first */
+    abort_filter_threads();
+    abort_mux_threads();
+    free_filter_threads();
+    free_mux_threads();
+    /* the output files can be flushed and closed again */
+    threads_io_aborted = 0;
+#endif
     for (i = 0; i < nb_filtergraphs; i++) {
         avfilter_graph_free(&filtergraphs[i]->graph);
         for (j = 0; j < filtergraphs[i]->nb_inputs; j++) {
@@ -449,6 +533,7 @@ static void ffmpeg_cleanup(int ret)
         }
         av_freep(&filtergraphs[i]->outputs);
         av_freep(&filtergraphs[i]->graph_desc);
+        av_freep(&filtergraphs[i]->shared_desc);
         av_freep(&filtergraphs[i]);
     }
     av_freep(&filtergraphs);
@@ -462,6 +547,9 @@ static void ffmpeg_cleanup(int ret)
             avio_close(s->pb);
         avformat_free_context(s);
         av_dict_free(&output_files[i]->opts);
+#if HAVE_PTHREADS
+        pthread_mutex_destroy(&output_files[i]->mux_lock);
+#endif
         av_freep(&output_files[i]);
     }
     for (i = 0; i < nb_output_streams; i++) {
@@ -485,6 +573,8 @@ static void ffmpeg_cleanup(int ret)
 #if HAVE_PTHREADS
     free_input_threads();
 #endif
+    /* closed here rather than by the last report, as an early exit skips it */
+    avio_closep(&benchmark_json_avio);
     for (i = 0; i < nb_input_files; i++) {
         avformat_close_input(&input_files[i]->ctx);
         av_freep(&input_files[i]);
@@ -551,20 +641,280 @@ static void update_benchmark(const char *fmt, ...)
     }
 }
 
+/* Start timing a stage for -benchmark_json, start receives the wallclock
+ * and thread CPU times. */
+static void benchmark_start(int64_t start[2])
+{
+    if (benchmark_json_avio) {
+        start[0] = av_gettime();
+        start[1] = getthreadtime();
+    } else
+        start[0] = start[1] = 0;
+}
+
+static void benchmark_stop(BenchmarkTimer *t, const int64_t start[2])
+{
+    if (benchmark_json_avio) {
+        int64_t wall = av_gettime()    - start[0];
+        int64_t cpu  = getthreadtime() - start[1];
+
+#if HAVE_PTHREADS
+        pthread_mutex_lock(&benchmark_lock);
+#endif
+        t->wall += wall;
+        t->cpu  += cpu;
+        t->calls++;
+#if HAVE_PTHREADS
+        pthread_mutex_unlock(&benchmark_lock);
+#endif
+    }
+}
+
 static void close_all_output_streams(OutputStream *ost, OSTFinished this_stream, OSTFinished others)
 {
     int i;
+
+    lock_output_state();
     for (i = 0; i < nb_output_streams; i++) {
         OutputStream *ost2 = output_streams[i];
         ost2->finished |= ost == ost2 ? this_stream : others;
     }
+    unlock_output_state();
+}
+
+static void mux_packet(OutputFile *of, AVPacket *pkt)
+{
+    OutputStream *ost = output_streams[of->ost_index + pkt->stream_index];
+    int64_t bench[2], cur_dts, pts, pos;
+    int ret;
+
+    lock_output_file(of);
+    benchmark_start(bench);
+    ret = av_interleaved_write_frame(of->ctx, pkt);
+    benchmark_stop(&of->bench_mux, bench);
+    pos     = of->ctx->pb ? avio_tell(of->ctx->pb) : 0;
+    cur_dts = ost->st->cur_dts;
+    pts     = ost->st->pts.val;
+    unlock_output_file(of);
+
+    lock_output_state();
+#if HAVE_PTHREADS
+    of->mux_pos = pos;
+#endif
+    ost->last_cur_dts = cur_dts;
+    ost->last_pts     = pts;
+    unlock_output_state();
+
+    if (ret < 0) {
+        print_error("av_interleaved_write_frame()", ret);
+        main_return_code = 1;
+        close_all_output_streams(ost, MUXER_FINISHED | ENCODER_FINISHED, ENCODER_FINISHED);
+    }
+    av_free_packet(pkt);
+}
+
+#if HAVE_PTHREADS
+static void *mux_thread(void *arg)
+{
+    OutputFile *of = arg;
+    AVPacket pkt;
+
+    while (1) {
+        pthread_mutex_lock(&of->mux_queue_lock);
+        while (!av_fifo_size(of->mux_queue) && !of->mux_drain && !of->mux_abort)
+            pthread_cond_wait(&of->mux_queue_cond, &of->mux_queue_lock);
+        if (!av_fifo_size(of->mux_queue) || of->mux_abort) {
+            pthread_mutex_unlock(&of->mux_queue_lock);
+            break;
+        }
+        av_fifo_generic_read(of->mux_queue, &pkt, sizeof(pkt), NULL);
+        pthread_cond_broadcast(&of->mux_queue_cond);
+        pthread_mutex_unlock(&of->mux_queue_lock);
+
+        mux_packet(of, &pkt);
+    }
+    return NULL;
+}
+
+/* Queue a packet for the muxing thread of of, taking ownership of it. */
+static int mux_queue_packet(OutputFile *of, OutputStream *ost, AVPacket *pkt)
+{
+    int64_t stall_start;
+
+    if (av_dup_packet(pkt) < 0) {
+        av_log(NULL, AV_LOG_FATAL, "Could not queue packet for muxing\n");
+        av_free_packet(pkt);
+        return AVERROR(ENOMEM);
+    }
+
+    pthread_mutex_lock(&of->mux_queue_lock);
+
+    /* once a packet is dropped, the following ones depend on it until the
+     * next keyframe, so drop them as well */
+    if (ost->mux_dropping && (pkt->flags & AV_PKT_FLAG_KEY))
+        ost->mux_dropping = 0;
+    if (of->mux_queue_drop && !av_fifo_space(of->mux_queue))
+        ost->mux_dropping = 1;
+    if (ost->mux_dropping) {
+        of->mux_dropped++;
+        pthread_mutex_unlock(&of->mux_queue_lock);
+        av_free_packet(pkt);
+        return 0;
+    }
+
+    if (!av_fifo_space(of->mux_queue)) {
+        of->mux_stalls++;
+        stall_start = av_gettime();
+        while (!av_fifo_space(of->mux_queue) && !of->mux_abort)
+            pthread_cond_wait(&of->mux_queue_cond, &of->mux_queue_lock);
+        of->mux_stall_time += av_gettime() - stall_start;
+    }
+    if (of->mux_abort) {
+        pthread_mutex_unlock(&of->mux_queue_lock);
+        av_free_packet(pkt);
+        return AVERROR_EXIT;
+    }
+
+    av_fifo_generic_write(of->mux_queue, pkt, sizeof(*pkt), NULL);
+    of->mux_queue_max = FFMAX(of->mux_queue_max,
+                              av_fifo_size(of->mux_queue) / sizeof(*pkt));
+    pthread_cond_broadcast(&of->mux_queue_cond);
+    pthread_mutex_unlock(&of->mux_queue_lock);
+    return 0;
+}
+
+/* Make the muxing threads exit without writing the packets still queued,
+ * when exiting early. Threads waiting for room in the queues are woken up,
+ * and a write in progress is interrupted if its protocol checks the
+ * interrupt callback. */
+static void abort_mux_threads(void)
+{
+    int i;
+
+    for (i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+
+        if (!of->mux_threaded)
+            continue;
+        lock_output_state();
+        threads_io_aborted = 1;
+        unlock_output_state();
+        pthread_mutex_lock(&of->mux_queue_lock);
+        of->mux_abort = 1;
+        pthread_cond_broadcast(&of->mux_queue_cond);
+        pthread_mutex_unlock(&of->mux_queue_lock);
+    }
+}
+
+static void free_mux_threads(void)
+{
+    int i;
+
+    for (i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+        AVPacket pkt;
+
+        if (!of->mux_threaded)
+            continue;
+
+        /* let the thread write what it was sent, then join it */
+        pthread_mutex_lock(&of->mux_queue_lock);
+        of->mux_drain = 1;
+        pthread_cond_broadcast(&of->mux_queue_cond);
+        pthread_mutex_unlock(&of->mux_queue_lock);
+
+        pthread_join(of->mux_thread, NULL);
+        of->mux_threaded = 0;
+
+        while (av_fifo_size(of->mux_queue)) {
+            av_fifo_generic_read(of->mux_queue, &pkt, sizeof(pkt), NULL);
+            av_free_packet(&pkt);
+        }
+        av_fifo_free(of->mux_queue);
+        of->mux_queue = NULL;
+        pthread_mutex_destroy(&of->mux_queue_lock);
+        pthread_cond_destroy (&of->mux_queue_cond);
+    }
+}
+
+static int init_mux_threads(void)
+{
+    int i, ret;
+
+    for (i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+
+        if (of->mux_queue_size <= 0)
+            continue;
+
+        if (!(of->mux_queue = av_fifo_alloc(of->mux_queue_size * sizeof(AVPacket))))
+            return AVERROR(ENOMEM);
+
+        pthread_mutex_init(&of->mux_queue_lock, NULL);
+        pthread_cond_init (&of->mux_queue_cond, NULL);
+
+        nb_mux_threads++;
+        of->mux_threaded = 1;
+        if ((ret = pthread_create(&of->mux_thread, NULL, mux_thread, of))) {
+            of->mux_threaded = 0;
+            return AVERROR(ret);
+        }
+    }
+    return 0;
+}
+#endif
+
+/* Position published by the muxing thread of of after its last write. */
+static int64_t output_file_mux_pos(OutputFile *of)
+{
+    int64_t pos = 0;
+
+#if HAVE_PTHREADS
+    lock_output_state();
+    pos = of->mux_pos;
+    unlock_output_state();
+#endif
+    return pos;
+}
+
+/* Current position in the output file. With a muxing thread the I/O context
+ * may be blocked in a write, so the position it last published is used. */
+static int64_t output_file_tell(OutputFile *of)
+{
+    int64_t pos;
+
+#if HAVE_PTHREADS
+    if (of->mux_threaded)
+        return output_file_mux_pos(of);
+#endif
+    lock_output_file(of);
+    pos = avio_tell(of->ctx->pb);
+    unlock_output_file(of);
+    return pos;
+}
+
+static int64_t output_file_size(OutputFile *of)
+{
+    int64_t size;
+
+#if HAVE_PTHREADS
+    if (of->mux_threaded)
+        return output_file_mux_pos(of);
+#endif
+    lock_output_file(of);
+    size = avio_size(of->ctx->pb);
+    unlock_output_file(of);
+    if (size <= 0) // FIXME improve avio_size() so it works with non seekable output too
+        size = output_file_tell(of);
+    return size;
 }
 
-static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
+/* Send a packet of ost to the muxer, taking ownership of it.
+ * Only fails on fatal errors, which the caller must not ignore. */
+static int write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
 {
     AVBitStreamFilterContext *bsfc = ost->bitstream_filters;
     AVCodecContext          *avctx = ost->st->codec;
-    int ret;
 
     if ((avctx->codec_type == AVMEDIA_TYPE_VIDEO && video_sync_method == VSYNC_DROP) ||
         (avctx->codec_type == AVMEDIA_TYPE_AUDIO && audio_sync_method < 0))
@@ -580,9 +930,11 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
     if (!(avctx->codec_type == AVMEDIA_TYPE_VIDEO && avctx->codec)) {
         if (ost->frame_number >= ost->max_frames) {
             av_free_packet(pkt);
-            return;
+            return 0;
         }
+        lock_output_state();
         ost->frame_number++;
+        unlock_output_state();
     }
 
     while (bsfc) {
@@ -606,15 +958,19 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
             av_free_packet(pkt);
             new_pkt.buf = av_buffer_create(new_pkt.data, new_pkt.size,
                                            av_buffer_default_free, NULL, 0);
-            if (!new_pkt.buf)
-                exit_program(1);
+            if (!new_pkt.buf) {
+                av_free(new_pkt.data);
+                return AVERROR(ENOMEM);
+            }
         } else if (a < 0) {
             av_log(NULL, AV_LOG_ERROR, "Failed to open bitstream filter %s for stream %d with codec %s",
                    bsfc->filter->name, pkt->stream_index,
                    avctx->codec ? avctx->codec->name : "copy");
             print_error("", a);
-            if (exit_on_error)
-                exit_program(1);
+            if (exit_on_error) {
+                av_free_packet(pkt);
+                return a;
+            }
         }
         *pkt = new_pkt;
 
@@ -633,7 +989,8 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
                ost->file_index, ost->st->index, ost->last_mux_dts, pkt->dts);
         if (exit_on_error) {
             av_log(NULL, AV_LOG_FATAL, "aborting.\n");
-            exit_program(1);
+            av_free_packet(pkt);
+            return AVERROR(EINVAL);
         }
         av_log(s, loglevel, "changing to %"PRId64". This may result "
                "in incorrect timestamps in the output file.\n",
@@ -645,8 +1002,10 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
     }
     ost->last_mux_dts = pkt->dts;
 
+    lock_output_state();
     ost->data_size += pkt->size;
     ost->packets_written++;
+    unlock_output_state();
 
     pkt->stream_index = ost->index;
 
@@ -660,20 +1019,21 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, OutputStream *ost)
               );
     }
 
-    ret = av_interleaved_write_frame(s, pkt);
-    if (ret < 0) {
-        print_error("av_interleaved_write_frame()", ret);
-        main_return_code = 1;
-        close_all_output_streams(ost, MUXER_FINISHED | ENCODER_FINISHED, ENCODER_FINISHED);
-    }
-    av_free_packet(pkt);
+#if HAVE_PTHREADS
+    if (output_files[ost->file_index]->mux_threaded)
+        return mux_queue_packet(output_files[ost->file_index], ost, pkt);
+#endif
+    mux_packet(output_files[ost->file_index], pkt);
+    return 0;
 }
 
 static void close_output_stream(OutputStream *ost)
 {
     OutputFile *of = output_files[ost->file_index];
 
+    lock_output_state();
     ost->finished |= ENCODER_FINISHED;
+    unlock_output_state();
     if (of->shortest) {
         int64_t end = av_rescale_q(ost->sync_opts - ost->first_pts, ost->st->codec->time_base, AV_TIME_BASE_Q);
         of->recording_time = FFMIN(of->recording_time, end);
@@ -693,11 +1053,27 @@ static int check_recording_time(OutputStream *ost)
     return 1;
 }
 
-static void do_audio_out(AVFormatContext *s, OutputStream *ost,
-                         AVFrame *frame)
+/* Publish the quality and the errors of the last frame coded by the encoder
+ * of ost for print_report(). */
+static void update_encoder_stats(OutputStream *ost)
+{
+    AVCodecContext *enc = ost->st->codec;
+
+    if (!enc->coded_frame)
+        return;
+    lock_output_state();
+    ost->quality = enc->coded_frame->quality;
+    memcpy(ost->error, enc->coded_frame->error, sizeof(ost->error));
+    unlock_output_state();
+}
+
+/* Encode and mux an audio frame, only fails on fatal errors. */
+static int do_audio_out(AVFormatContext *s, OutputStream *ost,
+                        AVFrame *frame)
 {
     AVCodecContext *enc = ost->st->codec;
     AVPacket pkt;
+    int64_t bench[2];
     int got_packet = 0;
 
     av_init_packet(&pkt);
@@ -705,13 +1081,15 @@ static void do_audio_out(AVFormatContext *s, OutputStream *ost,
     pkt.size = 0;
 
     if (!check_recording_time(ost))
-        return;
+        return 0;
 
     if (frame->pts == AV_NOPTS_VALUE || audio_sync_method < 0)
         frame->pts = ost->sync_opts;
     ost->sync_opts = frame->pts + frame->nb_samples;
+    lock_output_state();
     ost->samples_encoded += frame->nb_samples;
     ost->frames_encoded++;
+    unlock_output_state();
 
     av_assert0(pkt.size || !pkt.data);
     update_benchmark(NULL);
@@ -722,11 +1100,14 @@ static void do_audio_out(AVFormatContext *s, OutputStream *ost,
                enc->time_base.num, enc->time_base.den);
     }
 
+    benchmark_start(bench);
     if (avcodec_encode_audio2(enc, &pkt, frame, &got_packet) < 0) {
         av_log(NULL, AV_LOG_FATAL, "Audio encoding failed (avcodec_encode_audio2)\n");
-        exit_program(1);
+        return AVERROR_EXTERNAL;
     }
+    benchmark_stop(&ost->bench_encode, bench);
     update_benchmark("encode_audio %d.%d", ost->file_index, ost->index);
+    update_encoder_stats(ost);
 
     if (got_packet) {
         if (pkt.pts != AV_NOPTS_VALUE)
@@ -743,8 +1124,9 @@ static void do_audio_out(AVFormatContext *s, OutputStream *ost,
                    av_ts2str(pkt.dts), av_ts2timestr(pkt.dts, &ost->st->time_base));
         }
 
-        write_frame(s, &pkt, ost);
+        return write_frame(s, &pkt, ost);
     }
+    return 0;
 }
 
 static void do_subtitle_out(AVFormatContext *s,
@@ -756,7 +1138,7 @@ static void do_subtitle_out(AVFormatContext *s,
     int subtitle_out_size, nb, i;
     AVCodecContext *enc;
     AVPacket pkt;
-    int64_t pts;
+    int64_t pts, bench[2];
 
     if (sub->pts == AV_NOPTS_VALUE) {
         av_log(NULL, AV_LOG_ERROR, "Subtitle packets must have a pts\n");
@@ -798,8 +1180,10 @@ static void do_subtitle_out(AVFormatContext *s,
 
         ost->frames_encoded++;
 
+        benchmark_start(bench);
         subtitle_out_size = avcodec_encode_subtitle(enc, subtitle_out,
                                                     subtitle_out_max_size, sub);
+        benchmark_stop(&ost->bench_encode, bench);
         if (subtitle_out_size < 0) {
             av_log(NULL, AV_LOG_FATAL, "Subtitle encoding failed\n");
             exit_program(1);
@@ -818,17 +1202,21 @@ static void do_subtitle_out(AVFormatContext *s,
             else
                 pkt.pts += 90 * sub->end_display_time;
         }
-        write_frame(s, &pkt, ost);
+        if (write_frame(s, &pkt, ost) < 0)
+            exit_program(1);
     }
 }
 
-static void do_video_out(AVFormatContext *s,
-                         OutputStream *ost,
-                         AVFrame *in_picture)
+/* Encode and mux a video frame, duplicated or dropped to keep the output
+ * frame rate, only fails on fatal errors. */
+static int do_video_out(AVFormatContext *s,
+                        OutputStream *ost,
+                        AVFrame *in_picture)
 {
     int ret, format_video_sync;
     AVPacket pkt;
     AVCodecContext *enc = ost->st->codec;
+    int64_t bench[2];
     int nb_frames, i;
     double sync_ipts, delta;
     double duration = 0;
@@ -894,18 +1282,24 @@ static void do_video_out(AVFormatContext *s,
 
     nb_frames = FFMIN(nb_frames, ost->max_frames - ost->frame_number);
     if (nb_frames == 0) {
+        lock_output_state();
         nb_frames_drop++;
+        unlock_output_state();
         av_log(NULL, AV_LOG_WARNING,
                "*** dropping frame %d from stream %d at ts %"PRId64"\n",
                ost->frame_number, ost->st->index, in_picture->pts);
-        return;
+        return 0;
     } else if (nb_frames > 1) {
         if (nb_frames > dts_error_threshold * 30) {
             av_log(NULL, AV_LOG_ERROR, "%d frame duplication too large, skipping\n", nb_frames - 1);
+            lock_output_state();
             nb_frames_drop++;
-            return;
+            unlock_output_state();
+            return 0;
         }
+        lock_output_state();
         nb_frames_dup += nb_frames - 1;
+        unlock_output_state();
         av_log(NULL, AV_LOG_VERBOSE, "*** %d dup!\n", nb_frames - 1);
     }
 
@@ -922,7 +1316,7 @@ static void do_video_out(AVFormatContext *s,
 #else
     if (ost->frame_number >= ost->max_frames)
 #endif
-        return;
+        return 0;
 
     if (s->oformat->flags & AVFMT_RAWPICTURE &&
         enc->codec->id == AV_CODEC_ID_RAWVIDEO) {
@@ -940,7 +1334,8 @@ static void do_video_out(AVFormatContext *s,
         pkt.pts    = av_rescale_q(in_picture->pts, enc->time_base, ost->st->time_base);
         pkt.flags |= AV_PKT_FLAG_KEY;
 
-        write_frame(s, &pkt, ost);
+        if ((ret = write_frame(s, &pkt, ost)) < 0)
+            return ret;
     } else {
         int got_packet, forced_keyframe = 0;
         double pts_time;
@@ -1004,14 +1399,19 @@ static void do_video_out(AVFormatContext *s,
                    enc->time_base.num, enc->time_base.den);
         }
 
+        lock_output_state();
         ost->frames_encoded++;
+        unlock_output_state();
 
+        benchmark_start(bench);
         ret = avcodec_encode_video2(enc, &pkt, in_picture, &got_packet);
+        benchmark_stop(&ost->bench_encode, bench);
         update_benchmark("encode_video %d.%d", ost->file_index, ost->index);
         if (ret < 0) {
             av_log(NULL, AV_LOG_FATAL, "Video encoding failed\n");
-            exit_program(1);
+            return ret;
         }
+        update_encoder_stats(ost);
 
         if (got_packet) {
             if (debug_ts) {
@@ -1037,7 +1437,8 @@ static void do_video_out(AVFormatContext *s,
             }
 
             frame_size = pkt.size;
-            write_frame(s, &pkt, ost);
+            if ((ret = write_frame(s, &pkt, ost)) < 0)
+                return ret;
 
             /* if two pass, output log */
             if (ost->logfile && enc->stats_out) {
@@ -1051,11 +1452,14 @@ static void do_video_out(AVFormatContext *s,
      * But there may be reordering, so we can't throw away frames on encoder
      * flush, we need to limit them here, before they go into encoder.
      */
+    lock_output_state();
     ost->frame_number++;
+    unlock_output_state();
 
     if (vstats_filename && frame_size)
         do_video_stats(ost, frame_size);
   }
+  return 0;
 }
 
 static double psnr(double d)
@@ -1100,101 +1504,122 @@ static void do_video_stats(OutputStream *ost, int frame_size)
 }
 
 /**
- * Get and encode new output from any of the filtergraphs, without causing
- * activity.
+ * Get and encode new output from the filtergraph feeding ost, without
+ * causing activity.
  *
  * @return  0 for success, <0 for severe errors
  */
-static int reap_filters(void)
+static int reap_filter_output(OutputStream *ost)
 {
+    OutputFile    *of = output_files[ost->file_index];
+    AVFilterContext *filter = ost->filter->filter;
+    AVCodecContext *enc = ost->st->codec;
     AVFrame *filtered_frame = NULL;
-    int i;
     int64_t frame_pts;
+    int ret = 0;
 
-    /* Reap all buffers present in the buffer sinks */
-    for (i = 0; i < nb_output_streams; i++) {
-        OutputStream *ost = output_streams[i];
-        OutputFile    *of = output_files[ost->file_index];
-        AVFilterContext *filter;
-        AVCodecContext *enc = ost->st->codec;
-        int ret = 0;
+    if (!ost->filtered_frame && !(ost->filtered_frame = av_frame_alloc())) {
+        return AVERROR(ENOMEM);
+    }
+    filtered_frame = ost->filtered_frame;
 
-        if (!ost->filter)
+    while (1) {
+        ret = av_buffersink_get_frame_flags(filter, filtered_frame,
+                                           AV_BUFFERSINK_FLAG_NO_REQUEST);
+        if (ret < 0) {
+            if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+                av_log(NULL, AV_LOG_WARNING,
+                       "Error in av_buffersink_get_frame_flags(): %s\n", av_err2str(ret));
+            }
+            break;
+        }
+        if (output_stream_finished(ost)) {
+            av_frame_unref(filtered_frame);
             continue;
-        filter = ost->filter->filter;
-
-        if (!ost->filtered_frame && !(ost->filtered_frame = av_frame_alloc())) {
-            return AVERROR(ENOMEM);
         }
-        filtered_frame = ost->filtered_frame;
+        frame_pts = AV_NOPTS_VALUE;
+        if (filtered_frame->pts != AV_NOPTS_VALUE) {
+            int64_t start_time = (of->start_time == AV_NOPTS_VALUE) ? 0 : of->start_time;
+            filtered_frame->pts = frame_pts =
+                av_rescale_q(filtered_frame->pts, filter->inputs[0]->time_base, enc->time_base) -
+                av_rescale_q(start_time, AV_TIME_BASE_Q, enc->time_base);
+        }
+        //if (ost->source_index >= 0)
+        //    *filtered_frame= *input_streams[ost->source_index]->decoded_frame; //for me_threshold
 
-        while (1) {
-            ret = av_buffersink_get_frame_flags(filter, filtered_frame,
-                                               AV_BUFFERSINK_FLAG_NO_REQUEST);
-            if (ret < 0) {
-                if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
-                    av_log(NULL, AV_LOG_WARNING,
-                           "Error in av_buffersink_get_frame_flags(): %s\n", av_err2str(ret));
-                }
-                break;
-            }
-            if (ost->finished) {
-                av_frame_unref(filtered_frame);
-                continue;
-            }
-            frame_pts = AV_NOPTS_VALUE;
-            if (filtered_frame->pts != AV_NOPTS_VALUE) {
-                int64_t start_time = (of->start_time == AV_NOPTS_VALUE) ? 0 : of->start_time;
-                filtered_frame->pts = frame_pts =
-                    av_rescale_q(filtered_frame->pts, filter->inputs[0]->time_base, enc->time_base) -
-                    av_rescale_q(start_time, AV_TIME_BASE_Q, enc->time_base);
-            }
-            //if (ost->source_index >= 0)
-            //    *filtered_frame= *input_streams[ost->source_index]->decoded_frame; //for me_threshold
+        switch (filter->inputs[0]->type) {
+        case AVMEDIA_TYPE_VIDEO:
+            filtered_frame->pts = frame_pts;
+            if (!ost->frame_aspect_ratio.num)
+                enc->sample_aspect_ratio = filtered_frame->sample_aspect_ratio;
 
-            switch (filter->inputs[0]->type) {
-            case AVMEDIA_TYPE_VIDEO:
-                filtered_frame->pts = frame_pts;
-                if (!ost->frame_aspect_ratio.num)
-                    enc->sample_aspect_ratio = filtered_frame->sample_aspect_ratio;
-
-                if (debug_ts) {
-                    av_log(NULL, AV_LOG_INFO, "filter -> pts:%s pts_time:%s time_base:%d/%d\n",
-                            av_ts2str(filtered_frame->pts), av_ts2timestr(filtered_frame->pts, &enc->time_base),
-                            enc->time_base.num, enc->time_base.den);
-                }
+            if (debug_ts) {
+                av_log(NULL, AV_LOG_INFO, "filter -> pts:%s pts_time:%s time_base:%d/%d\n",
+                        av_ts2str(filtered_frame->pts), av_ts2timestr(filtered_frame->pts, &enc->time_base),
+                        enc->time_base.num, enc->time_base.den);
+            }
 
-                do_video_out(of->ctx, ost, filtered_frame);
-                break;
-            case AVMEDIA_TYPE_AUDIO:
-                filtered_frame->pts = frame_pts;
-                if (!(enc->codec->capabilities & CODEC_CAP_PARAM_CHANGE) &&
-                    enc->channels != av_frame_get_channels(filtered_frame)) {
-                    av_log(NULL, AV_LOG_ERROR,
-                           "Audio filter graph output is not normalized and encoder does not support parameter changes\n");
-                    break;
-                }
-                do_audio_out(of->ctx, ost, filtered_frame);
+            ret = do_video_out(of->ctx, ost, filtered_frame);
+            break;
+        case AVMEDIA_TYPE_AUDIO:
+            filtered_frame->pts = frame_pts;
+            if (!(enc->codec->capabilities & CODEC_CAP_PARAM_CHANGE) &&
+                enc->channels != av_frame_get_channels(filtered_frame)) {
+                av_log(NULL, AV_LOG_ERROR,
+                       "Audio filter graph output is not normalized and encoder does not support parameter changes\n");
                 break;
-            default:
-                // TODO support subtitle filters
-                av_assert0(0);
             }
-
-            av_frame_unref(filtered_frame);
+            ret = do_audio_out(of->ctx, ost, filtered_frame);
+            break;
+        default:
+            // TODO support subtitle filters
+            av_assert0(0);
         }
+
+        av_frame_unref(filtered_frame);
+        if (ret < 0)
+            return ret;
     }
 
     return 0;
 }
 
-static void print_final_stats(int64_t total_size)
+/**
+ * Get and encode new output from any of the filtergraphs, without causing
+ * activity. Graphs running in their own thread are left to it.
+ *
+ * @return  0 for success, <0 for severe errors
+ */
+static int reap_filters(void)
 {
-    uint64_t video_size = 0, audio_size = 0, extra_size = 0, other_size = 0;
-    uint64_t subtitle_size = 0;
-    uint64_t data_size = 0;
-    float percent = -1.0;
-    int i, j;
+    int i;
+
+    /* Reap all buffers present in the buffer sinks */
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+
+        if (!ost->filter)
+            continue;
+#if HAVE_PTHREADS
+        if (ost->filter->graph->pipelined)
+            continue;
+#endif
+        /* encoding and muxing errors are fatal, as for the graphs run by
+         * filter threads, see filter_threads_error() */
+        if (reap_filter_output(ost) < 0)
+            exit_program(1);
+    }
+
+    return 0;
+}
+
+static void print_final_stats(int64_t total_size)
+{
+    uint64_t video_size = 0, audio_size = 0, extra_size = 0, other_size = 0;
+    uint64_t subtitle_size = 0;
+    uint64_t data_size = 0;
+    float percent = -1.0;
+    int i, j;
 
     for (i = 0; i < nb_output_streams; i++) {
         OutputStream *ost = output_streams[i];
@@ -1291,28 +1716,142 @@ static void print_final_stats(int64_t total_size)
 
         av_log(NULL, AV_LOG_VERBOSE, "  Total: %"PRIu64" packets (%"PRIu64" bytes) muxed\n",
                total_packets, total_size);
+        if (of->mux_queue_size > 0)
+            av_log(NULL, of->mux_stalls || of->mux_dropped ? AV_LOG_INFO : AV_LOG_VERBOSE,
+                   "  Output file #%d muxing queue: %d/%d packets max, %"PRIu64" stalls (%.3fs), %"PRIu64" packets dropped\n",
+                   i, of->mux_queue_max, of->mux_queue_size, of->mux_stalls,
+                   of->mux_stall_time / 1000000.0, of->mux_dropped);
     }
     if(video_size + data_size + audio_size + subtitle_size + extra_size == 0){
         av_log(NULL, AV_LOG_WARNING, "Output file is empty, nothing was encoded (check -ss / -t / -frames parameters if used)\n");
     }
 }
 
+static void bprint_benchmark_timer(AVBPrint *bp, const char *name, const BenchmarkTimer *t)
+{
+    BenchmarkTimer timer;
+
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&benchmark_lock);
+#endif
+    timer = *t;
+#if HAVE_PTHREADS
+    pthread_mutex_unlock(&benchmark_lock);
+#endif
+    av_bprintf(bp, "\"%s\":{\"wall\":%.6f,\"cpu\":%.6f,\"calls\":%"PRIu64"}",
+               name, timer.wall / 1000000.0, timer.cpu / 1000000.0, timer.calls);
+}
+
+/* Write one line of JSON with the counters and the time spent in each stage
+ * so far to benchmark_json_avio. */
+static void print_benchmark_json(int is_last_report, int64_t timer_start, int64_t cur_time)
+{
+    AVBPrint bp;
+    int i, j, queued;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, "{\"final\":%s,\"time\":%.6f,\"cpu\":%.6f,\"maxrss\":%"PRId64,
+               is_last_report ? "true" : "false", (cur_time - timer_start) / 1000000.0,
+               getutime() / 1000000.0, getmaxrss());
+
+    av_bprintf(&bp, ",\"inputs\":[");
+    for (i = 0; i < nb_input_files; i++) {
+        InputFile *f = input_files[i];
+
+        queued = 0;
+#if HAVE_PTHREADS
+        if (f->queue) {
+            pthread_mutex_lock(&f->queue_lock);
+            queued = (f->queue_wr + f->queue_size + 1 - f->queue_rd) % (f->queue_size + 1);
+            pthread_mutex_unlock(&f->queue_lock);
+        }
+#endif
+        av_bprintf(&bp, "%s{\"index\":%d,", i ? "," : "", i);
+        bprint_benchmark_timer(&bp, "demux", &f->bench_demux);
+        av_bprintf(&bp, ",\"queue\":%d,\"streams\":[", queued);
+        for (j = 0; j < f->nb_streams; j++) {
+            InputStream *ist = input_streams[f->ist_index + j];
+            av_bprintf(&bp, "%s{\"index\":%d,\"type\":\"%s\",\"packets\":%"PRIu64",\"frames\":%"PRIu64",",
+                       j ? "," : "", j, (const char *)av_x_if_null(media_type_string(ist->st->codec->codec_type), "unknown"),
+                       ist->nb_packets, ist->frames_decoded);
+            bprint_benchmark_timer(&bp, "decode", &ist->bench_decode);
+            av_bprintf(&bp, "}");
+        }
+        av_bprintf(&bp, "]}");
+    }
+
+    av_bprintf(&bp, "],\"filtergraphs\":[");
+    for (i = 0; i < nb_filtergraphs; i++) {
+        FilterGraph *fg = filtergraphs[i];
+
+        queued = 0;
+#if HAVE_PTHREADS
+        if (fg->pipelined) {
+            pthread_mutex_lock(&fg->queue_lock);
+            queued = av_fifo_size(fg->queue) / sizeof(AVFrame *);
+            pthread_mutex_unlock(&fg->queue_lock);
+        }
+#endif
+        av_bprintf(&bp, "%s{\"index\":%d,", i ? "," : "", i);
+        bprint_benchmark_timer(&bp, "filter", &fg->bench_filter);
+        av_bprintf(&bp, ",\"queue\":%d}", queued);
+    }
+
+    av_bprintf(&bp, "],\"outputs\":[");
+    for (i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+
+        queued = 0;
+#if HAVE_PTHREADS
+        if (of->mux_threaded) {
+            pthread_mutex_lock(&of->mux_queue_lock);
+            queued = av_fifo_size(of->mux_queue) / sizeof(AVPacket);
+            pthread_mutex_unlock(&of->mux_queue_lock);
+        }
+#endif
+        av_bprintf(&bp, "%s{\"index\":%d,\"size\":%"PRId64",", i ? "," : "", i,
+                   output_file_size(of));
+        bprint_benchmark_timer(&bp, "mux", &of->bench_mux);
+        av_bprintf(&bp, ",\"queue\":%d,\"streams\":[", queued);
+        for (j = 0; j < of->ctx->nb_streams; j++) {
+            OutputStream *ost = output_streams[of->ost_index + j];
+            uint64_t packets_written, frames_encoded;
+
+            lock_output_state();
+            packets_written = ost->packets_written;
+            frames_encoded  = ost->frames_encoded;
+            unlock_output_state();
+            av_bprintf(&bp, "%s{\"index\":%d,\"type\":\"%s\",\"packets\":%"PRIu64",\"frames\":%"PRIu64",",
+                       j ? "," : "", j, (const char *)av_x_if_null(media_type_string(ost->st->codec->codec_type), "unknown"),
+                       packets_written, frames_encoded);
+            bprint_benchmark_timer(&bp, "encode", &ost->bench_encode);
+            av_bprintf(&bp, "}");
+        }
+        av_bprintf(&bp, "]}");
+    }
+    av_bprintf(&bp, "]}\n");
+
+    if (av_bprint_is_complete(&bp))
+        avio_write(benchmark_json_avio, bp.str, bp.len);
+    avio_flush(benchmark_json_avio);
+    av_bprint_finalize(&bp, NULL);
+}
+
 static void print_report(int is_last_report, int64_t timer_start, int64_t cur_time)
 {
     char buf[1024];
     AVBPrint buf_script;
     OutputStream *ost;
-    AVFormatContext *oc;
     int64_t total_size;
     AVCodecContext *enc;
-    int frame_number, vid, i;
+    int frame_number, vid, i, frames_dup, frames_drop;
     double bitrate;
     int64_t pts = INT64_MIN;
     static int64_t last_time = -1;
     static int qp_histogram[52];
     int hours, mins, secs, us;
 
-    if (!print_stats && !is_last_report && !progress_avio)
+    if (!print_stats && !is_last_report && !progress_avio && !benchmark_json_avio)
         return;
 
     if (!is_last_report) {
@@ -1326,21 +1865,28 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     }
 
 
-    oc = output_files[0]->ctx;
-
-    total_size = avio_size(oc->pb);
-    if (total_size <= 0) // FIXME improve avio_size() so it works with non seekable output too
-        total_size = avio_tell(oc->pb);
+    total_size = output_file_size(output_files[0]);
 
     buf[0] = '\0';
     vid = 0;
     av_bprint_init(&buf_script, 0, 1);
     for (i = 0; i < nb_output_streams; i++) {
         float q = -1;
+        int quality;
+        uint64_t coded_error[3];
+        int64_t last_pts;
+
         ost = output_streams[i];
         enc = ost->st->codec;
-        if (!ost->stream_copy && enc->coded_frame)
-            q = enc->coded_frame->quality / (float)FF_QP2LAMBDA;
+        lock_output_state();
+        quality      = ost->quality;
+        frame_number = ost->frame_number;
+        last_pts     = ost->last_pts;
+        memcpy(coded_error, ost->error, sizeof(coded_error));
+        unlock_output_state();
+
+        if (!ost->stream_copy && quality >= 0)
+            q = quality / (float)FF_QP2LAMBDA;
         if (vid && enc->codec_type == AVMEDIA_TYPE_VIDEO) {
             snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "q=%2.1f ", q);
             av_bprintf(&buf_script, "stream_%d_%d_q=%.1f\n",
@@ -1349,7 +1895,6 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         if (!vid && enc->codec_type == AVMEDIA_TYPE_VIDEO) {
             float fps, t = (cur_time-timer_start) / 1000000.0;
 
-            frame_number = ost->frame_number;
             fps = t > 1 ? frame_number / t : 0;
             snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "frame=%5d fps=%3.*f q=%3.1f ",
                      frame_number, fps < 9.95, fps, q);
@@ -1379,7 +1924,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
                         error = enc->error[j];
                         scale = enc->width * enc->height * 255.0 * 255.0 * frame_number;
                     } else {
-                        error = enc->coded_frame->error[j];
+                        error = coded_error[j];
                         scale = enc->width * enc->height * 255.0 * 255.0;
                     }
                     if (j)
@@ -1399,8 +1944,8 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
             vid = 1;
         }
         /* compute min output value */
-        if (ost->st->pts.val != AV_NOPTS_VALUE)
-            pts = FFMAX(pts, av_rescale_q(ost->st->pts.val,
+        if (last_pts != AV_NOPTS_VALUE)
+            pts = FFMAX(pts, av_rescale_q(last_pts,
                                           ost->st->time_base, AV_TIME_BASE_Q));
     }
 
@@ -1430,11 +1975,42 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     av_bprintf(&buf_script, "out_time=%02d:%02d:%02d.%06d\n",
                hours, mins, secs, us);
 
-    if (nb_frames_dup || nb_frames_drop)
+    lock_output_state();
+    frames_dup  = nb_frames_dup;
+    frames_drop = nb_frames_drop;
+    unlock_output_state();
+    if (frames_dup || frames_drop)
         snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), " dup=%d drop=%d",
-                nb_frames_dup, nb_frames_drop);
-    av_bprintf(&buf_script, "dup_frames=%d\n", nb_frames_dup);
-    av_bprintf(&buf_script, "drop_frames=%d\n", nb_frames_drop);
+                frames_dup, frames_drop);
+    av_bprintf(&buf_script, "dup_frames=%d\n", frames_dup);
+    av_bprintf(&buf_script, "drop_frames=%d\n", frames_drop);
+
+    for (i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+        uint64_t stalls, dropped;
+        int64_t stall_time;
+
+        if (of->mux_queue_size <= 0)
+            continue;
+#if HAVE_PTHREADS
+        /* updated by the threads queueing packets */
+        if (of->mux_threaded)
+            pthread_mutex_lock(&of->mux_queue_lock);
+#endif
+        stalls     = of->mux_stalls;
+        stall_time = of->mux_stall_time;
+        dropped    = of->mux_dropped;
+#if HAVE_PTHREADS
+        if (of->mux_threaded)
+            pthread_mutex_unlock(&of->mux_queue_lock);
+#endif
+        if (stalls || dropped)
+            snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), " mux%d:stall=%"PRIu64"/%.1fs drop=%"PRIu64,
+                     i, stalls, stall_time / 1000000.0, dropped);
+        av_bprintf(&buf_script, "mux_%d_stalls=%"PRIu64"\n", i, stalls);
+        av_bprintf(&buf_script, "mux_%d_stall_time_ms=%"PRId64"\n", i, stall_time / 1000);
+        av_bprintf(&buf_script, "mux_%d_dropped=%"PRIu64"\n", i, dropped);
+    }
 
     if (print_stats || is_last_report) {
         if (print_stats==1 && AV_LOG_INFO > av_log_get_level()) {
@@ -1458,12 +2034,16 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         }
     }
 
+    if (benchmark_json_avio)
+        print_benchmark_json(is_last_report, timer_start, cur_time);
+
     if (is_last_report)
         print_final_stats(total_size);
 }
 
 static void flush_encoders(void)
 {
+    int64_t bench[2];
     int i, ret;
 
     for (i = 0; i < nb_output_streams; i++) {
@@ -1506,12 +2086,15 @@ static void flush_encoders(void)
                 pkt.size = 0;
 
                 update_benchmark(NULL);
+                benchmark_start(bench);
                 ret = encode(enc, &pkt, NULL, &got_packet);
+                benchmark_stop(&ost->bench_encode, bench);
                 update_benchmark("flush %s %d.%d", desc, ost->file_index, ost->index);
                 if (ret < 0) {
                     av_log(NULL, AV_LOG_FATAL, "%s encoding failed\n", desc);
                     exit_program(1);
                 }
+                update_encoder_stats(ost);
                 if (ost->logfile && enc->stats_out) {
                     fprintf(ost->logfile, "%s", enc->stats_out);
                 }
@@ -1519,7 +2102,7 @@ static void flush_encoders(void)
                     stop_encoding = 1;
                     break;
                 }
-                if (ost->finished & MUXER_FINISHED) {
+                if (output_stream_finished(ost) & MUXER_FINISHED) {
                     av_free_packet(&pkt);
                     continue;
                 }
@@ -1530,7 +2113,8 @@ static void flush_encoders(void)
                 if (pkt.duration > 0)
                     pkt.duration = av_rescale_q(pkt.duration, enc->time_base, ost->st->time_base);
                 pkt_size = pkt.size;
-                write_frame(os, &pkt, ost);
+                if (write_frame(os, &pkt, ost) < 0)
+                    exit_program(1);
                 if (ost->st->codec->codec_type == AVMEDIA_TYPE_VIDEO && vstats_filename) {
                     do_video_stats(ost, pkt_size);
                 }
@@ -1553,7 +2137,7 @@ static int check_output_constraints(InputStream *ist, OutputStream *ost)
     if (ost->source_index != ist_index)
         return 0;
 
-    if (ost->finished)
+    if (output_stream_finished(ost))
         return 0;
 
     if (of->start_time != AV_NOPTS_VALUE && ist->pts < of->start_time)
@@ -1659,7 +2243,8 @@ static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *p
         opkt.flags |= AV_PKT_FLAG_KEY;
     }
 
-    write_frame(of->ctx, &opkt, ost);
+    if (write_frame(of->ctx, &opkt, ost) < 0)
+        exit_program(1);
     ost->st->codec->frame_number++;
 }
 
@@ -1683,12 +2268,261 @@ int guess_input_channel_layout(InputStream *ist)
     return 1;
 }
 
+#if HAVE_PTHREADS
+static void *filter_thread(void *arg)
+{
+    FilterGraph *fg = arg;
+    InputFilter *ifilter = fg->inputs[0];
+    AVFrame *frame;
+    int64_t bench[2];
+    int i, ret = 0;
+
+    while (ret >= 0) {
+        pthread_mutex_lock(&fg->queue_lock);
+        while (!av_fifo_size(fg->queue) && !fg->drain && !fg->abort)
+            pthread_cond_wait(&fg->queue_cond, &fg->queue_lock);
+        if (!av_fifo_size(fg->queue) || fg->abort) {
+            pthread_mutex_unlock(&fg->queue_lock);
+            break;
+        }
+        av_fifo_generic_read(fg->queue, &frame, sizeof(frame), NULL);
+        fg->busy = 1;
+        pthread_cond_signal(&fg->queue_cond);
+        pthread_mutex_unlock(&fg->queue_lock);
+
+        benchmark_start(bench);
+        if (frame)
+            ret = av_buffersrc_add_frame_flags(ifilter->filter, frame, AV_BUFFERSRC_FLAG_PUSH);
+        else
+            ret = av_buffersrc_add_ref(ifilter->filter, NULL, 0);
+        benchmark_stop(&fg->bench_filter, bench);
+        av_frame_free(&frame);
+        if (ret == AVERROR_EOF)
+            ret = 0; /* ignore */
+
+        /* drain the graph like transcode_from_filter() does */
+        while (ret >= 0) {
+            for (i = 0; i < fg->nb_outputs && ret >= 0; i++)
+                ret = reap_filter_output(fg->outputs[i]->ost);
+            if (ret < 0)
+                break;
+            benchmark_start(bench);
+            ret = avfilter_graph_request_oldest(fg->graph);
+            benchmark_stop(&fg->bench_filter, bench);
+        }
+        if (ret == AVERROR_EOF)
+            for (i = 0; i < fg->nb_outputs; i++)
+                close_output_stream(fg->outputs[i]->ost);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            ret = 0;
+
+        pthread_mutex_lock(&fg->queue_lock);
+        fg->busy = 0;
+        pthread_cond_signal(&fg->queue_cond);
+        pthread_mutex_unlock(&fg->queue_lock);
+    }
+
+    pthread_mutex_lock(&fg->queue_lock);
+    fg->error    = ret;
+    fg->finished = 1;
+    pthread_cond_signal(&fg->queue_cond);
+    pthread_mutex_unlock(&fg->queue_lock);
+    return NULL;
+}
+
+/* Hand a decoded frame, or EOF when frame is NULL, over to the thread of fg.
+ * Like av_buffersrc_add_frame(), the references of frame are moved. */
+static int filter_thread_send(FilterGraph *fg, AVFrame *frame)
+{
+    AVFrame *f = NULL;
+    int ret = 0;
+
+    if (frame) {
+        if (!(f = av_frame_alloc()))
+            return AVERROR(ENOMEM);
+        av_frame_move_ref(f, frame);
+    }
+
+    pthread_mutex_lock(&fg->queue_lock);
+    while (!av_fifo_space(fg->queue) && !fg->finished)
+        pthread_cond_wait(&fg->queue_cond, &fg->queue_lock);
+    if (fg->finished) {
+        ret = fg->error < 0 ? fg->error : AVERROR_EOF;
+        av_frame_free(&f);
+    } else {
+        av_fifo_generic_write(fg->queue, &f, sizeof(f), NULL);
+        pthread_cond_signal(&fg->queue_cond);
+    }
+    pthread_mutex_unlock(&fg->queue_lock);
+
+    return ret;
+}
+
+/* Wait until the thread of fg has processed all the frames sent to it. */
+static void filter_thread_wait(FilterGraph *fg)
+{
+    if (!fg->pipelined)
+        return;
+
+    pthread_mutex_lock(&fg->queue_lock);
+    while ((av_fifo_size(fg->queue) || fg->busy) && !fg->finished)
+        pthread_cond_wait(&fg->queue_cond, &fg->queue_lock);
+    pthread_mutex_unlock(&fg->queue_lock);
+}
+
+/* Return the error a filter thread stopped on, 0 if all are running. The
+ * threads never exit the program, their errors end the main loop instead. */
+static int filter_threads_error(void)
+{
+    int i, ret = 0;
+
+    for (i = 0; i < nb_filtergraphs && !ret; i++) {
+        FilterGraph *fg = filtergraphs[i];
+
+        if (!fg->pipelined)
+            continue;
+        pthread_mutex_lock(&fg->queue_lock);
+        if (fg->finished)
+            ret = fg->error;
+        pthread_mutex_unlock(&fg->queue_lock);
+    }
+    return ret;
+}
+
+/* Make the filter threads exit without filtering the frames still queued,
+ * when exiting early. Like for the muxing threads, a write in progress is
+ * interrupted if its protocol checks the interrupt callback. */
+static void abort_filter_threads(void)
+{
+    int i;
+
+    for (i = 0; i < nb_filtergraphs; i++) {
+        FilterGraph *fg = filtergraphs[i];
+
+        if (!fg->pipelined)
+            continue;
+        lock_output_state();
+        threads_io_aborted = 1;
+        unlock_output_state();
+        pthread_mutex_lock(&fg->queue_lock);
+        fg->abort = 1;
+        pthread_cond_signal(&fg->queue_cond);
+        pthread_mutex_unlock(&fg->queue_lock);
+    }
+}
+
+/* Join the filter threads, returning the first error one stopped on. */
+static int free_filter_threads(void)
+{
+    int i, ret = 0;
+
+    for (i = 0; i < nb_filtergraphs; i++) {
+        FilterGraph *fg = filtergraphs[i];
+        AVFrame *frame;
+
+        if (!fg->pipelined)
+            continue;
+
+        /* let the thread filter what it was sent, then join it */
+        pthread_mutex_lock(&fg->queue_lock);
+        fg->drain = 1;
+        pthread_cond_signal(&fg->queue_cond);
+        pthread_mutex_unlock(&fg->queue_lock);
+
+        pthread_join(fg->thread, NULL);
+        fg->pipelined = 0;
+        if (!ret)
+            ret = fg->error;
+
+        while (av_fifo_size(fg->queue)) {
+            av_fifo_generic_read(fg->queue, &frame, sizeof(frame), NULL);
+            av_frame_free(&frame);
+        }
+        av_fifo_free(fg->queue);
+        fg->queue = NULL;
+        pthread_mutex_destroy(&fg->queue_lock);
+        pthread_cond_destroy (&fg->queue_cond);
+    }
+    return ret;
+}
+
+static int init_filter_threads(void)
+{
+    int i, ret;
+
+    if (!do_pipeline)
+        return 0;
+    /* the benchmark timer and the vstats file are shared by all encoders */
+    if (do_benchmark_all || vstats_filename) {
+        av_log(NULL, AV_LOG_WARNING, "-pipeline is not compatible with "
+               "-benchmark_all and -vstats, disabling it.\n");
+        return 0;
+    }
+
+    for (i = 0; i < nb_filtergraphs; i++) {
+        FilterGraph *fg = filtergraphs[i];
+        enum AVMediaType type;
+        int j;
+
+        /* only simple graphs, possibly shared by several output streams, are
+         * run apart, complex graphs are driven by the main loop through
+         * transcode_from_filter() */
+        if (fg->graph_desc || fg->nb_inputs != 1)
+            continue;
+        type = fg->inputs[0]->ist->st->codec->codec_type;
+        if (type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_AUDIO)
+            continue;
+        /* -shortest needs the streams of a file to be ended in order */
+        for (j = 0; j < fg->nb_outputs; j++)
+            if (output_files[fg->outputs[j]->ost->file_index]->shortest)
+                break;
+        if (j < fg->nb_outputs)
+            continue;
+
+        if (!(fg->queue = av_fifo_alloc(8 * sizeof(AVFrame *))))
+            return AVERROR(ENOMEM);
+
+        pthread_mutex_init(&fg->queue_lock, NULL);
+        pthread_cond_init (&fg->queue_cond, NULL);
+
+        /* set before the first frame can reach write_frame() */
+        nb_filter_threads++;
+        fg->pipelined = 1;
+        if ((ret = pthread_create(&fg->thread, NULL, filter_thread, fg))) {
+            fg->pipelined = 0;
+            return AVERROR(ret);
+        }
+    }
+    return 0;
+}
+#endif
+
+/* Send a decoded frame, or EOF when frame is NULL, to a filtergraph input. */
+static int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame)
+{
+    int64_t bench[2];
+    int ret;
+
+#if HAVE_PTHREADS
+    if (ifilter->graph->pipelined)
+        return filter_thread_send(ifilter->graph, frame);
+#endif
+    benchmark_start(bench);
+    if (!frame)
+        ret = av_buffersrc_add_ref(ifilter->filter, NULL, 0);
+    else
+        ret = av_buffersrc_add_frame_flags(ifilter->filter, frame, AV_BUFFERSRC_FLAG_PUSH);
+    benchmark_stop(&ifilter->graph->bench_filter, bench);
+    return ret;
+}
+
 static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output)
 {
     AVFrame *decoded_frame, *f;
     AVCodecContext *avctx = ist->st->codec;
     int i, ret, err = 0, resample_changed;
     AVRational decoded_frame_tb;
+    int64_t bench[2];
 
     if (!ist->decoded_frame && !(ist->decoded_frame = av_frame_alloc()))
         return AVERROR(ENOMEM);
@@ -1697,7 +2531,9 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output)
     decoded_frame = ist->decoded_frame;
 
     update_benchmark(NULL);
+    benchmark_start(bench);
     ret = avcodec_decode_audio4(avctx, decoded_frame, got_output, pkt);
+    benchmark_stop(&ist->bench_decode, bench);
     update_benchmark("decode_audio %d.%d", ist->file_index, ist->st->index);
 
     if (ret >= 0 && avctx->sample_rate <= 0) {
@@ -1711,11 +2547,7 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output)
     if (!*got_output || ret < 0) {
         if (!pkt->size) {
             for (i = 0; i < ist->nb_filters; i++)
-#if 1
-                av_buffersrc_add_ref(ist->filters[i]->filter, NULL, 0);
-#else
-                av_buffersrc_add_frame(ist->filters[i]->filter, NULL);
-#endif
+                ifilter_send_frame(ist->filters[i], NULL);
         }
         return ret;
     }
@@ -1769,6 +2601,9 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output)
             if (ist_in_filtergraph(filtergraphs[i], ist)) {
                 FilterGraph *fg = filtergraphs[i];
                 int j;
+#if HAVE_PTHREADS
+                filter_thread_wait(fg);
+#endif
                 if (configure_filtergraph(fg) < 0) {
                     av_log(NULL, AV_LOG_FATAL, "Error reinitializing filters!\n");
                     exit_program(1);
@@ -1812,8 +2647,7 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output)
                 break;
         } else
             f = decoded_frame;
-        err = av_buffersrc_add_frame_flags(ist->filters[i]->filter, f,
-                                     AV_BUFFERSRC_FLAG_PUSH);
+        err = ifilter_send_frame(ist->filters[i], f);
         if (err == AVERROR_EOF)
             err = 0; /* ignore */
         if (err < 0)
@@ -1830,7 +2664,7 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output)
 {
     AVFrame *decoded_frame, *f;
     int i, ret = 0, err = 0, resample_changed;
-    int64_t best_effort_timestamp;
+    int64_t best_effort_timestamp, bench[2];
     AVRational *frame_sample_aspect;
 
     if (!ist->decoded_frame && !(ist->decoded_frame = av_frame_alloc()))
@@ -1841,8 +2675,10 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output)
     pkt->dts  = av_rescale_q(ist->dts, AV_TIME_BASE_Q, ist->st->time_base);
 
     update_benchmark(NULL);
+    benchmark_start(bench);
     ret = avcodec_decode_video2(ist->st->codec,
                                 decoded_frame, got_output, pkt);
+    benchmark_stop(&ist->bench_decode, bench);
     update_benchmark("decode_video %d.%d", ist->file_index, ist->st->index);
 
     if (*got_output || ret<0 || pkt->size)
@@ -1851,11 +2687,7 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output)
     if (!*got_output || ret < 0) {
         if (!pkt->size) {
             for (i = 0; i < ist->nb_filters; i++)
-#if 1
-                av_buffersrc_add_ref(ist->filters[i]->filter, NULL, 0);
-#else
-                av_buffersrc_add_frame(ist->filters[i]->filter, NULL);
-#endif
+                ifilter_send_frame(ist->filters[i], NULL);
         }
         return ret;
     }
@@ -1907,8 +2739,12 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output)
         ist->resample_pix_fmt = decoded_frame->format;
 
         for (i = 0; i < nb_filtergraphs; i++) {
-            if (ist_in_filtergraph(filtergraphs[i], ist) && ist->reinit_filters &&
-                configure_filtergraph(filtergraphs[i]) < 0) {
+            if (!ist_in_filtergraph(filtergraphs[i], ist) || !ist->reinit_filters)
+                continue;
+#if HAVE_PTHREADS
+            filter_thread_wait(filtergraphs[i]);
+#endif
+            if (configure_filtergraph(filtergraphs[i]) < 0) {
                 av_log(NULL, AV_LOG_FATAL, "Error reinitializing filters!\n");
                 exit_program(1);
             }
@@ -1927,7 +2763,7 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output)
                 break;
         } else
             f = decoded_frame;
-        ret = av_buffersrc_add_frame_flags(ist->filters[i]->filter, f, AV_BUFFERSRC_FLAG_PUSH);
+        ret = ifilter_send_frame(ist->filters[i], f);
         if (ret == AVERROR_EOF) {
             ret = 0; /* ignore */
         } else if (ret < 0) {
@@ -1946,8 +2782,12 @@ fail:
 static int transcode_subtitles(InputStream *ist, AVPacket *pkt, int *got_output)
 {
     AVSubtitle subtitle;
-    int i, ret = avcodec_decode_subtitle2(ist->st->codec,
-                                          &subtitle, got_output, pkt);
+    int64_t bench[2];
+    int i, ret;
+
+    benchmark_start(bench);
+    ret = avcodec_decode_subtitle2(ist->st->codec, &subtitle, got_output, pkt);
+    benchmark_stop(&ist->bench_decode, bench);
 
     if (*got_output || ret<0 || pkt->size)
         decode_error_stat[ret<0] ++;
@@ -2582,7 +3422,8 @@ static int transcode_init(void)
                 (codec->codec_type == AVMEDIA_TYPE_VIDEO ||
                  codec->codec_type == AVMEDIA_TYPE_AUDIO)) {
                     FilterGraph *fg;
-                    fg = init_simple_filtergraph(ist, ost);
+                    if (!(fg = init_shared_filtergraph(ist, ost)))
+                        fg = init_simple_filtergraph(ist, ost);
                     if (configure_filtergraph(fg)) {
                         av_log(NULL, AV_LOG_FATAL, "Error opening filters!\n");
                         exit_program(1);
@@ -2760,6 +3601,7 @@ static int transcode_init(void)
                         ost->file_index, ost->index);
                 goto dump_format;
             }
+            update_encoder_stats(ost);
             if (ost->enc->type == AVMEDIA_TYPE_AUDIO &&
                 !(ost->enc->capabilities & CODEC_CAP_VARIABLE_FRAME_SIZE))
                 av_buffersink_set_frame_size(ost->filter->filter,
@@ -2811,6 +3653,15 @@ static int transcode_init(void)
             ret = AVERROR(EINVAL);
             goto dump_format;
         }
+        for (j = 0; j < oc->nb_streams; j++) {
+            ost = output_streams[output_files[i]->ost_index + j];
+            ost->last_cur_dts = ost->st->cur_dts;
+            ost->last_pts     = ost->st->pts.val;
+        }
+#if HAVE_PTHREADS
+        if (oc->pb)
+            output_files[i]->mux_pos = avio_tell(oc->pb);
+#endif
 //         assert_avoptions(output_files[i]->opts);
         if (strcmp(oc->oformat->name, "rtp")) {
             want_sdp = 0;
@@ -2901,11 +3752,17 @@ static int need_output(void)
         OutputStream *ost    = output_streams[i];
         OutputFile *of       = output_files[ost->file_index];
         AVFormatContext *os  = output_files[ost->file_index]->ctx;
+        int frame_number;
+
+        lock_output_state();
+        frame_number = ost->frame_number;
+        unlock_output_state();
 
-        if (ost->finished ||
-            (os->pb && avio_tell(os->pb) >= of->limit_filesize))
+        if (output_stream_finished(ost))
             continue;
-        if (ost->frame_number >= ost->max_frames) {
+        if (os->pb && output_file_tell(of) >= of->limit_filesize)
+            continue;
+        if (frame_number >= ost->max_frames) {
             int j;
             for (j = 0; j < of->ctx->nb_streams; j++)
                 close_output_stream(output_streams[of->ost_index + j]);
@@ -2929,15 +3786,17 @@ static OutputStream *choose_output(void)
     int64_t opts_min = INT64_MAX;
     OutputStream *ost_min = NULL;
 
+    lock_output_state();
     for (i = 0; i < nb_output_streams; i++) {
         OutputStream *ost = output_streams[i];
-        int64_t opts = av_rescale_q(ost->st->cur_dts, ost->st->time_base,
+        int64_t opts = av_rescale_q(ost->last_cur_dts, ost->st->time_base,
                                     AV_TIME_BASE_Q);
         if (!ost->unavailable && !ost->finished && opts < opts_min) {
             opts_min = opts;
             ost_min  = ost;
         }
     }
+    unlock_output_state();
     return ost_min;
 }
 
@@ -3039,14 +3898,96 @@ static int check_keyboard_interaction(int64_t cur_time)
 }
 
 #if HAVE_PTHREADS
+/* the queue_lock of f must be held */
+static int input_queue_empty(InputFile *f)
+{
+    return f->queue_rd == f->queue_wr;
+}
+
+/* the queue_lock of f must be held */
+static int input_queue_full(InputFile *f)
+{
+    return (f->queue_wr + 1) % (f->queue_size + 1) == f->queue_rd;
+}
+
+static int input_thread_aborted(InputFile *f)
+{
+    int abort;
+
+    pthread_mutex_lock(&f->queue_lock);
+    abort = f->abort;
+    pthread_mutex_unlock(&f->queue_lock);
+    return abort;
+}
+
+/* Sleep until pkt is due when reading f at its native rate. Packets are due
+ * at a fixed offset from an anchor taken on the first packet, so time spent
+ * elsewhere or oversleeping does not add up. */
+static void rate_emu_wait(InputFile *f, const AVPacket *pkt)
+{
+    AVStream *st = f->ctx->streams[pkt->stream_index];
+    int64_t ts, deadline, now = av_gettime();
+
+    if (f->rate_emu_bitrate && pkt->pos >= 0) {
+        ts = av_rescale(pkt->pos, 8 * AV_TIME_BASE, f->ctx->bit_rate);
+    } else {
+        ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+        if (ts == AV_NOPTS_VALUE)
+            return;
+        ts = av_rescale_q(ts, st->time_base, AV_TIME_BASE_Q);
+    }
+
+    if (f->rate_emu_wall == AV_NOPTS_VALUE) {
+        f->rate_emu_wall    = now;
+        f->rate_emu_ts      = ts;
+        f->rate_emu_last_ts = ts;
+    }
+    deadline = f->rate_emu_wall + ts - f->rate_emu_ts;
+
+    /* start again from this packet on timestamp discontinuities, and when
+     * lagging by more than -re_max_lag; smaller lags are caught up */
+    if (FFABS(ts - f->rate_emu_last_ts) > dts_delta_threshold * AV_TIME_BASE ||
+        (f->rate_emu_max_lag > 0 && now - deadline > f->rate_emu_max_lag)) {
+        av_log(NULL, AV_LOG_VERBOSE, "%s: -re clock resynced, %0.3fs off\n",
+               f->ctx->filename, (now - deadline) / 1000000.0);
+        f->rate_emu_wall = deadline = now;
+        f->rate_emu_ts   = ts;
+    }
+    f->rate_emu_last_ts = ts;
+
+    deadline -= f->rate_emu_burst;
+    while (!input_thread_aborted(f) && (now = av_gettime()) < deadline)
+        av_usleep(FFMIN(deadline - now, 100000));
+}
+
+/* the main thread sleeps in merge_next_input() until any input queues a
+ * packet or finishes */
+static pthread_mutex_t merge_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  merge_cond = PTHREAD_COND_INITIALIZER;
+
+/* inputs with a queued packet, as a min-heap on the timestamp of that packet */
+static InputFile **merge_heap;
+static int nb_merge_heap;
+
+static void merge_wake(void)
+{
+    pthread_mutex_lock(&merge_lock);
+    pthread_cond_signal(&merge_cond);
+    pthread_mutex_unlock(&merge_lock);
+}
+
 static void *input_thread(void *arg)
 {
     InputFile *f = arg;
     int ret = 0;
 
-    while (!transcoding_finished && ret >= 0) {
+    while (!input_thread_aborted(f) && ret >= 0) {
         AVPacket pkt;
+        int64_t bench[2];
+
+        benchmark_start(bench);
         ret = av_read_frame(f->ctx, &pkt);
+        benchmark_stop(&f->bench_demux, bench);
 
         if (ret == AVERROR(EAGAIN)) {
             av_usleep(10000);
@@ -3055,117 +3996,302 @@ static void *input_thread(void *arg)
         } else if (ret < 0)
             break;
 
-        pthread_mutex_lock(&f->fifo_lock);
-        while (!av_fifo_space(f->fifo))
-            pthread_cond_wait(&f->fifo_cond, &f->fifo_lock);
-
         av_dup_packet(&pkt);
-        av_fifo_generic_write(f->fifo, &pkt, sizeof(pkt), NULL);
-        pthread_cond_signal(&f->fifo_cond);
 
-        pthread_mutex_unlock(&f->fifo_lock);
+        if (f->rate_emu)
+            rate_emu_wait(f, &pkt);
+
+        pthread_mutex_lock(&f->queue_lock);
+        while (input_queue_full(f) && !f->abort)
+            pthread_cond_wait(&f->queue_cond, &f->queue_lock);
+        if (f->abort) {
+            pthread_mutex_unlock(&f->queue_lock);
+            av_free_packet(&pkt);
+            break;
+        }
+        f->queue[f->queue_wr] = pkt;
+        f->queue_wr = (f->queue_wr + 1) % (f->queue_size + 1);
+        pthread_cond_signal(&f->queue_cond);
+        pthread_mutex_unlock(&f->queue_lock);
+        merge_wake();
     }
 
-    pthread_mutex_lock(&f->fifo_lock);
+    pthread_mutex_lock(&f->queue_lock);
     f->finished = 1;
-    pthread_cond_signal(&f->fifo_cond);
-    pthread_mutex_unlock(&f->fifo_lock);
+    pthread_cond_signal(&f->queue_cond);
+    pthread_mutex_unlock(&f->queue_lock);
+    merge_wake();
     return NULL;
 }
 
+/* the queue_lock of f must be held */
+static void input_queue_flush(InputFile *f)
+{
+    while (!input_queue_empty(f)) {
+        av_free_packet(&f->queue[f->queue_rd]);
+        f->queue_rd = (f->queue_rd + 1) % (f->queue_size + 1);
+    }
+}
+
 static void free_input_threads(void)
 {
     int i;
 
-    if (nb_input_files == 1)
-        return;
-
-    transcoding_finished = 1;
-
     for (i = 0; i < nb_input_files; i++) {
         InputFile *f = input_files[i];
-        AVPacket pkt;
 
-        if (!f->fifo || f->joined)
+        if (!f->queue || f->joined)
             continue;
 
-        pthread_mutex_lock(&f->fifo_lock);
-        while (av_fifo_size(f->fifo)) {
-            av_fifo_generic_read(f->fifo, &pkt, sizeof(pkt), NULL);
-            av_free_packet(&pkt);
-        }
-        pthread_cond_signal(&f->fifo_cond);
-        pthread_mutex_unlock(&f->fifo_lock);
+        /* wake up the thread if it waits for room in the queue */
+        pthread_mutex_lock(&f->queue_lock);
+        f->abort = 1;
+        input_queue_flush(f);
+        pthread_cond_signal(&f->queue_cond);
+        pthread_mutex_unlock(&f->queue_lock);
 
         pthread_join(f->thread, NULL);
         f->joined = 1;
 
-        while (av_fifo_size(f->fifo)) {
-            av_fifo_generic_read(f->fifo, &pkt, sizeof(pkt), NULL);
-            av_free_packet(&pkt);
-        }
-        av_fifo_free(f->fifo);
+        av_freep(&f->queue);
     }
+    av_freep(&merge_heap);
+    nb_merge_heap = 0;
 }
 
 static int init_input_threads(void)
 {
     int i, ret;
 
-    if (nb_input_files == 1)
-        return 0;
-
     for (i = 0; i < nb_input_files; i++) {
         InputFile *f = input_files[i];
 
-        if (!(f->fifo = av_fifo_alloc(8*sizeof(AVPacket))))
+        if (!(f->queue = av_mallocz_array(f->queue_size + 1, sizeof(*f->queue))))
             return AVERROR(ENOMEM);
 
-        if (f->ctx->pb ? !f->ctx->pb->seekable :
-            strcmp(f->ctx->iformat->name, "lavfi"))
+        /* with several inputs, a file that has nothing to read must not
+         * keep the others waiting */
+        if (nb_input_files > 1 &&
+            (f->ctx->pb ? !f->ctx->pb->seekable :
+             strcmp(f->ctx->iformat->name, "lavfi")))
             f->non_blocking = 1;
 
-        pthread_mutex_init(&f->fifo_lock, NULL);
-        pthread_cond_init (&f->fifo_cond, NULL);
+        pthread_mutex_init(&f->queue_lock, NULL);
+        pthread_cond_init (&f->queue_cond, NULL);
+
+        f->merge_ts           = AV_NOPTS_VALUE;
+        f->merge_starve_start = AV_NOPTS_VALUE;
 
-        if ((ret = pthread_create(&f->thread, NULL, input_thread, f)))
+        if ((ret = pthread_create(&f->thread, NULL, input_thread, f))) {
+            av_freep(&f->queue);
             return AVERROR(ret);
+        }
     }
     return 0;
 }
 
 static int get_input_packet_mt(InputFile *f, AVPacket *pkt)
 {
-    int ret = 0;
+    pthread_mutex_lock(&f->queue_lock);
+    if (input_queue_empty(f) && f->non_blocking && !f->finished) {
+        pthread_mutex_unlock(&f->queue_lock);
+        return AVERROR(EAGAIN);
+    }
+    while (input_queue_empty(f) && !f->finished)
+        pthread_cond_wait(&f->queue_cond, &f->queue_lock);
 
-    pthread_mutex_lock(&f->fifo_lock);
+    /* the thread may have queued packets right before finishing */
+    if (input_queue_empty(f)) {
+        pthread_mutex_unlock(&f->queue_lock);
+        return AVERROR_EOF;
+    }
 
-    while (1) {
-    if (av_fifo_size(f->fifo)) {
-        av_fifo_generic_read(f->fifo, pkt, sizeof(*pkt), NULL);
-        pthread_cond_signal(&f->fifo_cond);
-        break;
-    } else {
-        if (f->finished) {
-            ret = AVERROR_EOF;
+    *pkt = f->queue[f->queue_rd];
+    f->queue_rd = (f->queue_rd + 1) % (f->queue_size + 1);
+    pthread_cond_signal(&f->queue_cond);
+    pthread_mutex_unlock(&f->queue_lock);
+
+    return 0;
+}
+
+/* Return 1 if the input thread of f has queued a packet, -1 if it has
+ * finished with nothing queued and 0 otherwise. */
+static int input_queue_state(InputFile *f)
+{
+    int state;
+
+    pthread_mutex_lock(&f->queue_lock);
+    state = !input_queue_empty(f) ? 1 : f->finished ? -1 : 0;
+    pthread_mutex_unlock(&f->queue_lock);
+    return state;
+}
+
+static void merge_heap_push(InputFile *f)
+{
+    int i = nb_merge_heap++;
+
+    while (i > 0 && merge_heap[(i - 1) / 2]->merge_ts > f->merge_ts) {
+        merge_heap[i] = merge_heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    merge_heap[i]   = f;
+    f->merge_queued = 1;
+}
+
+static InputFile *merge_heap_pop(void)
+{
+    InputFile *top  = merge_heap[0];
+    InputFile *last = merge_heap[--nb_merge_heap];
+    int i = 0;
+
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= nb_merge_heap)
             break;
-        }
-        if (f->non_blocking) {
-            ret = AVERROR(EAGAIN);
+        if (child + 1 < nb_merge_heap &&
+            merge_heap[child + 1]->merge_ts < merge_heap[child]->merge_ts)
+            child++;
+        if (last->merge_ts <= merge_heap[child]->merge_ts)
             break;
+        merge_heap[i] = merge_heap[child];
+        i = child;
+    }
+    merge_heap[i]     = last;
+    top->merge_queued = 0;
+    return top;
+}
+
+/* Update the merge timestamp of f from the packet at the head of its queue.
+ * Packets without timestamps are taken as soon as they are at the head. */
+static void merge_update_ts(InputFile *f)
+{
+    const AVPacket *pkt = &f->queue[f->queue_rd];
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+
+    if (pkt->stream_index >= f->nb_streams || ts == AV_NOPTS_VALUE) {
+        if (f->merge_ts == AV_NOPTS_VALUE)
+            f->merge_ts = INT64_MIN;
+        return;
+    }
+    f->merge_ts = av_rescale_q(ts, f->ctx->streams[pkt->stream_index]->time_base,
+                               AV_TIME_BASE_Q) + f->ts_offset;
+}
+
+/* Nothing can be merged before one of the pending inputs queues a packet,
+ * finishes or the deadline passes. */
+static void merge_wait(int64_t deadline)
+{
+    struct timespec abstime = { deadline / 1000000, deadline % 1000000 * 1000 };
+    int i, arrived = 0;
+
+    pthread_mutex_lock(&merge_lock);
+    for (i = 0; i < nb_input_files; i++) {
+        InputFile *f = input_files[i];
+        if (!f->eof_reached && !f->merge_queued && input_queue_state(f))
+            arrived = 1;
+    }
+    if (!arrived)
+        pthread_cond_timedwait(&merge_cond, &merge_lock, &abstime);
+    pthread_mutex_unlock(&merge_lock);
+}
+
+/*
+ * Pick the input holding the earliest packet over all inputs, for
+ * -merge_inputs.
+ *
+ * A packet may be taken once every other input has queued a later one. An
+ * input that has nothing queued holds the others back unless the packet is
+ * at most merge_window after the last timestamp seen from it; after waiting
+ * merge_timeout for it, it is considered starved and the others are merged
+ * without it until it queues a packet again.
+ *
+ * Return
+ * - the index of the input to call process_input() for
+ * - AVERROR(EAGAIN) -- waited for a while without result, call again
+ * - AVERROR_EOF -- all inputs are finished
+ */
+static int merge_next_input(void)
+{
+    int64_t now = av_gettime(), deadline = now + 100000;
+    InputFile *top;
+    int i, nb_live = 0, blocked = 0;
+
+    if (!merge_heap && !(merge_heap = av_mallocz_array(nb_input_files, sizeof(*merge_heap))))
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < nb_input_files; i++) {
+        InputFile *f = input_files[i];
+        int state;
+
+        if (f->eof_reached)
+            continue;
+        nb_live++;
+        if (f->merge_queued)
+            continue;
+        state = input_queue_state(f);
+        if (state > 0) {
+            if (f->merge_starved)
+                av_log(NULL, AV_LOG_INFO, "%s: packets are arriving again, "
+                       "merging it with the other inputs\n", f->ctx->filename);
+            f->merge_starved      = 0;
+            f->merge_starve_start = AV_NOPTS_VALUE;
+            merge_update_ts(f);
+            merge_heap_push(f);
+        } else if (state < 0) {
+            /* let process_input() handle the end of the file */
+            return i;
         }
-        pthread_cond_wait(&f->fifo_cond, &f->fifo_lock);
     }
+    if (!nb_live)
+        return AVERROR_EOF;
+
+    top = nb_merge_heap ? merge_heap[0] : NULL;
+    for (i = 0; i < nb_input_files; i++) {
+        InputFile *f = input_files[i];
+
+        if (f->eof_reached || f->merge_queued || f->merge_starved)
+            continue;
+        if (top && f->merge_ts != AV_NOPTS_VALUE &&
+            top->merge_ts <= f->merge_ts + merge_window) {
+            f->merge_starve_start = AV_NOPTS_VALUE;
+            continue;
+        }
+
+        if (f->merge_starve_start == AV_NOPTS_VALUE)
+            f->merge_starve_start = now;
+        if (now - f->merge_starve_start >= merge_timeout) {
+            av_log(NULL, AV_LOG_WARNING, "%s: no packets for %0.3fs, merging "
+                   "the other inputs without it\n", f->ctx->filename,
+                   (now - f->merge_starve_start) / 1000000.0);
+            f->merge_starved = 1;
+            continue;
+        }
+        deadline = FFMIN(deadline, f->merge_starve_start + merge_timeout);
+        blocked  = 1;
     }
 
-    pthread_mutex_unlock(&f->fifo_lock);
+    if (top && !blocked) {
+        top = merge_heap_pop();
+        for (i = 0; i < nb_input_files; i++)
+            if (input_files[i] == top)
+                return i;
+    }
 
-    return ret;
+    merge_wait(deadline);
+    return AVERROR(EAGAIN);
 }
 #endif
 
 static int get_input_packet(InputFile *f, AVPacket *pkt)
 {
+    int64_t bench[2];
+    int ret;
+
+#if HAVE_PTHREADS
+    /* the input thread paces the packets itself */
+    if (f->queue)
+        return get_input_packet_mt(f, pkt);
+#endif
     if (f->rate_emu) {
         int i;
         for (i = 0; i < f->nb_streams; i++) {
@@ -3177,11 +4303,10 @@ static int get_input_packet(InputFile *f, AVPacket *pkt)
         }
     }
 
-#if HAVE_PTHREADS
-    if (nb_input_files > 1)
-        return get_input_packet_mt(f, pkt);
-#endif
-    return av_read_frame(f->ctx, pkt);
+    benchmark_start(bench);
+    ret = av_read_frame(f->ctx, pkt);
+    benchmark_stop(&f->bench_demux, bench);
+    return ret;
 }
 
 static int got_eagain(void)
@@ -3433,13 +4558,16 @@ discard_packet:
  */
 static int transcode_from_filter(FilterGraph *graph, InputStream **best_ist)
 {
+    int64_t bench[2];
     int i, ret;
     int nb_requests, nb_requests_max = 0;
     InputFilter *ifilter;
     InputStream *ist;
 
     *best_ist = NULL;
+    benchmark_start(bench);
     ret = avfilter_graph_request_oldest(graph->graph);
+    benchmark_stop(&graph->bench_filter, bench);
     if (ret >= 0)
         return reap_filters();
 
@@ -3494,6 +4622,34 @@ static int transcode_step(void)
         return AVERROR_EOF;
     }
 
+#if HAVE_PTHREADS
+    if (merge_inputs && nb_input_files > 1) {
+        /* the inputs are read in timestamp order as long as any is left,
+         * the outputs are then drained as usual */
+        ret = merge_next_input();
+        if (ret >= 0) {
+            ret = process_input(ret);
+            if (ret == AVERROR(EAGAIN))
+                return 0;
+            if (ret < 0)
+                return ret == AVERROR_EOF ? 0 : ret;
+            return reap_filters();
+        }
+        if (ret != AVERROR_EOF)
+            return ret == AVERROR(EAGAIN) ? 0 : ret;
+    }
+
+    if (ost->filter && ost->filter->graph->pipelined) {
+        /* the graph is fed straight from its input stream, and finishes
+         * once the thread has filtered everything sent before EOF */
+        ist = input_streams[ost->source_index];
+        if (input_files[ist->file_index]->eof_reached) {
+            filter_thread_wait(ost->filter->graph);
+            close_output_stream(ost);
+            return 0;
+        }
+    } else
+#endif
     if (ost->filter) {
         if ((ret = transcode_from_filter(ost->filter->graph, &ist)) < 0)
             return ret;
@@ -3540,6 +4696,10 @@ static int transcode(void)
 #if HAVE_PTHREADS
     if ((ret = init_input_threads()) < 0)
         goto fail;
+    if ((ret = init_mux_threads()) < 0)
+        goto fail;
+    if ((ret = init_filter_threads()) < 0)
+        goto fail;
 #endif
 
     while (!received_sigterm) {
@@ -3550,6 +4710,13 @@ static int transcode(void)
             if (check_keyboard_interaction(cur_time) < 0)
                 break;
 
+#if HAVE_PTHREADS
+        /* an encoding or muxing error in a filter thread is fatal, like in
+         * the main thread */
+        if ((ret = filter_threads_error()) < 0)
+            goto fail;
+#endif
+
         /* check if there's any stream where output is still needed */
         if (!need_output()) {
             av_log(NULL, AV_LOG_VERBOSE, "No more output streams to write to, finishing.\n");
@@ -3579,7 +4746,14 @@ static int transcode(void)
             output_packet(ist, NULL);
         }
     }
+#if HAVE_PTHREADS
+    if ((ret = free_filter_threads()) < 0)
+        goto fail;
+#endif
     flush_encoders();
+#if HAVE_PTHREADS
+    free_mux_threads();
+#endif
 
     term_exit();
 
@@ -3641,6 +4815,353 @@ static int transcode(void)
     return ret;
 }
 
+#if HAVE_FORK
+/* Return the time of the first keyframe of st at or after target, both in
+ * AV_TIME_BASE units, or AV_NOPTS_VALUE if there is none. */
+static int64_t find_chunk_keyframe(AVFormatContext *ic, AVStream *st, int64_t target)
+{
+    AVPacket pkt;
+    int64_t ts = AV_NOPTS_VALUE;
+    int ret;
+
+    if (avformat_seek_file(ic, -1, INT64_MIN, target, target, 0) < 0)
+        return AV_NOPTS_VALUE;
+
+    while (ts == AV_NOPTS_VALUE) {
+        ret = av_read_frame(ic, &pkt);
+        if (ret == AVERROR(EAGAIN))
+            continue;
+        if (ret < 0)
+            break;
+        if (pkt.stream_index == st->index && (pkt.flags & AV_PKT_FLAG_KEY)) {
+            int64_t t = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+            if (t != AV_NOPTS_VALUE) {
+                t = av_rescale_q(t, st->time_base, AV_TIME_BASE_Q);
+                if (t >= target)
+                    ts = t;
+            }
+        }
+        av_free_packet(&pkt);
+    }
+    return ts;
+}
+
+/* Seek the input to start, relative to its start time, and shift its
+ * timestamps like -ss would. */
+static void seek_chunk(InputFile *ifile, int64_t start)
+{
+    AVFormatContext *ic = ifile->ctx;
+    int64_t timestamp = start;
+
+    if (ic->start_time != AV_NOPTS_VALUE)
+        timestamp += ic->start_time;
+    if (avformat_seek_file(ic, -1, INT64_MIN, timestamp, timestamp, 0) < 0)
+        av_log(NULL, AV_LOG_WARNING, "%s: could not seek to position %0.3f\n",
+               ic->filename, (double)timestamp / AV_TIME_BASE);
+    ifile->ts_offset = ifile->input_ts_offset - timestamp;
+}
+
+/* Return the start time of the first video stream of a chunk, which starts
+ * at the keyframe the input was cut at, in AV_TIME_BASE units. Delayed audio
+ * encoders make the chunk itself start earlier. */
+static int64_t chunk_start_time(AVFormatContext *ic)
+{
+    int i;
+
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVStream *st = ic->streams[i];
+        if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO &&
+            st->start_time != AV_NOPTS_VALUE)
+            return av_rescale_q(st->start_time, st->time_base, AV_TIME_BASE_Q);
+    }
+    return ic->start_time != AV_NOPTS_VALUE ? ic->start_time : 0;
+}
+
+/* Mux the packets of the chunks, in order, into the output file, shifting
+ * their timestamps so they continue where the previous chunk ended. */
+static int concat_chunks(OutputFile *of, char **names, const int64_t *cuts, int nb_chunks)
+{
+    AVFormatContext *oc = of->ctx, *ic = NULL;
+    int64_t base = 0, *last_dts;
+    int i, j, ret = 0;
+
+    last_dts = av_malloc_array(oc->nb_streams, sizeof(*last_dts));
+    if (!last_dts)
+        return AVERROR(ENOMEM);
+    for (j = 0; j < oc->nb_streams; j++)
+        last_dts[j] = AV_NOPTS_VALUE;
+
+    for (i = 0; i < nb_chunks; i++) {
+        AVPacket pkt;
+        int64_t offset;
+        int nb_dropped = 0;
+
+        if ((ret = avformat_open_input(&ic, names[i], NULL, NULL)) < 0 ||
+            (ret = avformat_find_stream_info(ic, NULL)) < 0) {
+            print_error(names[i], ret);
+            goto fail;
+        }
+        if (ic->nb_streams != oc->nb_streams) {
+            av_log(NULL, AV_LOG_ERROR, "%s: expected %d streams, found %d\n",
+                   names[i], oc->nb_streams, ic->nb_streams);
+            ret = AVERROR_INVALIDDATA;
+            goto fail;
+        }
+
+        if (!i) {
+            for (j = 0; j < oc->nb_streams; j++) {
+                AVCodecContext *codec  = oc->streams[j]->codec;
+                AVCodecContext *icodec = ic->streams[j]->codec;
+                unsigned int codec_tag;
+
+                /* the chunks were encoded with the flags of the output, so
+                 * the extradata copied here holds their global headers */
+                if ((ret = avcodec_copy_context(codec, icodec)) < 0)
+                    goto fail;
+                if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+                    codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+                if (oc->oformat->codec_tag &&
+                    av_codec_get_id(oc->oformat->codec_tag, icodec->codec_tag) != codec->codec_id &&
+                    av_codec_get_tag2(oc->oformat->codec_tag, icodec->codec_id, &codec_tag))
+                    codec->codec_tag = 0;
+                oc->streams[j]->time_base = ic->streams[j]->time_base;
+            }
+            if ((ret = avformat_write_header(oc, &of->opts)) < 0) {
+                print_error(oc->filename, ret);
+                goto fail;
+            }
+            base = chunk_start_time(ic);
+        } else {
+            for (j = 0; j < oc->nb_streams; j++) {
+                AVCodecContext *codec  = oc->streams[j]->codec;
+                AVCodecContext *icodec = ic->streams[j]->codec;
+
+                if (codec->extradata_size != icodec->extradata_size ||
+                    (codec->extradata_size &&
+                     memcmp(codec->extradata, icodec->extradata, codec->extradata_size)))
+                    av_log(NULL, AV_LOG_WARNING, "%s: stream %d has other global "
+                           "headers than the first chunk\n", names[i], j);
+            }
+        }
+
+        /* the muxer may have delayed the first timestamp of each chunk */
+        offset = base + cuts[i] - cuts[0] - chunk_start_time(ic);
+
+        while ((ret = av_read_frame(ic, &pkt)) >= 0) {
+            AVStream *ist = ic->streams[pkt.stream_index];
+            AVStream *ost = oc->streams[pkt.stream_index];
+            int64_t delta = av_rescale_q(offset, AV_TIME_BASE_Q, ist->time_base);
+
+            if (pkt.pts != AV_NOPTS_VALUE)
+                pkt.pts = av_rescale_q(pkt.pts + delta, ist->time_base, ost->time_base);
+            if (pkt.dts != AV_NOPTS_VALUE)
+                pkt.dts = av_rescale_q(pkt.dts + delta, ist->time_base, ost->time_base);
+            pkt.duration = av_rescale_q(pkt.duration, ist->time_base, ost->time_base);
+
+            /* Audio encoders with a delay, like AAC, start each chunk with
+             * priming packets from before the cut, which the end of the
+             * previous chunk already covers. */
+            if (i && ist->codec->codec_type == AVMEDIA_TYPE_AUDIO &&
+                pkt.dts != AV_NOPTS_VALUE && last_dts[pkt.stream_index] != AV_NOPTS_VALUE &&
+                pkt.dts <= last_dts[pkt.stream_index]) {
+                av_free_packet(&pkt);
+                nb_dropped++;
+                continue;
+            }
+            if (pkt.dts != AV_NOPTS_VALUE)
+                last_dts[pkt.stream_index] = pkt.dts;
+
+            ret = av_interleaved_write_frame(oc, &pkt);
+            av_free_packet(&pkt);
+            if (ret < 0) {
+                print_error("av_interleaved_write_frame()", ret);
+                goto fail;
+            }
+        }
+        if (nb_dropped)
+            av_log(NULL, AV_LOG_VERBOSE, "%s: dropped %d audio packets overlapping "
+                   "the previous chunk\n", names[i], nb_dropped);
+        avformat_close_input(&ic);
+    }
+
+    ret = av_write_trailer(oc);
+    if (ret < 0)
+        print_error(oc->filename, ret);
+
+fail:
+    avformat_close_input(&ic);
+    av_free(last_dts);
+    return ret;
+}
+
+/* Split the input at keyframes in chunk_parallel chunks, transcode each of
+ * them in its own process and join the results in the output file. */
+static int transcode_chunks(void)
+{
+    InputFile       *ifile;
+    OutputFile      *of;
+    AVFormatContext *ic, *oc;
+    AVStream *st = NULL;
+    const char *reason = NULL;
+    int64_t *cuts = NULL, start;
+    pid_t   *pids = NULL;
+    char   **names = NULL;
+    int nb_chunks = 1, nb_started = 0, i, ret = 0;
+
+    if (nb_input_files != 1 || nb_output_files != 1) {
+        av_log(NULL, AV_LOG_WARNING, "Cannot transcode in chunks, it needs exactly one input and one output file\n");
+        return transcode();
+    }
+    ifile = input_files[0];
+    of    = output_files[0];
+    ic    = ifile->ctx;
+    oc    = of->ctx;
+
+    for (i = 0; i < ic->nb_streams; i++)
+        if (ic->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO &&
+            !(ic->streams[i]->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+            st = ic->streams[i];
+            break;
+        }
+    for (i = 0; i < nb_filtergraphs; i++)
+        if (filtergraphs[i]->graph_desc)
+            reason = "complex filtergraphs are not supported";
+
+    if (!st)
+        reason = "the input has no video stream";
+    else if (!ic->pb || !ic->pb->seekable || ic->duration == AV_NOPTS_VALUE)
+        reason = "the input is not seekable or has an unknown duration";
+    else if ((oc->oformat->flags & AVFMT_NOFILE) || !strncmp(oc->filename, "pipe:", 5))
+        reason = "the output is not a file";
+    else if (copy_ts || ifile->start_time != AV_NOPTS_VALUE ||
+             ifile->recording_time != INT64_MAX ||
+             of->start_time != AV_NOPTS_VALUE || of->recording_time != INT64_MAX)
+        reason = "-ss, -t, -to and -copyts are not supported";
+    if (reason) {
+        av_log(NULL, AV_LOG_WARNING, "Cannot transcode in chunks, %s\n", reason);
+        return transcode();
+    }
+
+    cuts  = av_malloc_array(chunk_parallel + 1, sizeof(*cuts));
+    pids  = av_malloc_array(chunk_parallel, sizeof(*pids));
+    names = av_mallocz_array(chunk_parallel, sizeof(*names));
+    if (!cuts || !pids || !names) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    /* all chunks, including the first, start at a keyframe so that they are
+     * trimmed the same way */
+    start   = ic->start_time != AV_NOPTS_VALUE ? ic->start_time : 0;
+    cuts[0] = find_chunk_keyframe(ic, st, start);
+    if (cuts[0] == AV_NOPTS_VALUE) {
+        av_log(NULL, AV_LOG_WARNING, "Cannot transcode in chunks, no keyframe found\n");
+        seek_chunk(ifile, 0);
+        ret = transcode();
+        goto fail;
+    }
+    cuts[0] -= start;
+    for (i = 1; i < chunk_parallel; i++) {
+        int64_t ts = find_chunk_keyframe(ic, st, start + av_rescale(ic->duration, i, chunk_parallel));
+        if (ts != AV_NOPTS_VALUE && ts - start > cuts[nb_chunks - 1])
+            cuts[nb_chunks++] = ts - start;
+    }
+    cuts[nb_chunks] = INT64_MAX;
+
+    if (nb_chunks == 1) {
+        av_log(NULL, AV_LOG_WARNING, "Cannot transcode in chunks, no keyframe to split the input at\n");
+        seek_chunk(ifile, 0);
+        ret = transcode();
+        goto fail;
+    }
+
+    for (i = 0; i < nb_chunks; i++) {
+        if (!(names[i] = av_asprintf("%s.chunk%d", oc->filename, i))) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        av_log(NULL, AV_LOG_VERBOSE, "Chunk %d: %s from %0.3f to %0.3f\n", i, names[i],
+               cuts[i] / 1000000.0, (i + 1 < nb_chunks ? cuts[i + 1] : ic->duration) / 1000000.0);
+
+        pids[i] = fork();
+        if (pids[i] < 0) {
+            ret = AVERROR(errno);
+            av_log(NULL, AV_LOG_ERROR, "Could not start the process for chunk %d: %s\n",
+                   i, av_err2str(ret));
+            break;
+        }
+        if (!pids[i]) {
+            /* this process only transcodes chunk i, into its own file */
+            if (av_log_get_level() == AV_LOG_INFO)
+                av_log_set_level(AV_LOG_WARNING);
+            print_stats       = 0;
+            stdin_interaction = 0;
+
+            /* the file offsets are shared with the other processes,
+             * so the input and output have to be opened anew */
+            avio_close(ic->pb);
+            ic->pb = NULL;
+            if ((ret = avio_open2(&ic->pb, ic->filename, AVIO_FLAG_READ,
+                                  &ic->interrupt_callback, NULL)) < 0) {
+                print_error(ic->filename, ret);
+                exit_program(1);
+            }
+            ifile->start_time = cuts[i];
+            if (cuts[i + 1] != INT64_MAX)
+                ifile->recording_time = cuts[i + 1] - cuts[i];
+            seek_chunk(ifile, cuts[i]);
+
+            avio_close(oc->pb);
+            oc->pb = NULL;
+            if ((ret = avio_open2(&oc->pb, names[i], AVIO_FLAG_WRITE,
+                                  &oc->interrupt_callback, NULL)) < 0) {
+                print_error(names[i], ret);
+                exit_program(1);
+            }
+            for (i = 0; i < nb_chunks; i++)
+                av_freep(&names[i]);
+            av_freep(&names);
+            av_freep(&pids);
+            av_freep(&cuts);
+            return transcode();
+        }
+        nb_started++;
+    }
+
+    for (i = 0; i < nb_started; i++) {
+        int status;
+
+        while (waitpid(pids[i], &status, 0) < 0) {
+            if (errno != EINTR) {
+                status = -1;
+                break;
+            }
+        }
+        if (status == -1 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+            av_log(NULL, AV_LOG_ERROR, "Transcoding chunk %d failed\n", i);
+            if (!ret)
+                ret = AVERROR_EXTERNAL;
+        }
+    }
+
+    if (!ret)
+        ret = concat_chunks(of, names, cuts, nb_chunks);
+
+    for (i = 0; i < nb_started; i++)
+        if (unlink(names[i]) < 0)
+            av_log(NULL, AV_LOG_WARNING, "Could not remove %s\n", names[i]);
+
+fail:
+    if (names)
+        for (i = 0; i < chunk_parallel; i++)
+            av_freep(&names[i]);
+    av_freep(&names);
+    av_freep(&pids);
+    av_freep(&cuts);
+    return ret;
+}
+#endif
+
 
 static int64_t getutime(void)
 {
@@ -3660,6 +5181,19 @@ static int64_t getutime(void)
 #endif
 }
 
+/* CPU time used by the calling thread, or by the whole process where that is
+ * not available */
+static int64_t getthreadtime(void)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+
+    if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+        return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+#endif
+    return getutime();
+}
+
 static int64_t getmaxrss(void)
 {
 #if HAVE_GETRUSAGE && HAVE_STRUCT_RUSAGE_RU_MAXRSS
@@ -3736,7 +5270,13 @@ int main(int argc, char **argv)
 //     }
 
     current_time = ti = getutime();
-    if (transcode() < 0)
+#if HAVE_FORK
+    if (chunk_parallel > 1)
+        ret = transcode_chunks();
+    else
+#endif
+    ret = transcode();
+    if (ret < 0)
         exit_program(1);
     ti = getutime() - ti;
     if (do_benchmark) {
@@ -84,6 +84,14 @@ typedef struct {
     int ofile_idx, ostream_idx;               // output
 } AudioChannelMap;
 
+/* time spent in one processing stage, reported by -benchmark_json,
+ * updated by whichever thread runs the stage */
+typedef struct BenchmarkTimer {
+    int64_t  wall;   /* wallclock time, in microseconds */
+    int64_t  cpu;    /* CPU time of the thread doing the work, in microseconds */
+    uint64_t calls;  /* number of timed calls */
+} BenchmarkTimer;
+
 typedef struct OptionsContext {
     OptionGroup *g;
 
@@ -108,6 +116,10 @@ typedef struct OptionsContext {
     int64_t input_ts_offset;
     int rate_emu;
     int accurate_seek;
+    int input_queue_size;
+    int64_t rate_emu_burst;
+    int64_t rate_emu_max_lag;
+    const char *rate_emu_clock;
 
     SpecifierOpt *ts_scale;
     int        nb_ts_scale;
@@ -201,6 +213,9 @@ typedef struct OptionsContext {
     int        nb_guess_layout_max;
     SpecifierOpt *apad;
     int        nb_apad;
+
+    int mux_queue_size;
+    const char *mux_queue_policy;
 } OptionsContext;
 
 typedef struct InputFilter {
@@ -223,6 +238,7 @@ typedef struct OutputFilter {
 typedef struct FilterGraph {
     int            index;
     const char    *graph_desc;
+    char          *shared_desc; /* filters of a simple graph shared by several output streams */
 
     AVFilterGraph *graph;
     int reconfiguration;
@@ -231,6 +247,21 @@ typedef struct FilterGraph {
     int          nb_inputs;
     OutputFilter **outputs;
     int         nb_outputs;
+
+    BenchmarkTimer bench_filter;
+
+#if HAVE_PTHREADS
+    int pipelined;              /* filtering and encoding run in their own thread */
+    pthread_t thread;           /* thread filtering and encoding the frames of this graph */
+    int busy;                   /* the thread is processing a frame */
+    int drain;                  /* the thread should exit once the queue is empty */
+    int finished;               /* the thread has exited */
+    int error;                  /* error that made the thread exit early */
+    int abort;                  /* the thread should exit without emptying the queue */
+    pthread_mutex_t queue_lock; /* lock for access to queue */
+    pthread_cond_t  queue_cond; /* signaled whenever the queue or busy changes */
+    AVFifoBuffer *queue;        /* decoded frames (AVFrame *, NULL for EOF) waiting to be filtered */
+#endif
 } FilterGraph;
 
 typedef struct InputStream {
@@ -315,6 +346,7 @@ typedef struct InputStream {
     // number of frames/samples retrieved from the decoder
     uint64_t frames_decoded;
     uint64_t samples_decoded;
+    BenchmarkTimer bench_decode;
 } InputStream;
 
 typedef struct InputFile {
@@ -331,16 +363,39 @@ typedef struct InputFile {
                              from ctx.nb_streams if new streams appear during av_read_frame() */
     int nb_streams_warn;  /* number of streams that the user was warned of */
     int rate_emu;
+    int64_t rate_emu_burst;     /* how far ahead of real time -re may read, in AV_TIME_BASE units */
+    int64_t rate_emu_max_lag;   /* lag after which -re resyncs instead of catching up, 0 for never */
+    int rate_emu_bitrate;       /* -re paces by byte position at the file bitrate instead of by dts */
+    int64_t rate_emu_wall;      /* wallclock time the clock of -re is anchored at */
+    int64_t rate_emu_ts;        /* packet time the clock of -re is anchored at, in AV_TIME_BASE units */
+    int64_t rate_emu_last_ts;   /* time of the previous packet paced by -re, in AV_TIME_BASE units */
     int accurate_seek;
+    int queue_size;             /* number of demuxed packets the input thread may queue */
+
+    BenchmarkTimer bench_demux;
 
 #if HAVE_PTHREADS
     pthread_t thread;           /* thread reading from this file */
     int non_blocking;           /* reading packets from the thread should not block */
     int finished;               /* the thread has exited */
+    int abort;                  /* the thread should exit */
     int joined;                 /* the thread has been joined */
-    pthread_mutex_t fifo_lock;  /* lock for access to fifo */
-    pthread_cond_t  fifo_cond;  /* the main thread will signal on this cond after reading from fifo */
-    AVFifoBuffer *fifo;         /* demuxed packets are stored here; freed by the main thread */
+    /* demuxed packets are passed through a ring of queue_size + 1 slots;
+     * queue_wr is advanced by the input thread and queue_rd by the main
+     * thread, both under queue_lock along with finished and abort, and
+     * queue_cond is signaled whenever one of them changes. A slot between
+     * queue_rd and queue_wr is only accessed by the main thread. */
+    AVPacket *queue;            /* freed by the main thread */
+    int queue_rd, queue_wr;
+    pthread_mutex_t queue_lock;
+    pthread_cond_t  queue_cond;
+
+    /* -merge_inputs state, only used by the main thread */
+    int64_t merge_ts;           /* timestamp of the packet at the head of the queue, or of the
+                                   last one taken, in AV_TIME_BASE units */
+    int64_t merge_starve_start; /* since when other files wait for this one, or AV_NOPTS_VALUE */
+    int merge_queued;           /* the file is in the merge heap */
+    int merge_starved;          /* the other files are merged without waiting for this one */
 #endif
 } InputFile;
 
@@ -421,6 +476,7 @@ typedef struct OutputStream {
     int copy_prior_start;
 
     int keep_pix_fmt;
+    int mux_dropping;       /* packets are dropped until the next keyframe, the muxing queue was full */
 
     AVCodecParserContext *parser;
 
@@ -432,6 +488,16 @@ typedef struct OutputStream {
     // number of frames/samples sent to the encoder
     uint64_t frames_encoded;
     uint64_t samples_encoded;
+    BenchmarkTimer bench_encode;
+
+    /* encoder and muxer state published for the main loop, which must not
+     * look into the encoder or the muxer while another thread runs them.
+     * These, finished, frame_number and the stats above are accessed under
+     * the output state lock when threads are running. */
+    int      quality;        /* quality of the last coded frame, <0 if unknown */
+    uint64_t error[3];       /* SSE of the last coded frame, per plane */
+    int64_t  last_cur_dts;   /* st->cur_dts after the last packet was muxed */
+    int64_t  last_pts;       /* st->pts.val after the last packet was muxed */
 } OutputStream;
 
 typedef struct OutputFile {
@@ -443,6 +509,33 @@ typedef struct OutputFile {
     uint64_t limit_filesize; /* filesize limit expressed in bytes */
 
     int shortest;
+
+    int mux_queue_size;      /* packets queued for the muxing thread, 0 (default) to mux synchronously */
+    int mux_queue_drop;      /* drop packets instead of waiting when the queue is full */
+
+    /* muxing queue stats */
+    // number of packets that had to wait for room in the queue
+    uint64_t mux_stalls;
+    // total time spent waiting for room, in microseconds
+    int64_t  mux_stall_time;
+    // number of packets dropped because the queue was full
+    uint64_t mux_dropped;
+    // highest number of packets seen in the queue
+    int      mux_queue_max;
+
+    BenchmarkTimer bench_mux;
+
+#if HAVE_PTHREADS
+    pthread_mutex_t mux_lock;   /* serializes access to ctx when other threads are running */
+    pthread_t mux_thread;       /* thread writing the packets of this file */
+    int mux_threaded;           /* packets are sent to mux_thread through mux_queue */
+    int mux_drain;              /* the thread should exit once the queue is empty */
+    int mux_abort;              /* the thread should exit without emptying the queue */
+    pthread_mutex_t mux_queue_lock; /* lock for access to mux_queue */
+    pthread_cond_t  mux_queue_cond; /* broadcast whenever mux_queue changes */
+    AVFifoBuffer *mux_queue;    /* packets waiting to be muxed */
+    int64_t mux_pos;            /* position in ctx->pb after the last packet written, under the output state lock */
+#endif
 } OutputFile;
 
 extern InputStream **input_streams;
@@ -469,6 +562,11 @@ extern int audio_sync_method;
 extern int video_sync_method;
 extern int do_benchmark;
 extern int do_benchmark_all;
+extern int do_pipeline;
+extern int chunk_parallel;
+extern int merge_inputs;
+extern int64_t merge_window;
+extern int64_t merge_timeout;
 extern int do_deinterlace;
 extern int do_hex_dump;
 extern int do_pkt_dump;
@@ -481,6 +579,7 @@ extern int qp_hist;
 extern int stdin_interaction;
 extern int frame_bits_per_raw_sample;
 extern AVIOContext *progress_avio;
+extern AVIOContext *benchmark_json_avio;
 extern float max_error_rate;
 
 extern const AVIOInterruptCB int_cb;
@@ -508,6 +607,7 @@ int configure_filtergraph(FilterGraph *fg);
 int configure_output_filter(FilterGraph *fg, OutputFilter *ofilter, AVFilterInOut *out);
 int ist_in_filtergraph(FilterGraph *fg, InputStream *ist);
 FilterGraph *init_simple_filtergraph(InputStream *ist, OutputStream *ost);
+FilterGraph *init_shared_filtergraph(InputStream *ist, OutputStream *ost);
 
 int ffmpeg_parse_options(int argc, char **argv);
 
@@ -210,6 +210,197 @@ FilterGraph *init_simple_filtergraph(InputStream *ist, OutputStream *ost)
     return fg;
 }
 
+/* Split the description of a simple filtergraph made of one chain of filters
+ * at the commas separating the filters. Return the number of filters, or 0
+ * if the description is anything more complex than such a chain. */
+static int split_filter_chain(const char *desc, char ***filters)
+{
+    const char *p, *start = desc;
+    char **list = NULL;
+    int nb = 0, quoted = 0;
+
+    for (p = desc; ; p++) {
+        if (*p == '\\' && p[1]) {
+            p++;
+            continue;
+        }
+        if (*p == '\'')
+            quoted = !quoted;
+        if (quoted && *p)
+            continue;
+        if (*p == '[' || *p == ';')
+            goto fail;
+        if (*p == ',' || !*p) {
+            const char *end = p;
+            char *filter;
+
+            start += strspn(start, " \t\r\n");
+            while (end > start && strchr(" \t\r\n", end[-1]))
+                end--;
+            if (end == start)
+                goto fail;
+            if (!(filter = av_malloc(end - start + 1)))
+                exit_program(1);
+            av_strlcpy(filter, start, end - start + 1);
+            GROW_ARRAY(list, nb);
+            list[nb - 1] = filter;
+            if (!*p)
+                break;
+            start = p + 1;
+        }
+    }
+    *filters = list;
+    return nb;
+
+fail:
+    while (nb)
+        av_free(list[--nb]);
+    av_free(list);
+    return 0;
+}
+
+static void free_filter_chain(char ***filters, int nb)
+{
+    while (nb)
+        av_free((*filters)[--nb]);
+    av_freep(filters);
+}
+
+static int dict_equal(AVDictionary *a, AVDictionary *b)
+{
+    AVDictionaryEntry *e = NULL, *f;
+
+    if (av_dict_count(a) != av_dict_count(b))
+        return 0;
+    while ((e = av_dict_get(a, "", e, AV_DICT_IGNORE_SUFFIX)))
+        if (!(f = av_dict_get(b, e->key, NULL, 0)) || strcmp(e->value, f->value))
+            return 0;
+    return 1;
+}
+
+/* Whether the simple filtergraphs of ost and ost2 would be configured the
+ * same way apart from their filters. */
+static int can_share_filters(OutputStream *ost, OutputStream *ost2)
+{
+    AVDictionaryEntry *t  = av_dict_get(ost->opts,  "threads", NULL, 0);
+    AVDictionaryEntry *t2 = av_dict_get(ost2->opts, "threads", NULL, 0);
+
+    return !ost2->stream_copy && !ost2->filter && ost2->enc && ost2->avfilter &&
+           ost2->source_index == ost->source_index &&
+           ost2->st->codec->codec_type == ost->st->codec->codec_type &&
+           ost2->sws_flags == ost->sws_flags &&
+           dict_equal(ost2->swr_opts, ost->swr_opts) &&
+           dict_equal(ost2->resample_opts, ost->resample_opts) &&
+           (t ? t2 && !strcmp(t->value, t2->value) : !t2);
+}
+
+/**
+ * Create a filtergraph for ost and the following output streams that are fed
+ * from the same input stream and whose filters start like the ones of ost.
+ * The leading filters common to all of them are run once and their output
+ * split between the remaining filters of each stream.
+ *
+ * @return the new filtergraph, or NULL if no other stream can share filters
+ *         with ost
+ */
+FilterGraph *init_shared_filtergraph(InputStream *ist, OutputStream *ost)
+{
+    enum AVMediaType type = ost->st->codec->codec_type;
+    OutputStream **osts = NULL;
+    char ***chains = NULL;
+    int *nb_filters = NULL;
+    int nb_osts = 0, nb_prefix = 0, nb, i, j;
+    FilterGraph *fg = NULL;
+    AVBPrint desc;
+
+    if (!ist || !ost->avfilter)
+        return NULL;
+
+    osts       = av_mallocz_array(nb_output_streams, sizeof(*osts));
+    chains     = av_mallocz_array(nb_output_streams, sizeof(*chains));
+    nb_filters = av_mallocz_array(nb_output_streams, sizeof(*nb_filters));
+    if (!osts || !chains || !nb_filters)
+        exit_program(1);
+
+    if (!(nb_prefix = split_filter_chain(ost->avfilter, &chains[0])))
+        goto end;
+    osts[0]       = ost;
+    nb_filters[0] = nb_prefix;
+    nb_osts       = 1;
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost2 = output_streams[i];
+
+        if (ost2 == ost || !can_share_filters(ost, ost2) ||
+            !(nb = split_filter_chain(ost2->avfilter, &chains[nb_osts])))
+            continue;
+        if (strcmp(chains[nb_osts][0], chains[0][0])) {
+            free_filter_chain(&chains[nb_osts], nb);
+            continue;
+        }
+        osts[nb_osts]         = ost2;
+        nb_filters[nb_osts++] = nb;
+    }
+    if (nb_osts < 2)
+        goto end;
+
+    for (i = 1; i < nb_osts; i++) {
+        for (j = 0; j < nb_prefix && j < nb_filters[i]; j++)
+            if (strcmp(chains[0][j], chains[i][j]))
+                break;
+        nb_prefix = j;
+    }
+    /* sharing only pays off if the common filters do something */
+    for (j = 0; j < nb_prefix; j++)
+        if (strcmp(chains[0][j], "null") && strcmp(chains[0][j], "anull"))
+            break;
+    if (j == nb_prefix)
+        goto end;
+
+    av_bprint_init(&desc, 0, AV_BPRINT_SIZE_UNLIMITED);
+    for (j = 0; j < nb_prefix; j++)
+        av_bprintf(&desc, "%s,", chains[0][j]);
+    av_bprintf(&desc, "%ssplit=%d", type == AVMEDIA_TYPE_AUDIO ? "a" : "", nb_osts);
+    for (i = 0; i < nb_osts; i++)
+        av_bprintf(&desc, "[shared%d]", i);
+    for (i = 0; i < nb_osts; i++) {
+        av_bprintf(&desc, ";[shared%d]", i);
+        if (nb_filters[i] == nb_prefix)
+            av_bprintf(&desc, "%s", type == AVMEDIA_TYPE_AUDIO ? "anull" : "null");
+        for (j = nb_prefix; j < nb_filters[i]; j++)
+            av_bprintf(&desc, "%s%s", j > nb_prefix ? "," : "", chains[i][j]);
+    }
+    if (!av_bprint_is_complete(&desc)) {
+        av_bprint_finalize(&desc, NULL);
+        goto end;
+    }
+
+    fg = init_simple_filtergraph(ist, ost);
+    for (i = 1; i < nb_osts; i++) {
+        GROW_ARRAY(fg->outputs, fg->nb_outputs);
+        if (!(fg->outputs[i] = av_mallocz(sizeof(*fg->outputs[i]))))
+            exit_program(1);
+        fg->outputs[i]->ost   = osts[i];
+        fg->outputs[i]->graph = fg;
+        osts[i]->filter       = fg->outputs[i];
+    }
+    av_bprint_finalize(&desc, &fg->shared_desc);
+
+    av_log(NULL, AV_LOG_VERBOSE, "Output streams");
+    for (i = 0; i < nb_osts; i++)
+        av_log(NULL, AV_LOG_VERBOSE, " #%d:%d", osts[i]->file_index, osts[i]->index);
+    av_log(NULL, AV_LOG_VERBOSE, " share their first %d filter(s) in '%s'\n",
+           nb_prefix, fg->shared_desc);
+
+end:
+    for (i = 0; i < nb_osts; i++)
+        free_filter_chain(&chains[i], nb_filters[i]);
+    av_free(chains);
+    av_free(nb_filters);
+    av_free(osts);
+    return fg;
+}
+
 static void init_input_filter(FilterGraph *fg, AVFilterInOut *in)
 {
     InputStream *ist = NULL;
@@ -836,8 +1027,9 @@ int configure_filtergraph(FilterGraph *fg)
 {
     AVFilterInOut *inputs, *outputs, *cur;
     int ret, i, init = !fg->graph, simple = !fg->graph_desc;
-    const char *graph_desc = simple ? fg->outputs[0]->ost->avfilter :
-                                      fg->graph_desc;
+    const char *graph_desc = !simple        ? fg->graph_desc  :
+                             fg->shared_desc ? fg->shared_desc :
+                                               fg->outputs[0]->ost->avfilter;
 
     avfilter_graph_free(&fg->graph);
     if (!(fg->graph = avfilter_graph_alloc()))
@@ -877,7 +1069,9 @@ int configure_filtergraph(FilterGraph *fg)
     if ((ret = avfilter_graph_parse2(fg->graph, graph_desc, &inputs, &outputs)) < 0)
         return ret;
 
-    if (simple && (!inputs || inputs->next || !outputs || outputs->next)) {
+    for (cur = outputs, i = 0; cur; cur = cur->next)
+        i++;
+    if (simple && (!inputs || inputs->next || i != fg->nb_outputs)) {
         av_log(NULL, AV_LOG_ERROR, "Simple filtergraph '%s' does not have "
                "exactly one input and output.\n", graph_desc);
         return AVERROR(EINVAL);
@@ -82,6 +82,11 @@ int video_sync_method = VSYNC_AUTO;
 int do_deinterlace    = 0;
 int do_benchmark      = 0;
 int do_benchmark_all  = 0;
+int do_pipeline       = 0;
+int chunk_parallel    = 0;
+int merge_inputs      = 0;
+int64_t merge_window  = 0;
+int64_t merge_timeout = 1000000;
 int do_hex_dump       = 0;
 int do_pkt_dump       = 0;
 int copy_ts           = 0;
@@ -900,6 +905,24 @@ static int open_input_file(OptionsContext *o, const char *filename)
     f->nb_streams = ic->nb_streams;
     f->rate_emu   = o->rate_emu;
     f->accurate_seek = o->accurate_seek;
+    f->queue_size = o->input_queue_size > 0 ? o->input_queue_size : 8;
+    f->rate_emu_burst   = o->rate_emu_burst;
+    f->rate_emu_max_lag = o->rate_emu_max_lag;
+    f->rate_emu_wall    = AV_NOPTS_VALUE;
+    if (o->rate_emu_clock) {
+        if (!strcmp(o->rate_emu_clock, "bitrate"))
+            f->rate_emu_bitrate = 1;
+        else if (strcmp(o->rate_emu_clock, "dts")) {
+            av_log(NULL, AV_LOG_FATAL, "Invalid -re_clock %s, must be dts or bitrate\n",
+                   o->rate_emu_clock);
+            exit_program(1);
+        }
+        if (f->rate_emu_bitrate && ic->bit_rate <= 0) {
+            av_log(NULL, AV_LOG_WARNING, "The bitrate of %s is unknown, "
+                   "-re will pace it by dts\n", filename);
+            f->rate_emu_bitrate = 0;
+        }
+    }
 
     /* check if all codec options have been used */
     unused_opts = strip_specifiers(o->g->codec_opts);
@@ -1146,6 +1169,7 @@ static OutputStream *new_output_stream(OptionsContext *o, AVFormatContext *oc, e
         input_streams[source_index]->st->discard = AVDISCARD_NONE;
     }
     ost->last_mux_dts = AV_NOPTS_VALUE;
+    ost->quality      = -1;
 
     return ost;
 }
@@ -1708,14 +1732,29 @@ static int open_output_file(OptionsContext *o, const char *filename)
     if (!of)
         exit_program(1);
     output_files[nb_output_files - 1] = of;
+#if HAVE_PTHREADS
+    /* destroyed in ffmpeg_cleanup() */
+    pthread_mutex_init(&of->mux_lock, NULL);
+#endif
 
     of->ost_index      = nb_output_streams;
     of->recording_time = o->recording_time;
     of->start_time     = o->start_time;
     of->limit_filesize = o->limit_filesize;
     of->shortest       = o->shortest;
+    of->mux_queue_size = o->mux_queue_size;
     av_dict_copy(&of->opts, o->g->format_opts, 0);
 
+    if (o->mux_queue_policy) {
+        if (!strcmp(o->mux_queue_policy, "drop"))
+            of->mux_queue_drop = 1;
+        else if (strcmp(o->mux_queue_policy, "block")) {
+            av_log(NULL, AV_LOG_FATAL, "Invalid muxing queue policy '%s', "
+                   "must be 'block' or 'drop'.\n", o->mux_queue_policy);
+            exit_program(1);
+        }
+    }
+
     if (!strcmp(filename, "-"))
         filename = "pipe:";
 
@@ -2683,6 +2722,23 @@ static int opt_progress(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+static int opt_benchmark_json(void *optctx, const char *opt, const char *arg)
+{
+    AVIOContext *avio = NULL;
+    int ret;
+
+    if (!strcmp(arg, "-"))
+        arg = "pipe:";
+    ret = avio_open2(&avio, arg, AVIO_FLAG_WRITE, &int_cb, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to open benchmark URL \"%s\": %s\n",
+               arg, av_err2str(ret));
+        return ret;
+    }
+    benchmark_json_avio = avio;
+    return 0;
+}
+
 #define OFFSET(x) offsetof(OptionsContext, x)
 const OptionDef options[] = {
     /* main options */
@@ -2747,6 +2803,18 @@ const OptionDef options[] = {
         "add timings for benchmarking" },
     { "benchmark_all",  OPT_BOOL | OPT_EXPERT,                       { &do_benchmark_all },
       "add timings for each task" },
+    { "benchmark_json", HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_benchmark_json },
+      "write per-stage timings and counters as JSON", "url" },
+    { "pipeline",       OPT_BOOL | OPT_EXPERT,                       { &do_pipeline },
+      "filter and encode each simple filtergraph in its own thread" },
+    { "chunk_parallel", HAS_ARG | OPT_INT | OPT_EXPERT,              { &chunk_parallel },
+      "split the input at keyframes and transcode this many chunks in parallel", "number" },
+    { "merge_inputs",   OPT_BOOL | OPT_EXPERT,                       { &merge_inputs },
+      "read all inputs concurrently and process their packets in timestamp order" },
+    { "merge_window",   HAS_ARG | OPT_TIME | OPT_EXPERT,             { &merge_window },
+      "how far ahead of an input without queued packets the others may be processed", "time" },
+    { "merge_timeout",  HAS_ARG | OPT_TIME | OPT_EXPERT,             { &merge_timeout },
+      "how long to wait for an input without queued packets before merging without it", "time" },
     { "progress",       HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_progress },
       "write program-readable progress information", "url" },
     { "stdin",          OPT_BOOL | OPT_EXPERT,                       { &stdin_interaction },
@@ -2760,6 +2828,18 @@ const OptionDef options[] = {
     { "re",             OPT_BOOL | OPT_EXPERT | OPT_OFFSET |
                         OPT_INPUT,                                   { .off = OFFSET(rate_emu) },
         "read input at native frame rate", "" },
+    { "re_burst",       HAS_ARG | OPT_TIME | OPT_OFFSET | OPT_EXPERT |
+                        OPT_INPUT,                                   { .off = OFFSET(rate_emu_burst) },
+        "read this much of the input ahead of real time with -re", "duration" },
+    { "re_max_lag",     HAS_ARG | OPT_TIME | OPT_OFFSET | OPT_EXPERT |
+                        OPT_INPUT,                                   { .off = OFFSET(rate_emu_max_lag) },
+        "resync -re instead of catching up when lagging this much", "duration" },
+    { "re_clock",       HAS_ARG | OPT_STRING | OPT_OFFSET | OPT_EXPERT |
+                        OPT_INPUT,                                   { .off = OFFSET(rate_emu_clock) },
+        "pace -re by packet dts or by byte position at the input bitrate", "dts|bitrate" },
+    { "input_queue_size", HAS_ARG | OPT_INT | OPT_EXPERT | OPT_OFFSET |
+                        OPT_INPUT,                                   { .off = OFFSET(input_queue_size) },
+        "set the number of packets queued by the demuxing thread", "packets" },
     { "target",         HAS_ARG | OPT_PERFILE | OPT_OUTPUT,          { .func_arg = opt_target },
         "specify target file type (\"vcd\", \"svcd\", \"dvd\","
         " \"dv\", \"dv50\", \"pal-vcd\", \"ntsc-svcd\", ...)", "type" },
@@ -2971,6 +3051,10 @@ const OptionDef options[] = {
         "set the maximum demux-decode delay", "seconds" },
     { "muxpreload", OPT_FLOAT | HAS_ARG | OPT_EXPERT | OPT_OFFSET | OPT_OUTPUT, { .off = OFFSET(mux_preload) },
         "set the initial demux-decode delay", "seconds" },
+    { "mux_queue_size",   OPT_INT | HAS_ARG | OPT_EXPERT | OPT_OFFSET | OPT_OUTPUT, { .off = OFFSET(mux_queue_size) },
+        "set the number of packets queued for the muxing thread", "packets" },
+    { "mux_queue_policy", OPT_STRING | HAS_ARG | OPT_EXPERT | OPT_OFFSET | OPT_OUTPUT, { .off = OFFSET(mux_queue_policy) },
+        "set what to do with packets when the muxing queue is full (block or drop)", "policy" },
     { "override_ffserver", OPT_BOOL | OPT_EXPERT | OPT_OUTPUT, { &override_ffserver },
         "override the options from ffserver", "" },
 
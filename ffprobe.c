@@ -61,6 +61,7 @@ static int do_show_frames  = 0;
 static int do_show_packets = 0;
 static int do_show_programs = 0;
 static int do_show_streams = 0;
+static int do_show_ts_analysis = 0;
 static int do_show_stream_disposition = 0;
 static int do_show_data    = 0;
 static int do_show_program_version  = 0;
@@ -142,6 +143,9 @@ typedef enum {
     SECTION_ID_STREAMS,
     SECTION_ID_STREAM_TAGS,
     SECTION_ID_SUBTITLE,
+    SECTION_ID_TS_ANALYSIS,
+    SECTION_ID_TS_PID,
+    SECTION_ID_TS_PIDS,
 } SectionID;
 
 static struct section sections[] = {
@@ -169,12 +173,16 @@ static struct section sections[] = {
     [SECTION_ID_PROGRAMS] =                   { SECTION_ID_PROGRAMS, "programs", SECTION_FLAG_IS_ARRAY, { SECTION_ID_PROGRAM, -1 } },
     [SECTION_ID_ROOT] =               { SECTION_ID_ROOT, "root", SECTION_FLAG_IS_WRAPPER,
                                         { SECTION_ID_CHAPTERS, SECTION_ID_FORMAT, SECTION_ID_FRAMES, SECTION_ID_PROGRAMS, SECTION_ID_STREAMS,
-                                          SECTION_ID_PACKETS, SECTION_ID_ERROR, SECTION_ID_PROGRAM_VERSION, SECTION_ID_LIBRARY_VERSIONS, -1} },
+                                          SECTION_ID_PACKETS, SECTION_ID_ERROR, SECTION_ID_PROGRAM_VERSION, SECTION_ID_LIBRARY_VERSIONS,
+                                          SECTION_ID_TS_ANALYSIS, -1} },
     [SECTION_ID_STREAMS] =            { SECTION_ID_STREAMS, "streams", SECTION_FLAG_IS_ARRAY, { SECTION_ID_STREAM, -1 } },
     [SECTION_ID_STREAM] =             { SECTION_ID_STREAM, "stream", 0, { SECTION_ID_STREAM_DISPOSITION, SECTION_ID_STREAM_TAGS, -1 } },
     [SECTION_ID_STREAM_DISPOSITION] = { SECTION_ID_STREAM_DISPOSITION, "disposition", 0, { -1 }, .unique_name = "stream_disposition" },
     [SECTION_ID_STREAM_TAGS] =        { SECTION_ID_STREAM_TAGS, "tags", SECTION_FLAG_HAS_VARIABLE_FIELDS, { -1 }, .element_name = "tag", .unique_name = "stream_tags" },
     [SECTION_ID_SUBTITLE] =           { SECTION_ID_SUBTITLE, "subtitle", 0, { -1 } },
+    [SECTION_ID_TS_ANALYSIS] =        { SECTION_ID_TS_ANALYSIS, "ts_analysis", 0, { SECTION_ID_TS_PIDS, -1 } },
+    [SECTION_ID_TS_PIDS] =            { SECTION_ID_TS_PIDS, "pids", SECTION_FLAG_IS_ARRAY, { SECTION_ID_TS_PID, -1 } },
+    [SECTION_ID_TS_PID] =             { SECTION_ID_TS_PID, "pid", 0, { -1 } },
 };
 
 static const OptionDef *options;
@@ -2281,9 +2289,16 @@ static int open_input_file(AVFormatContext **fmt_ctx_ptr, const char *filename)
     AVFormatContext *fmt_ctx = NULL;
     AVDictionaryEntry *t;
     AVDictionary **opts;
+    int ts_analysis_set = 0;
 
-    if ((err = avformat_open_input(&fmt_ctx, filename,
-                                   iformat, &format_opts)) < 0) {
+    if (do_show_ts_analysis && !av_dict_get(format_opts, "ts_analysis", NULL, AV_DICT_MATCH_CASE)) {
+        av_dict_set(&format_opts, "ts_analysis", "1", 0);
+        ts_analysis_set = 1;
+    }
+    err = avformat_open_input(&fmt_ctx, filename, iformat, &format_opts);
+    if (ts_analysis_set)
+        av_dict_set(&format_opts, "ts_analysis", NULL, AV_DICT_MATCH_CASE);
+    if (err < 0) {
         print_error(filename, err);
         return err;
     }
@@ -2338,6 +2353,90 @@ static int open_input_file(AVFormatContext **fmt_ctx_ptr, const char *filename)
     return 0;
 }
 
+static int64_t ts_analysis_get(AVDictionary *d, const char *key)
+{
+    AVDictionaryEntry *t = av_dict_get(d, key, NULL, AV_DICT_MATCH_CASE);
+    return t ? strtoll(t->value, NULL, 10) : 0;
+}
+
+/* The statistics are gathered by the mpegts demuxer while the packets are
+ * read, see read_packets(), and exported as format metadata once the end of
+ * the input is reached. They are removed from the metadata once printed. */
+static int show_ts_analysis(WriterContext *w, AVFormatContext *fmt_ctx)
+{
+    static const AVRational pcr_tb = { 1, 27000000 };
+    AVDictionaryEntry *t;
+    AVDictionary *ta = NULL, *ps = NULL;
+    char val_str[128];
+    int64_t packets, bit_rate;
+    int ret;
+
+    t = av_dict_get(fmt_ctx->metadata, "ts_analysis", NULL, AV_DICT_MATCH_CASE);
+    if (!t) {
+        av_log(NULL, AV_LOG_ERROR, "%s: the transport stream analysis "
+               "requires an MPEG-TS input read to its end\n", fmt_ctx->filename);
+        return AVERROR(ENOSYS);
+    }
+    if ((ret = av_dict_parse_string(&ta, t->value, "=", ":", 0)) < 0)
+        goto end;
+    packets  = ts_analysis_get(ta, "packets");
+    bit_rate = ts_analysis_get(ta, "bit_rate");
+
+    writer_print_section_header(w, SECTION_ID_TS_ANALYSIS);
+    print_int("packet_size", ts_analysis_get(ta, "packet_size"));
+    print_int("packets", packets);
+    print_int("sync_errors", ts_analysis_get(ta, "sync_errors"));
+    print_duration_time("duration", ts_analysis_get(ta, "duration"), &pcr_tb);
+    if (bit_rate > 0) print_val    ("bit_rate", bit_rate, unit_bit_per_second_str);
+    else              print_str_opt("bit_rate", "N/A");
+
+    writer_print_section_header(w, SECTION_ID_TS_PIDS);
+    t = NULL;
+    while ((t = av_dict_get(fmt_ctx->metadata, "ts_analysis_pid_", t, AV_DICT_IGNORE_SUFFIX))) {
+        int64_t pid_packets;
+
+        av_dict_free(&ps);
+        if ((ret = av_dict_parse_string(&ps, t->value, "=", ":", 0)) < 0)
+            break;
+        pid_packets = ts_analysis_get(ps, "packets");
+
+        writer_print_section_header(w, SECTION_ID_TS_PID);
+        print_int("pid", strtol(t->key + strlen("ts_analysis_pid_"), NULL, 10));
+        print_str("type", av_dict_get(ps, "type", NULL, 0) ? av_dict_get(ps, "type", NULL, 0)->value : "unknown");
+        print_int("packets", pid_packets);
+        if (bit_rate > 0 && packets > 0) print_val    ("bit_rate", av_rescale(bit_rate, pid_packets, packets), unit_bit_per_second_str);
+        else                             print_str_opt("bit_rate", "N/A");
+        print_int("cc_errors", ts_analysis_get(ps, "cc_errors"));
+        print_int("scrambled_packets", ts_analysis_get(ps, "scrambled"));
+        if (ts_analysis_get(ps, "pcr_count")) {
+            print_int("pcr_count", ts_analysis_get(ps, "pcr_count"));
+            print_duration_time("pcr_interval_max", ts_analysis_get(ps, "pcr_interval_max"), &pcr_tb);
+            print_int("pcr_interval_errors", ts_analysis_get(ps, "pcr_interval_errors"));
+            print_int("pcr_accuracy_max_ns", av_rescale(ts_analysis_get(ps, "pcr_accuracy_max"), 1000, 27));
+            print_int("pcr_accuracy_errors", ts_analysis_get(ps, "pcr_accuracy_errors"));
+        }
+        if (ts_analysis_get(ps, "sections")) {
+            print_int("sections", ts_analysis_get(ps, "sections"));
+            print_duration_time("section_interval_min", ts_analysis_get(ps, "section_interval_min"), &pcr_tb);
+            print_duration_time("section_interval_max", ts_analysis_get(ps, "section_interval_max"), &pcr_tb);
+            print_int("section_interval_errors", ts_analysis_get(ps, "section_interval_errors"));
+        }
+        writer_print_section_footer(w);
+    }
+    writer_print_section_footer(w);
+
+    writer_print_section_footer(w);
+
+    /* do not print them again with the format tags */
+    while ((t = av_dict_get(fmt_ctx->metadata, "ts_analysis", NULL, AV_DICT_IGNORE_SUFFIX)))
+        av_dict_set(&fmt_ctx->metadata, t->key, NULL, 0);
+
+end:
+    av_dict_free(&ta);
+    av_dict_free(&ps);
+    return ret;
+}
+
 static void close_input_file(AVFormatContext **ctx_ptr)
 {
     int i;
@@ -2358,7 +2457,7 @@ static int probe_file(WriterContext *wctx, const char *filename)
     int section_id;
 
     do_read_frames = do_show_frames || do_count_frames;
-    do_read_packets = do_show_packets || do_count_packets;
+    do_read_packets = do_show_packets || do_count_packets || do_show_ts_analysis;
 
     ret = open_input_file(&fmt_ctx, filename);
     if (ret < 0)
@@ -2413,6 +2512,10 @@ static int probe_file(WriterContext *wctx, const char *filename)
         ret = show_chapters(wctx, fmt_ctx);
         CHECK_END;
     }
+    if (do_show_ts_analysis) {
+        ret = show_ts_analysis(wctx, fmt_ctx);
+        CHECK_END;
+    }
     if (do_show_format) {
         ret = show_format(wctx, fmt_ctx);
         CHECK_END;
@@ -2817,6 +2920,7 @@ DEFINE_OPT_SHOW_SECTION(packets,          PACKETS);
 DEFINE_OPT_SHOW_SECTION(program_version,  PROGRAM_VERSION);
 DEFINE_OPT_SHOW_SECTION(streams,          STREAMS);
 DEFINE_OPT_SHOW_SECTION(programs,         PROGRAMS);
+DEFINE_OPT_SHOW_SECTION(ts_analysis,      TS_ANALYSIS);
 
 static const OptionDef real_options[] = {
 #include "cmdutils_common_opts.h"
@@ -2846,6 +2950,7 @@ static const OptionDef real_options[] = {
     { "show_programs", 0, {(void*)&opt_show_programs}, "show programs info" },
     { "show_streams", 0, {(void*)&opt_show_streams}, "show streams info" },
     { "show_chapters", 0, {(void*)&opt_show_chapters}, "show chapters info" },
+    { "show_ts_analysis", 0, {(void*)&opt_show_ts_analysis}, "analyze the MPEG-TS packet layer" },
     { "count_frames", OPT_BOOL, {(void*)&do_count_frames}, "count the number of frames per stream" },
     { "count_packets", OPT_BOOL, {(void*)&do_count_packets}, "count the number of packets per stream" },
     { "show_program_version",  0, {(void*)&opt_show_program_version},  "show ffprobe version" },
@@ -2910,6 +3015,7 @@ int main(int argc, char **argv)
     SET_DO_SHOW(PROGRAM_VERSION, program_version);
     SET_DO_SHOW(PROGRAMS, programs);
     SET_DO_SHOW(STREAMS, streams);
+    SET_DO_SHOW(TS_ANALYSIS, ts_analysis);
     SET_DO_SHOW(STREAM_DISPOSITION, stream_disposition);
     SET_DO_SHOW(PROGRAM_STREAM_DISPOSITION, stream_disposition);
 
@@ -2958,7 +3064,8 @@ int main(int argc, char **argv)
             ffprobe_show_library_versions(wctx);
 
         if (!input_filename &&
-            ((do_show_format || do_show_programs || do_show_streams || do_show_chapters || do_show_packets || do_show_error) ||
+            ((do_show_format || do_show_programs || do_show_streams || do_show_chapters || do_show_packets || do_show_error ||
+              do_show_ts_analysis) ||
              (!do_show_program_version && !do_show_library_versions))) {
             show_usage();
             av_log(NULL, AV_LOG_ERROR, "You have to specify one input file.\n");
@@ -3014,6 +3014,17 @@ typedef struct AVCodecContext {
      * - decoding: unused.
      */
     uint16_t *chroma_intra_matrix;
+
+    /**
+     * Number of slice threads each frame thread may use.
+     * When frame threading is active and the codec supports it, every
+     * frame thread additionally decodes the slices of its frame in
+     * parallel using this many threads. 0 or 1 disables it.
+     * Code outside libavcodec should access this field using AVOptions
+     * - encoding: unused
+     * - decoding: Set by user.
+     */
+    int slice_thread_count;
 } AVCodecContext;
 
 AVRational av_codec_get_pkt_timebase         (const AVCodecContext *avctx);
@@ -3138,6 +3149,11 @@ typedef struct AVCodec {
      * Will be called when seeking
      */
     void (*flush)(AVCodecContext *);
+    /**
+     * Internal codec capabilities.
+     * See FF_CODEC_CAP_* in internal.h
+     */
+    int caps_internal;
 } AVCodec;
 
 int av_codec_get_max_lowres(const AVCodec *codec);
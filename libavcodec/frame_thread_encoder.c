@@ -61,6 +61,7 @@ typedef struct{
     unsigned finished_task_index;
 
     pthread_t worker[MAX_THREADS];
+    int nb_workers;
     int exit;
 } ThreadContext;
 
@@ -90,11 +91,16 @@ static void * attribute_align_arg worker(void *v){
         pthread_mutex_unlock(&c->task_fifo_mutex);
         frame = task.indata;
 
-        ret = avcodec_encode_video2(avctx, pkt, frame, &got_packet);
-        pthread_mutex_lock(&c->buffer_mutex);
-        av_frame_unref(frame);
-        pthread_mutex_unlock(&c->buffer_mutex);
-        av_frame_free(&frame);
+        if (avctx->codec_type == AVMEDIA_TYPE_AUDIO)
+            ret = avcodec_encode_audio2(avctx, pkt, frame, &got_packet);
+        else
+            ret = avcodec_encode_video2(avctx, pkt, frame, &got_packet);
+        if (frame) {
+            pthread_mutex_lock(&c->buffer_mutex);
+            av_frame_unref(frame);
+            pthread_mutex_unlock(&c->buffer_mutex);
+            av_frame_free(&frame);
+        }
         if(got_packet) {
             av_dup_packet(pkt);
         } else {
@@ -116,13 +122,43 @@ end:
     return NULL;
 }
 
+/**
+ * Audio encoders keep state from one frame to the next (MDCT overlap,
+ * psychoacoustic history, bit reservoir), so they cannot be split across
+ * frame threads. Instead a single worker runs the encoder serially while
+ * the caller queues up to thread_count frames ahead of it; the output is
+ * identical to unthreaded encoding. Only encoders whose per-frame analysis
+ * is expensive enough to be worth the extra latency are listed here.
+ * As the default thread_type includes frame threading, the pipeline is only
+ * used when thread_type is explicitly passed to avcodec_open2().
+ */
+static int audio_pipeline_supported(const AVCodecContext *avctx,
+                                    AVDictionary *options)
+{
+    if (!av_dict_get(options, "thread_type", NULL, 0))
+        return 0;
+    switch (avctx->codec_id) {
+    case AV_CODEC_ID_AAC:
+    case AV_CODEC_ID_AC3:
+    case AV_CODEC_ID_EAC3:
+    case AV_CODEC_ID_MP2:
+        return 1;
+    }
+    return 0;
+}
+
 int ff_frame_thread_encoder_init(AVCodecContext *avctx, AVDictionary *options){
     int i=0;
+    int nb_workers;
     ThreadContext *c;
 
 
-    if(   !(avctx->thread_type & FF_THREAD_FRAME)
-       || !(avctx->codec->capabilities & CODEC_CAP_INTRA_ONLY))
+    if (!(avctx->thread_type & FF_THREAD_FRAME))
+        return 0;
+    if (avctx->codec_type == AVMEDIA_TYPE_AUDIO) {
+        if (!av_codec_is_encoder(avctx->codec) || !audio_pipeline_supported(avctx, options))
+            return 0;
+    } else if (!(avctx->codec->capabilities & CODEC_CAP_INTRA_ONLY))
         return 0;
 
     if(   !avctx->thread_count
@@ -161,6 +197,8 @@ int ff_frame_thread_encoder_init(AVCodecContext *avctx, AVDictionary *options){
     if(avctx->thread_count > MAX_THREADS)
         return AVERROR(EINVAL);
 
+    nb_workers = avctx->codec_type == AVMEDIA_TYPE_AUDIO ? 1 : avctx->thread_count;
+
     av_assert0(!avctx->internal->frame_thread_encoder);
     c = avctx->internal->frame_thread_encoder = av_mallocz(sizeof(ThreadContext));
     if(!c)
@@ -178,7 +216,7 @@ int ff_frame_thread_encoder_init(AVCodecContext *avctx, AVDictionary *options){
     pthread_cond_init(&c->task_fifo_cond, NULL);
     pthread_cond_init(&c->finished_task_cond, NULL);
 
-    for(i=0; i<avctx->thread_count ; i++){
+    for(i=0; i<nb_workers; i++){
         AVDictionary *tmp = NULL;
         void *tmpv;
         AVCodecContext *thread_avctx = avcodec_alloc_context3(avctx->codec);
@@ -204,13 +242,13 @@ int ff_frame_thread_encoder_init(AVCodecContext *avctx, AVDictionary *options){
         if(pthread_create(&c->worker[i], NULL, worker, thread_avctx)) {
             goto fail;
         }
+        c->nb_workers++;
     }
 
     avctx->active_thread_type = FF_THREAD_FRAME;
 
     return 0;
 fail:
-    avctx->thread_count = i;
     av_log(avctx, AV_LOG_ERROR, "ff_frame_thread_encoder_init failed\n");
     ff_frame_thread_encoder_free(avctx);
     return -1;
@@ -225,7 +263,7 @@ void ff_frame_thread_encoder_free(AVCodecContext *avctx){
     pthread_cond_broadcast(&c->task_fifo_cond);
     pthread_mutex_unlock(&c->task_fifo_mutex);
 
-    for (i=0; i<avctx->thread_count; i++) {
+    for (i=0; i<c->nb_workers; i++) {
          pthread_join(c->worker[i], NULL);
     }
 
@@ -238,9 +276,41 @@ void ff_frame_thread_encoder_free(AVCodecContext *avctx){
     av_freep(&avctx->internal->frame_thread_encoder);
 }
 
+static void submit_task(ThreadContext *c, void *indata)
+{
+    Task task;
+
+    task.index  = c->task_index;
+    task.indata = indata;
+    pthread_mutex_lock(&c->task_fifo_mutex);
+    av_fifo_generic_write(c->task_fifo, &task, sizeof(task), NULL);
+    pthread_cond_signal(&c->task_fifo_cond);
+    pthread_mutex_unlock(&c->task_fifo_mutex);
+
+    c->task_index = (c->task_index+1) % BUFFER_SIZE;
+}
+
+static int receive_task(ThreadContext *c, AVPacket *pkt, int *got_packet_ptr)
+{
+    Task task;
+
+    pthread_mutex_lock(&c->finished_task_mutex);
+    while (!c->finished_tasks[c->finished_task_index].outdata) {
+        pthread_cond_wait(&c->finished_task_cond, &c->finished_task_mutex);
+    }
+    task = c->finished_tasks[c->finished_task_index];
+    *pkt = *(AVPacket*)(task.outdata);
+    if(pkt->data)
+        *got_packet_ptr = 1;
+    av_freep(&c->finished_tasks[c->finished_task_index].outdata);
+    c->finished_task_index = (c->finished_task_index+1) % BUFFER_SIZE;
+    pthread_mutex_unlock(&c->finished_task_mutex);
+
+    return task.return_code;
+}
+
 int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *pkt, const AVFrame *frame, int *got_packet_ptr){
     ThreadContext *c = avctx->internal->frame_thread_encoder;
-    Task task;
     int ret;
 
     av_assert1(!*got_packet_ptr);
@@ -263,14 +333,7 @@ int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *pkt, const AVF
             frame = new;
         }
 
-        task.index = c->task_index;
-        task.indata = (void*)frame;
-        pthread_mutex_lock(&c->task_fifo_mutex);
-        av_fifo_generic_write(c->task_fifo, &task, sizeof(task), NULL);
-        pthread_cond_signal(&c->task_fifo_cond);
-        pthread_mutex_unlock(&c->task_fifo_mutex);
-
-        c->task_index = (c->task_index+1) % BUFFER_SIZE;
+        submit_task(c, (void*)frame);
 
         if(!c->finished_tasks[c->finished_task_index].outdata && (c->task_index - c->finished_task_index) % BUFFER_SIZE <= avctx->thread_count)
             return 0;
@@ -279,17 +342,27 @@ int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *pkt, const AVF
     if(c->task_index == c->finished_task_index)
         return 0;
 
-    pthread_mutex_lock(&c->finished_task_mutex);
-    while (!c->finished_tasks[c->finished_task_index].outdata) {
-        pthread_cond_wait(&c->finished_task_cond, &c->finished_task_mutex);
+    return receive_task(c, pkt, got_packet_ptr);
+}
+
+int ff_thread_audio_encode_frame(AVCodecContext *avctx, AVPacket *pkt, const AVFrame *frame, int *got_packet_ptr){
+    ThreadContext *c = avctx->internal->frame_thread_encoder;
+
+    av_assert1(!*got_packet_ptr);
+
+    if (frame) {
+        AVFrame *new = av_frame_clone(frame);
+        if (!new)
+            return AVERROR(ENOMEM);
+        submit_task(c, new);
+
+        if (!c->finished_tasks[c->finished_task_index].outdata &&
+            (c->task_index - c->finished_task_index) % BUFFER_SIZE <= avctx->thread_count)
+            return 0;
+    } else if (c->task_index == c->finished_task_index) {
+        /* queue drained, let the encoder flush its own delay */
+        submit_task(c, NULL);
     }
-    task = c->finished_tasks[c->finished_task_index];
-    *pkt = *(AVPacket*)(task.outdata);
-    if(pkt->data)
-        *got_packet_ptr = 1;
-    av_freep(&c->finished_tasks[c->finished_task_index].outdata);
-    c->finished_task_index = (c->finished_task_index+1) % BUFFER_SIZE;
-    pthread_mutex_unlock(&c->finished_task_mutex);
 
-    return task.return_code;
+    return receive_task(c, pkt, got_packet_ptr);
 }
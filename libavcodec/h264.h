@@ -638,6 +638,12 @@ typedef struct H264Context {
 
     int slice_context_count;
 
+    /**
+     * Set while this context decodes a slice in parallel with other
+     * contexts; row progress is then reported once all of them are done.
+     */
+    int slice_threaded;
+
     /**
      *  1 if the single thread fallback warning has already been
      *  displayed, 0 otherwise.
@@ -488,6 +488,7 @@ static int copy_parameter_set(void **to, void **from, int count, int size)
            (char *)&to->end_field - (char *)&to->start_field)
 
 static int h264_slice_header_init(H264Context *h, int reinit);
+static int init_slice_contexts(H264Context *h);
 
 int ff_h264_update_thread_context(AVCodecContext *dst,
                                   const AVCodecContext *src)
@@ -571,6 +572,7 @@ int ff_h264_update_thread_context(AVCodecContext *dst,
 
         memset(h->sps_buffers, 0, sizeof(h->sps_buffers));
         memset(h->pps_buffers, 0, sizeof(h->pps_buffers));
+        memset(h->thread_context, 0, sizeof(h->thread_context));
 
         memset(&h->er, 0, sizeof(h->er));
         memset(&h->mb, 0, sizeof(h->mb));
@@ -600,12 +602,11 @@ int ff_h264_update_thread_context(AVCodecContext *dst,
             av_log(dst, AV_LOG_ERROR, "Could not allocate memory\n");
             return ret;
         }
-        ret = ff_h264_context_init(h);
-        if (ret < 0) {
-            av_log(dst, AV_LOG_ERROR, "context_init() failed.\n");
+        h->thread_context[0] = h;
+        ret = init_slice_contexts(h);
+        if (ret < 0)
             return ret;
         }
-        }
 
         h->bipred_scratchpad = NULL;
         h->edge_emu_buffer   = NULL;
@@ -1142,40 +1143,16 @@ static int init_dimensions(H264Context *h)
     return 0;
 }
 
-static int h264_slice_header_init(H264Context *h, int reinit)
+/**
+ * Set up the slice thread contexts of h, its tables must already be allocated.
+ */
+static int init_slice_contexts(H264Context *h)
 {
     int nb_slices = (HAVE_THREADS &&
                      h->avctx->active_thread_type & FF_THREAD_SLICE) ?
                     h->avctx->thread_count : 1;
     int i, ret;
 
-    h->avctx->sample_aspect_ratio = h->sps.sar;
-    av_assert0(h->avctx->sample_aspect_ratio.den);
-    av_pix_fmt_get_chroma_sub_sample(h->avctx->pix_fmt,
-                                     &h->chroma_x_shift, &h->chroma_y_shift);
-
-    if (h->sps.timing_info_present_flag) {
-        int64_t den = h->sps.time_scale;
-        if (h->x264_build < 44U)
-            den *= 2;
-        av_reduce(&h->avctx->time_base.num, &h->avctx->time_base.den,
-                  h->sps.num_units_in_tick, den, 1 << 30);
-    }
-
-    h->avctx->hwaccel = ff_find_hwaccel(h->avctx);
-
-    if (reinit)
-        ff_h264_free_tables(h, 0);
-    h->first_field           = 0;
-    h->prev_interlaced_frame = 1;
-
-    init_scan_tables(h);
-    ret = ff_h264_alloc_tables(h);
-    if (ret < 0) {
-        av_log(h->avctx, AV_LOG_ERROR, "Could not allocate memory\n");
-        return ret;
-    }
-
     if (nb_slices > H264_MAX_THREADS || (nb_slices > h->mb_height && h->mb_height)) {
         int max_slices;
         if (h->mb_height)
@@ -1242,6 +1219,43 @@ static int h264_slice_header_init(H264Context *h, int reinit)
             }
     }
 
+    return 0;
+}
+
+static int h264_slice_header_init(H264Context *h, int reinit)
+{
+    int ret;
+
+    h->avctx->sample_aspect_ratio = h->sps.sar;
+    av_assert0(h->avctx->sample_aspect_ratio.den);
+    av_pix_fmt_get_chroma_sub_sample(h->avctx->pix_fmt,
+                                     &h->chroma_x_shift, &h->chroma_y_shift);
+
+    if (h->sps.timing_info_present_flag) {
+        int64_t den = h->sps.time_scale;
+        if (h->x264_build < 44U)
+            den *= 2;
+        av_reduce(&h->avctx->time_base.num, &h->avctx->time_base.den,
+                  h->sps.num_units_in_tick, den, 1 << 30);
+    }
+
+    h->avctx->hwaccel = ff_find_hwaccel(h->avctx);
+
+    if (reinit)
+        ff_h264_free_tables(h, 0);
+    h->first_field           = 0;
+    h->prev_interlaced_frame = 1;
+
+    init_scan_tables(h);
+    ret = ff_h264_alloc_tables(h);
+    if (ret < 0) {
+        av_log(h->avctx, AV_LOG_ERROR, "Could not allocate memory\n");
+        return ret;
+    }
+
+    if ((ret = init_slice_contexts(h)) < 0)
+        return ret;
+
     h->context_initialized = 1;
 
     return 0;
@@ -2326,7 +2340,7 @@ static void decode_finish_row(H264Context *h)
 
     ff_h264_draw_horiz_band(h, top, height);
 
-    if (h->droppable || h->er.error_occurred)
+    if (h->droppable || h->er.error_occurred || h->slice_threaded)
         return;
 
     ff_thread_report_progress(&h->cur_pic_ptr->tf, top + height - 1,
@@ -2537,15 +2551,20 @@ int ff_h264_execute_decode_slices(H264Context *h, unsigned context_count)
         h->avctx->codec->capabilities & CODEC_CAP_HWACCEL_VDPAU)
         return 0;
     if (context_count == 1) {
+        h->slice_threaded = 0;
         return decode_slice(avctx, &h);
     } else {
+        int error_occurred = 0;
+
         av_assert0(context_count > 0);
+        h->slice_threaded = 1;
         for (i = 1; i < context_count; i++) {
             hx                 = h->thread_context[i];
             if (CONFIG_ERROR_RESILIENCE) {
                 hx->er.error_count = 0;
             }
             hx->x264_build     = h->x264_build;
+            hx->slice_threaded = 1;
         }
 
         avctx->execute(avctx, decode_slice, h->thread_context,
@@ -2561,6 +2580,21 @@ int ff_h264_execute_decode_slices(H264Context *h, unsigned context_count)
             for (i = 1; i < context_count; i++)
                 h->er.error_count += h->thread_context[i]->er.error_count;
         }
+
+        /* The slices may have finished their rows in any order, so other
+         * frame threads are only told about the rows before the end of the
+         * last slice once all of them are done. The following slice may
+         * still deblock the border rows. */
+        for (i = 0; i < context_count; i++)
+            error_occurred |= h->thread_context[i]->er.error_occurred;
+        if (!h->droppable && !error_occurred) {
+            int deblock_border = (16 + 4) << FRAME_MBAFF(h);
+            int progress       = 16 * (h->mb_y >> FIELD_PICTURE(h)) - deblock_border - 1;
+
+            if (progress >= 0)
+                ff_thread_report_progress(&h->cur_pic_ptr->tf, progress,
+                                          h->picture_structure == PICT_BOTTOM_FIELD);
+        }
     }
 
     return 0;
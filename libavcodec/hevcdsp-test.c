@@ -0,0 +1,270 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * HEVC DSP test: compares the optimized functions against the C ones.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/cpu.h"
+#include "libavutil/internal.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "hevc.h"
+#include "hevcdsp.h"
+
+#undef printf
+
+#define PAD     8
+#define STRIDE  (MAX_PB_SIZE + 2 * PAD)
+#define NB_ITS  20
+
+static const int widths[]  = { 2, 4, 6, 8, 12, 16, 24, 32, 48, 64 };
+static const int heights[] = { 2, 4, 8, 16, 32, 64 };
+
+static AVLFG prng;
+
+static void fill_pixels(uint8_t *buf, int size, int bit_depth)
+{
+    int i;
+
+    if (bit_depth > 8) {
+        uint16_t *buf16 = (uint16_t *)buf;
+        for (i = 0; i < size / 2; i++)
+            buf16[i] = av_lfg_get(&prng) & ((1 << bit_depth) - 1);
+    } else {
+        for (i = 0; i < size; i++)
+            buf[i] = av_lfg_get(&prng);
+    }
+}
+
+static void fill_coeffs(int16_t *buf, int size)
+{
+    int i;
+
+    for (i = 0; i < size; i++)
+        buf[i] = av_lfg_get(&prng);
+}
+
+static int check(const char *name, int bit_depth, int width, int height,
+                 const void *ref, const void *out, int size)
+{
+    if (memcmp(ref, out, size)) {
+        printf("error: %s %d-bit %dx%d\n", name, bit_depth, width, height);
+        return 1;
+    }
+    return 0;
+}
+
+static int test_mc(HEVCDSPContext *ref, HEVCDSPContext *opt, int bit_depth)
+{
+    DECLARE_ALIGNED(16, uint8_t, src)[STRIDE * STRIDE * 2];
+    DECLARE_ALIGNED(16, int16_t, dst_ref)[MAX_PB_SIZE * MAX_PB_SIZE];
+    DECLARE_ALIGNED(16, int16_t, dst_opt)[MAX_PB_SIZE * MAX_PB_SIZE];
+    DECLARE_ALIGNED(16, int16_t, mcbuffer)[(MAX_PB_SIZE + 7) * MAX_PB_SIZE];
+    const int pixel_size = bit_depth > 8 ? 2 : 1;
+    const ptrdiff_t srcstride = STRIDE * pixel_size;
+    uint8_t *s = src + PAD * srcstride + PAD * pixel_size;
+    int it, w, h, i, j, mx, my, err = 0;
+
+    for (it = 0; it < NB_ITS; it++) {
+        fill_pixels(src, sizeof(src), bit_depth);
+        for (w = 0; w < FF_ARRAY_ELEMS(widths); w++) {
+            for (h = 0; h < FF_ARRAY_ELEMS(heights); h++) {
+                const int width  = widths[w];
+                const int height = heights[h];
+                const int size   = sizeof(dst_ref);
+
+                for (i = 0; i < 4; i++) {
+                    for (j = 0; j < 4; j++) {
+                        if (ref->put_hevc_qpel[i][j] == opt->put_hevc_qpel[i][j])
+                            continue;
+                        memset(dst_ref, 0, size);
+                        memset(dst_opt, 0, size);
+                        ref->put_hevc_qpel[i][j](dst_ref, MAX_PB_SIZE, s, srcstride,
+                                                 width, height, mcbuffer);
+                        opt->put_hevc_qpel[i][j](dst_opt, MAX_PB_SIZE, s, srcstride,
+                                                 width, height, mcbuffer);
+                        err |= check("put_hevc_qpel", bit_depth, width, height,
+                                     dst_ref, dst_opt, size);
+                    }
+                }
+
+                for (i = 0; i < 2; i++) {
+                    for (j = 0; j < 2; j++) {
+                        if (ref->put_hevc_epel[i][j] == opt->put_hevc_epel[i][j])
+                            continue;
+                        for (mx = 1; mx < 8; mx++) {
+                            my = 8 - mx;
+                            memset(dst_ref, 0, size);
+                            memset(dst_opt, 0, size);
+                            ref->put_hevc_epel[i][j](dst_ref, MAX_PB_SIZE, s, srcstride,
+                                                     width, height, mx, my, mcbuffer);
+                            opt->put_hevc_epel[i][j](dst_opt, MAX_PB_SIZE, s, srcstride,
+                                                     width, height, mx, my, mcbuffer);
+                            err |= check("put_hevc_epel", bit_depth, width, height,
+                                         dst_ref, dst_opt, size);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return err;
+}
+
+static int test_pred(HEVCDSPContext *ref, HEVCDSPContext *opt, int bit_depth)
+{
+    DECLARE_ALIGNED(16, int16_t, src1)[MAX_PB_SIZE * MAX_PB_SIZE];
+    DECLARE_ALIGNED(16, int16_t, src2)[MAX_PB_SIZE * MAX_PB_SIZE];
+    DECLARE_ALIGNED(16, uint8_t, dst_ref)[MAX_PB_SIZE * MAX_PB_SIZE * 2];
+    DECLARE_ALIGNED(16, uint8_t, dst_opt)[MAX_PB_SIZE * MAX_PB_SIZE * 2];
+    const ptrdiff_t dststride = MAX_PB_SIZE * (bit_depth > 8 ? 2 : 1);
+    int it, w, h, err = 0;
+
+    for (it = 0; it < NB_ITS; it++) {
+        fill_coeffs(src1, FF_ARRAY_ELEMS(src1));
+        fill_coeffs(src2, FF_ARRAY_ELEMS(src2));
+        for (w = 0; w < FF_ARRAY_ELEMS(widths); w++) {
+            for (h = 0; h < FF_ARRAY_ELEMS(heights); h++) {
+                const int width  = widths[w];
+                const int height = heights[h];
+
+                if (ref->put_unweighted_pred != opt->put_unweighted_pred) {
+                    memset(dst_ref, 0, sizeof(dst_ref));
+                    memset(dst_opt, 0, sizeof(dst_opt));
+                    ref->put_unweighted_pred(dst_ref, dststride, src1, MAX_PB_SIZE,
+                                             width, height);
+                    opt->put_unweighted_pred(dst_opt, dststride, src1, MAX_PB_SIZE,
+                                             width, height);
+                    err |= check("put_unweighted_pred", bit_depth, width, height,
+                                 dst_ref, dst_opt, sizeof(dst_ref));
+                }
+                if (ref->put_weighted_pred_avg != opt->put_weighted_pred_avg) {
+                    memset(dst_ref, 0, sizeof(dst_ref));
+                    memset(dst_opt, 0, sizeof(dst_opt));
+                    ref->put_weighted_pred_avg(dst_ref, dststride, src1, src2,
+                                               MAX_PB_SIZE, width, height);
+                    opt->put_weighted_pred_avg(dst_opt, dststride, src1, src2,
+                                               MAX_PB_SIZE, width, height);
+                    err |= check("put_weighted_pred_avg", bit_depth, width, height,
+                                 dst_ref, dst_opt, sizeof(dst_ref));
+                }
+            }
+        }
+    }
+    return err;
+}
+
+static int test_deblock(HEVCDSPContext *ref, HEVCDSPContext *opt, int bit_depth)
+{
+    DECLARE_ALIGNED(16, uint8_t, pix_ref)[16 * 16 * 2];
+    DECLARE_ALIGNED(16, uint8_t, pix_opt)[16 * 16 * 2];
+    const int pixel_size = bit_depth > 8 ? 2 : 1;
+    const ptrdiff_t stride = 16 * pixel_size;
+    const int offset = 4 * stride + 4 * pixel_size;
+    int it, tc[2];
+    uint8_t no_p[2], no_q[2];
+    int err = 0;
+
+    for (it = 0; it < NB_ITS * 100; it++) {
+        int i;
+
+        fill_pixels(pix_ref, sizeof(pix_ref), bit_depth);
+        for (i = 0; i < 2; i++) {
+            tc[i]   = (int)(av_lfg_get(&prng) % 32) - 2;
+            no_p[i] = av_lfg_get(&prng) % 4 == 0;
+            no_q[i] = av_lfg_get(&prng) % 4 == 0;
+        }
+
+        if (ref->hevc_h_loop_filter_chroma != opt->hevc_h_loop_filter_chroma) {
+            memcpy(pix_opt, pix_ref, sizeof(pix_ref));
+            ref->hevc_h_loop_filter_chroma(pix_ref + offset, stride, tc, no_p, no_q);
+            opt->hevc_h_loop_filter_chroma(pix_opt + offset, stride, tc, no_p, no_q);
+            err |= check("hevc_h_loop_filter_chroma", bit_depth, 8, 4,
+                         pix_ref, pix_opt, sizeof(pix_ref));
+        }
+        if (ref->hevc_v_loop_filter_chroma != opt->hevc_v_loop_filter_chroma) {
+            memcpy(pix_opt, pix_ref, sizeof(pix_ref));
+            ref->hevc_v_loop_filter_chroma(pix_ref + offset, stride, tc, no_p, no_q);
+            opt->hevc_v_loop_filter_chroma(pix_opt + offset, stride, tc, no_p, no_q);
+            err |= check("hevc_v_loop_filter_chroma", bit_depth, 4, 8,
+                         pix_ref, pix_opt, sizeof(pix_ref));
+        }
+    }
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    static const int bit_depths[] = { 8, 9, 10 };
+    /* every instruction set is tested with the ones it builds upon */
+    static const int cpu_levels[] = {
+        AV_CPU_FLAG_MMX,
+        AV_CPU_FLAG_MMXEXT,
+        AV_CPU_FLAG_SSE,
+        AV_CPU_FLAG_SSE2,
+        AV_CPU_FLAG_SSE3,
+        AV_CPU_FLAG_SSSE3,
+        AV_CPU_FLAG_SSE4,
+        AV_CPU_FLAG_SSE42,
+        AV_CPU_FLAG_AVX,
+        AV_CPU_FLAG_AVX2,
+    };
+    HEVCDSPContext ref, opt;
+    int host_flags = av_get_cpu_flags();
+    int i, j, err = 0;
+
+    av_lfg_init(&prng, 1);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(bit_depths); i++) {
+        int mask = 0, prev_flags = -1;
+
+        av_force_cpu_flags(0);
+        ff_hevc_dsp_init(&ref, bit_depths[i]);
+
+        for (j = 0; j <= FF_ARRAY_ELEMS(cpu_levels); j++) {
+            /* the last pass uses all the flags of the host */
+            int flags = j < FF_ARRAY_ELEMS(cpu_levels) ?
+                        host_flags & (mask |= cpu_levels[j]) : host_flags;
+            int level_err;
+
+            if (!flags || flags == prev_flags)
+                continue;
+            prev_flags = flags;
+
+            av_force_cpu_flags(flags);
+            ff_hevc_dsp_init(&opt, bit_depths[i]);
+
+            level_err  = test_mc(&ref, &opt, bit_depths[i]);
+            level_err |= test_pred(&ref, &opt, bit_depths[i]);
+            level_err |= test_deblock(&ref, &opt, bit_depths[i]);
+            if (level_err)
+                printf("error: %d bit with cpu flags 0x%x\n", bit_depths[i], flags);
+            err |= level_err;
+        }
+    }
+    av_force_cpu_flags(-1);
+
+    if (!err)
+        printf("hevcdsp: all tests passed\n");
+    return err;
+}
@@ -60,6 +60,12 @@ typedef struct FramePool {
     int samples;
 } FramePool;
 
+/**
+ * The codec can decode the slices of a frame in parallel from within a
+ * frame thread, see AVCodecContext.slice_thread_count.
+ */
+#define FF_CODEC_CAP_HYBRID_THREADS (1 << 0)
+
 typedef struct AVCodecInternal {
     /**
      * Whether the parent AVCodecContext is a copy of the context which had
@@ -104,6 +110,12 @@ typedef struct AVCodecInternal {
 
     void *thread_ctx;
 
+    /**
+     * Slice threading context. Kept apart from thread_ctx so that the
+     * contexts of frame threads can run their own slice threads.
+     */
+    void *slice_thread_ctx;
+
     /**
      * Current packet as passed into the decoder, to avoid having to pass the
      * packet into every function.
@@ -241,6 +253,20 @@ const uint8_t *avpriv_find_start_code(const uint8_t *p,
                                       const uint8_t *end,
                                       uint32_t *state);
 
+/**
+ * Find all start codes in a buffer in one pass.
+ *
+ * @param offsets     receives the offset of the byte following each
+ *                    00 00 01 prefix (the start code value or NAL header),
+ *                    in increasing order. Prefixes ending in the last byte
+ *                    of the buffer are not reported.
+ * @param max_offsets size of offsets
+ * @return the number of offsets stored; if it is max_offsets, the search
+ *         may be continued from the last offset
+ */
+int avpriv_find_start_codes(const uint8_t *buf, int size,
+                            int *offsets, int max_offsets);
+
 /**
  * Check that the provided frame dimensions are valid and set them on the codec
  * context.
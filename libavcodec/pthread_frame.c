@@ -229,7 +229,7 @@ static int update_context_from_thread(AVCodecContext *dst, AVCodecContext *src,
     }
 
     if (for_user) {
-        dst->delay       = src->thread_count - 1;
+        dst->delay       = dst->thread_count - 1;
         dst->coded_frame = src->coded_frame;
     } else {
         if (dst->codec->update_thread_context)
@@ -582,6 +582,9 @@ void ff_frame_thread_free(AVCodecContext *avctx, int thread_count)
         if (codec->close)
             codec->close(p->avctx);
 
+        if (p->avctx->internal && p->avctx->internal->slice_thread_ctx)
+            ff_slice_thread_free(p->avctx);
+
         avctx->codec = NULL;
 
         release_delayed_buffers(p);
@@ -683,8 +686,12 @@ int ff_frame_thread_init(AVCodecContext *avctx)
         }
         *copy->internal = *src->internal;
         copy->internal->thread_ctx = p;
+        copy->internal->slice_thread_ctx = NULL;
         copy->internal->pkt = &p->avpkt;
 
+        if (avctx->active_thread_type & FF_THREAD_SLICE)
+            copy->thread_count = avctx->slice_thread_count;
+
         if (!i) {
             src = copy;
 
@@ -707,6 +714,10 @@ int ff_frame_thread_init(AVCodecContext *avctx)
 
         if (err) goto error;
 
+        if (avctx->active_thread_type & FF_THREAD_SLICE &&
+            (err = ff_slice_thread_init(copy)) < 0)
+            goto error;
+
         err = AVERROR(pthread_create(&p->thread, NULL, frame_worker_thread, p));
         p->thread_init= !err;
         if(!p->thread_init)
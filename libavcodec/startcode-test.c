@@ -0,0 +1,212 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Start code search test: compares avpriv_find_start_code(),
+ * avpriv_find_start_codes() and the H.264 start code candidate search
+ * against a byte by byte search, at every CPU level.
+ */
+
+#include <stdio.h>
+
+#include "libavutil/cpu.h"
+#include "libavutil/internal.h"
+#include "libavutil/lfg.h"
+#include "avcodec.h"
+#include "h264dsp.h"
+#include "internal.h"
+#include "startcode.h"
+
+#undef printf
+
+#define MAX_SIZE 1024
+#define NB_ITS   2000
+
+static AVLFG prng;
+
+static const uint8_t *find_start_code_ref(const uint8_t *p, const uint8_t *end,
+                                          uint32_t *state)
+{
+    while (p < end) {
+        *state = (*state << 8) | *p++;
+        if ((*state & 0xFFFFFF00) == 0x100)
+            break;
+    }
+    return p;
+}
+
+static int find_start_codes_ref(const uint8_t *buf, int size, int *offsets)
+{
+    int i, n = 0;
+
+    for (i = 0; i + 3 < size; i++)
+        if (!buf[i] && !buf[i + 1] && buf[i + 2] == 1)
+            offsets[n++] = i + 3;
+    return n;
+}
+
+/* random data with start codes, and zeros anywhere from rare to dense */
+static void fill_buffer(uint8_t *buf, int size)
+{
+    int i, zeros = av_lfg_get(&prng) % 2 ? av_lfg_get(&prng) % 8 :
+                                            av_lfg_get(&prng) % 32;
+
+    for (i = 0; i < size; i++) {
+        unsigned r = av_lfg_get(&prng);
+        if (r % 64 < zeros)
+            buf[i] = 0;
+        else if (r % 64 < 2 * zeros)
+            buf[i] = 1;
+        else
+            buf[i] = r >> 8;
+    }
+}
+
+static int test_find_start_code(const uint8_t *buf, int size)
+{
+    const uint8_t *p = buf, *p_ref = buf, *end = buf + size;
+    uint32_t state = av_lfg_get(&prng) % 2 ? -1 : 0x0100 | av_lfg_get(&prng) % 2;
+    uint32_t state_ref = state;
+
+    while (p < end) {
+        const uint8_t *chunk_end = p + 1 + av_lfg_get(&prng) % (end - p);
+
+        while (p < chunk_end) {
+            p     = avpriv_find_start_code(p, chunk_end, &state);
+            p_ref = find_start_code_ref(p_ref, chunk_end, &state_ref);
+            if (p != p_ref || state != state_ref) {
+                printf("error: find_start_code size %d at %d: "
+                       "got %d/%08x, expected %d/%08x\n", size,
+                       (int)(chunk_end - buf), (int)(p - buf), state,
+                       (int)(p_ref - buf), state_ref);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int test_find_start_codes(const uint8_t *buf, int size)
+{
+    int offsets[MAX_SIZE], offsets_ref[MAX_SIZE];
+    int max = 1 + av_lfg_get(&prng) % 8;
+    int n_ref = find_start_codes_ref(buf, size, offsets_ref);
+    int n = 0, pos = 0, i, ret;
+
+    do {
+        ret = avpriv_find_start_codes(buf + pos, size - pos, offsets + n, max);
+        for (i = n; i < n + ret; i++)
+            offsets[i] += pos;
+        n += ret;
+        if (ret)
+            pos = offsets[n - 1];
+    } while (ret == max);
+
+    if (n != n_ref) {
+        printf("error: find_start_codes size %d: got %d, expected %d\n",
+               size, n, n_ref);
+        return 1;
+    }
+    for (i = 0; i < n; i++) {
+        if (offsets[i] != offsets_ref[i]) {
+            printf("error: find_start_codes size %d: offset %d is %d, "
+                   "expected %d\n", size, i, offsets[i], offsets_ref[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int test_find_candidate(H264DSPContext *h264dsp,
+                               const uint8_t *buf, int size)
+{
+    int i = 0, ret, ref;
+
+    while (i < size) {
+        /* the C version may step past the end into the padding */
+        ret = FFMIN(h264dsp->h264_find_start_code_candidate(buf + i, size - i),
+                    size - i);
+        for (ref = 0; ref < size - i && buf[i + ref]; ref++);
+        if (ret != ref) {
+            printf("error: find_start_code_candidate size %d at %d: "
+                   "got %d, expected %d\n", size, i, ret, ref);
+            return 1;
+        }
+        i += ret + 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    /* every instruction set is tested with the ones it builds upon */
+    static const int cpu_levels[] = {
+        AV_CPU_FLAG_MMX,
+        AV_CPU_FLAG_MMXEXT,
+        AV_CPU_FLAG_SSE,
+        AV_CPU_FLAG_SSE2,
+        AV_CPU_FLAG_SSE3,
+        AV_CPU_FLAG_SSSE3,
+        AV_CPU_FLAG_SSE4,
+        AV_CPU_FLAG_SSE42,
+        AV_CPU_FLAG_AVX,
+        AV_CPU_FLAG_AVX2,
+    };
+    uint8_t buf[MAX_SIZE + FF_INPUT_BUFFER_PADDING_SIZE] = { 0 };
+    int host_flags = av_get_cpu_flags();
+    int mask = 0, prev_flags = -1;
+    int i, it, err = 0;
+
+    av_lfg_init(&prng, 1);
+
+    for (i = 0; i <= FF_ARRAY_ELEMS(cpu_levels) + 1; i++) {
+        /* the first pass is plain C, the last uses all the flags of the host */
+        int flags = !i ? 0 : i <= FF_ARRAY_ELEMS(cpu_levels) ?
+                    host_flags & (mask |= cpu_levels[i - 1]) : host_flags;
+        H264DSPContext h264dsp;
+        int level_err = 0;
+
+        if (flags == prev_flags)
+            continue;
+        prev_flags = flags;
+
+        av_force_cpu_flags(flags);
+        ff_startcode_init();
+        if (CONFIG_H264DSP)
+            ff_h264dsp_init(&h264dsp, 8, 1);
+        for (it = 0; it < NB_ITS && !level_err; it++) {
+            int size = av_lfg_get(&prng) % (it < NB_ITS / 2 ? 80 : MAX_SIZE);
+
+            fill_buffer(buf, size);
+            level_err |= test_find_start_code(buf, size);
+            level_err |= test_find_start_codes(buf, size);
+            if (CONFIG_H264DSP)
+                level_err |= test_find_candidate(&h264dsp, buf, size);
+        }
+        if (level_err)
+            printf("error: cpu flags 0x%x\n", flags);
+        err |= level_err;
+    }
+    av_force_cpu_flags(-1);
+    ff_startcode_init();
+
+    if (!err)
+        printf("startcode: all tests passed\n");
+    return err;
+}
@@ -0,0 +1,52 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Accelerated start code search
+ */
+
+#ifndef AVCODEC_STARTCODE_H
+#define AVCODEC_STARTCODE_H
+
+#include <stdint.h>
+
+/**
+ * Return the offset of the first 00 00 01 prefix in buf that is followed by
+ * at least one more byte. A SIMD search may stop before the end of buf; it
+ * then returns the offset from which the rest of buf has to be searched
+ * with the scalar loop. No data past buf + size is read, so buf does not
+ * need to be padded.
+ */
+typedef int (*startcode_find_prefix_func)(const uint8_t *buf, int size);
+
+/**
+ * Select the start code search used by avpriv_find_start_code() and
+ * avpriv_find_start_codes() for the current CPU flags. This is done once
+ * when the first codec is registered; it has to be called again after
+ * av_force_cpu_flags() for the change to apply to the start code search.
+ */
+void ff_startcode_init(void);
+
+/**
+ * Return a SIMD prefix search for the given CPU flags, or NULL if there
+ * is none and the scalar start code scan should be used.
+ */
+startcode_find_prefix_func ff_startcode_find_prefix_x86(int cpu_flags);
+
+#endif /* AVCODEC_STARTCODE_H */
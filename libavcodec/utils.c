@@ -32,6 +32,7 @@
 #include "libavutil/avstring.h"
 #include "libavutil/bprint.h"
 #include "libavutil/channel_layout.h"
+#include "libavutil/cpu.h"
 #include "libavutil/crc.h"
 #include "libavutil/frame.h"
 #include "libavutil/internal.h"
@@ -47,6 +48,7 @@
 #include "frame_thread_encoder.h"
 #include "internal.h"
 #include "raw.h"
+#include "startcode.h"
 #include "bytestream.h"
 #include "version.h"
 #include <stdlib.h>
@@ -196,6 +198,7 @@ static av_cold void avcodec_init(void)
 
     if (CONFIG_DSPUTIL)
         ff_dsputil_static_init();
+    ff_startcode_init();
 }
 
 int av_codec_is_encoder(const AVCodec *codec)
@@ -1665,6 +1668,10 @@ int attribute_align_arg avcodec_encode_audio2(AVCodecContext *avctx,
 
     *got_packet_ptr = 0;
 
+    if (CONFIG_FRAME_THREAD_ENCODER &&
+        avctx->internal->frame_thread_encoder && (avctx->active_thread_type&FF_THREAD_FRAME))
+        return ff_thread_audio_encode_frame(avctx, avpkt, frame, got_packet_ptr);
+
     if (!(avctx->codec->capabilities & CODEC_CAP_DELAY) && !frame) {
         av_free_packet(avpkt);
         av_init_packet(avpkt);
@@ -2642,7 +2649,8 @@ av_cold int avcodec_close(AVCodecContext *avctx)
             ff_frame_thread_encoder_free(avctx);
             ff_lock_avcodec(avctx);
         }
-        if (HAVE_THREADS && avctx->internal->thread_ctx)
+        if (HAVE_THREADS && (avctx->internal->thread_ctx ||
+                             avctx->internal->slice_thread_ctx))
             ff_thread_free(avctx);
         if (avctx->codec && avctx->codec->close)
             avctx->codec->close(avctx);
@@ -3515,6 +3523,44 @@ int avpriv_bprint_to_extradata(AVCodecContext *avctx, struct AVBPrint *buf)
     return 0;
 }
 
+static startcode_find_prefix_func startcode_find_prefix;
+
+av_cold void ff_startcode_init(void)
+{
+    startcode_find_prefix = NULL;
+    if (ARCH_X86)
+        startcode_find_prefix = ff_startcode_find_prefix_x86(av_get_cpu_flags());
+}
+
+/**
+ * Return the first 00 00 01 prefix in [p, end) that is followed by at least
+ * one more byte, or end if there is none.
+ */
+static const uint8_t *find_start_code_prefix(const uint8_t *p,
+                                             const uint8_t *end)
+{
+    const uint8_t *simd_start = end;
+
+    /* Start codes that are only a few bytes apart are found faster without
+     * the SIMD call, so it only takes over after the first 16 bytes. */
+    if (startcode_find_prefix && end - p > 32)
+        simd_start = p + 16;
+
+    for (p += 2; p < end - 1;) {
+        if (p >= simd_start) {
+            p += startcode_find_prefix(p - 2, end - p + 2);
+            simd_start = end;
+            continue;
+        }
+        if      (p[0] > 1      ) p += 3;
+        else if (p[-1]         ) p += 2;
+        else if (p[-2]|(p[0]-1)) p++;
+        else
+            return p - 2;
+    }
+    return end;
+}
+
 const uint8_t *avpriv_find_start_code(const uint8_t *av_restrict p,
                                       const uint8_t *end,
                                       uint32_t *av_restrict state)
@@ -3532,18 +3578,27 @@ const uint8_t *avpriv_find_start_code(const uint8_t *av_restrict p,
             return p;
     }
 
-    while (p < end) {
-        if      (p[-1] > 1      ) p += 3;
-        else if (p[-2]          ) p += 2;
-        else if (p[-3]|(p[-1]-1)) p++;
-        else {
-            p++;
-            break;
-        }
-    }
-
-    p = FFMIN(p, end) - 4;
+    p = find_start_code_prefix(p - 3, end);
+    if (p == end)
+        p = end - 4;
     *state = AV_RB32(p);
 
     return p + 4;
 }
+
+int avpriv_find_start_codes(const uint8_t *buf, int size,
+                            int *offsets, int max_offsets)
+{
+    const uint8_t *p = buf, *end = buf + size;
+    int nb_offsets = 0;
+
+    while (nb_offsets < max_offsets) {
+        p = find_start_code_prefix(p, end);
+        if (p == end)
+            break;
+        p += 3;
+        offsets[nb_offsets++] = p - buf;
+    }
+
+    return nb_offsets;
+}
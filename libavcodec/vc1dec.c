@@ -37,6 +37,7 @@
 #include "vc1data.h"
 #include "vc1acdata.h"
 #include "msmpeg4data.h"
+#include "thread.h"
 #include "unary.h"
 #include "mathops.h"
 #include "vdpau_internal.h"
@@ -4750,6 +4751,51 @@ static int vc1_decode_b_mb_intfr(VC1Context *v)
     return 0;
 }
 
+/* The overlap smoothing, the delayed block output and the loop filters
+ * all run behind the MB decoding, so a row is final only once the row
+ * VC1_PROGRESS_LAG below it has been decoded. */
+#define VC1_PROGRESS_LAG 3
+
+/** Report the rows of the current reference picture that later frame
+ * threads may use. Only done for progressive pictures, interlaced ones are
+ * reported as a whole by ff_MPV_frame_end(). */
+static void vc1_report_decode_progress(VC1Context *v)
+{
+    MpegEncContext *s = &v->s;
+
+    if (s->pict_type != AV_PICTURE_TYPE_B && !s->er.error_occurred &&
+        v->fcm == PROGRESSIVE && s->mb_y >= VC1_PROGRESS_LAG)
+        ff_thread_report_progress(&s->current_picture_ptr->tf,
+                                  s->mb_y - VC1_PROGRESS_LAG, 0);
+}
+
+static void vc1_await_picture(VC1Context *v, Picture *pic)
+{
+    MpegEncContext *s = &v->s;
+    /* lowest line a motion vector of this MB row can reach, including the
+     * filter taps and one MB row of margin for the chroma rounding */
+    int y = ((s->mb_y + 1) << 4) + (v->range_y >> 2) + 16;
+
+    if (!pic || pic == s->current_picture_ptr)
+        return;
+    if (v->fcm != PROGRESSIVE)
+        y <<= 1;
+    ff_thread_await_progress(&pic->tf, FFMIN(y >> 4, s->mb_height - 1), 0);
+}
+
+/** Wait until the reference pictures are decoded far enough for the
+ * motion compensation of the current MB row. */
+static void vc1_await_references(VC1Context *v)
+{
+    MpegEncContext *s = &v->s;
+
+    if (!(s->avctx->active_thread_type & FF_THREAD_FRAME))
+        return;
+    vc1_await_picture(v, s->last_picture_ptr);
+    if (s->pict_type == AV_PICTURE_TYPE_B)
+        vc1_await_picture(v, s->next_picture_ptr);
+}
+
 /** Decode blocks of I-frame
  */
 static void vc1_decode_i_blocks(VC1Context *v)
@@ -4879,6 +4925,7 @@ static void vc1_decode_i_blocks(VC1Context *v)
             ff_mpeg_draw_horiz_band(s, s->mb_y * 16, 16);
         else if (s->mb_y)
             ff_mpeg_draw_horiz_band(s, (s->mb_y - 1) * 16, 16);
+        vc1_report_decode_progress(v);
 
         s->first_slice_line = 0;
     }
@@ -5007,6 +5054,7 @@ static void vc1_decode_i_blocks_adv(VC1Context *v)
             ff_mpeg_draw_horiz_band(s, s->mb_y * 16, 16);
         else if (s->mb_y)
             ff_mpeg_draw_horiz_band(s, (s->mb_y-1) * 16, 16);
+        vc1_report_decode_progress(v);
         s->first_slice_line = 0;
     }
 
@@ -5063,6 +5111,7 @@ static void vc1_decode_p_blocks(VC1Context *v)
     for (s->mb_y = s->start_mb_y; s->mb_y < s->end_mb_y; s->mb_y++) {
         s->mb_x = 0;
         init_block_index(v);
+        vc1_await_references(v);
         for (; s->mb_x < s->mb_width; s->mb_x++) {
             ff_update_block_index(s);
 
@@ -5086,6 +5135,7 @@ static void vc1_decode_p_blocks(VC1Context *v)
         memmove(v->is_intra_base, v->is_intra, sizeof(v->is_intra_base[0]) * s->mb_stride);
         memmove(v->luma_mv_base,  v->luma_mv,  sizeof(v->luma_mv_base[0])  * s->mb_stride);
         if (s->mb_y != s->start_mb_y) ff_mpeg_draw_horiz_band(s, (s->mb_y - 1) * 16, 16);
+        vc1_report_decode_progress(v);
         s->first_slice_line = 0;
     }
     if (apply_loop_filter) {
@@ -5135,6 +5185,7 @@ static void vc1_decode_b_blocks(VC1Context *v)
     for (s->mb_y = s->start_mb_y; s->mb_y < s->end_mb_y; s->mb_y++) {
         s->mb_x = 0;
         init_block_index(v);
+        vc1_await_references(v);
         for (; s->mb_x < s->mb_width; s->mb_x++) {
             ff_update_block_index(s);
 
@@ -5178,10 +5229,12 @@ static void vc1_decode_skip_blocks(VC1Context *v)
         s->mb_x = 0;
         init_block_index(v);
         ff_update_block_index(s);
+        vc1_await_references(v);
         memcpy(s->dest[0], s->last_picture.f.data[0] + s->mb_y * 16 * s->linesize,   s->linesize   * 16);
         memcpy(s->dest[1], s->last_picture.f.data[1] + s->mb_y *  8 * s->uvlinesize, s->uvlinesize *  8);
         memcpy(s->dest[2], s->last_picture.f.data[2] + s->mb_y *  8 * s->uvlinesize, s->uvlinesize *  8);
         ff_mpeg_draw_horiz_band(s, s->mb_y * 16, 16);
+        vc1_report_decode_progress(v);
         s->first_slice_line = 0;
     }
     s->pict_type = AV_PICTURE_TYPE_P;
@@ -5741,6 +5794,9 @@ static av_cold int vc1_decode_init(AVCodecContext *avctx)
             return AVERROR_PATCHWELCOME;
         }
     }
+
+    avctx->internal->allocate_progress = 1;
+
     return 0;
 }
 
@@ -5779,6 +5835,89 @@ av_cold int ff_vc1_decode_end(AVCodecContext *avctx)
 }
 
 
+#if HAVE_THREADS
+#define copy_fields(to, from, start_field, end_field)                   \
+    memcpy(&to->start_field, &from->start_field,                        \
+           (char *)&to->end_field - (char *)&to->start_field)
+
+static av_cold int vc1_init_thread_copy(AVCodecContext *avctx)
+{
+    VC1Context *v = avctx->priv_data;
+
+    /* the sprite frame belongs to the main context */
+    v->sprite_output_frame = av_frame_alloc();
+    if (!v->sprite_output_frame)
+        return AVERROR(ENOMEM);
+    return 0;
+}
+
+static int vc1_update_thread_context(AVCodecContext *dst,
+                                     const AVCodecContext *src)
+{
+    VC1Context *v = dst->priv_data;
+    const VC1Context *v1 = src->priv_data;
+    MpegEncContext *s = &v->s;
+    const MpegEncContext *s1 = &v1->s;
+    int ret;
+
+    if (dst == src)
+        return 0;
+
+    /* the VC-1 tables are sized for the picture, reallocate them below */
+    if (s->context_initialized &&
+        (s->width != s1->width || s->height != s1->height)) {
+        AVFrame *sprite_output_frame = v->sprite_output_frame;
+
+        v->sprite_output_frame = NULL;
+        ff_vc1_decode_end(dst);
+        v->sprite_output_frame = sprite_output_frame;
+    }
+
+    if ((ret = ff_mpeg_update_thread_context(dst, src)) < 0)
+        return ret;
+
+    if (s->context_initialized && !v->mv_type_mb_plane &&
+        (ret = ff_vc1_decode_init_alloc_tables(v)) < 0)
+        return ret;
+
+    s->loop_filter = s1->loop_filter;
+    s->h_edge_pos  = s1->h_edge_pos;
+    s->v_edge_pos  = s1->v_edge_pos;
+
+    /* sequence header and entry point */
+    copy_fields(v, v1, res_sprite, mv_mode);
+    v->hrd_num_leaky_buckets = v1->hrd_num_leaky_buckets;
+    v->range_mapy_flag       = v1->range_mapy_flag;
+    v->range_mapuv_flag      = v1->range_mapuv_flag;
+    v->range_mapy            = v1->range_mapy;
+    v->range_mapuv           = v1->range_mapuv;
+    v->broken_link           = v1->broken_link;
+    v->closed_entry          = v1->closed_entry;
+
+    /* state the following picture headers depend on */
+    copy_fields(v, v1, last_luty, curr_luty);
+    v->last_use_ic = v1->last_use_ic;
+    v->next_use_ic = v1->next_use_ic;
+    v->aux_use_ic  = v1->aux_use_ic;
+    v->rnd         = v1->rnd;
+    v->qs_last     = v1->qs_last;
+    v->refdist     = v1->refdist;
+
+    /* field MV types of the last anchor, for the direct mode of B fields */
+    if (v->mv_f_next_base && v1->mv_f_next_base) {
+        int mb_height = FFALIGN(s->mb_height, 2);
+        int size = s->b8_stride * (mb_height * 2 + 1) + s->mb_stride * (mb_height + 1) * 2;
+
+        /* mv_f and mv_f_next are swapped as a whole, copy from the base of
+         * the buffer holding both directions */
+        memcpy(v->mv_f_next[0] - s->b8_stride - 1,
+               v1->mv_f_next[0] - s1->b8_stride - 1, 2 * size);
+    }
+
+    return 0;
+}
+#endif
+
 /** Decode a VC1/WMV3 frame
  * @todo TODO: Handle VC-1 IDUs (Transport level?)
  */
@@ -5793,6 +5932,7 @@ static int vc1_decode_frame(AVCodecContext *avctx, void *data,
     uint8_t *buf2 = NULL;
     const uint8_t *buf_start = buf, *buf_start_second_field = NULL;
     int mb_height, n_slices1=-1;
+    int frame_started = 0;
     struct {
         uint8_t *buf;
         GetBitContext gb;
@@ -6023,6 +6163,7 @@ static int vc1_decode_frame(AVCodecContext *avctx, void *data,
     if (ff_MPV_frame_start(s, avctx) < 0) {
         goto err;
     }
+    frame_started = 1;
 
     v->s.current_picture_ptr->field_picture = v->field_mode;
     v->s.current_picture_ptr->f.interlaced_frame = (v->fcm != PROGRESSIVE);
@@ -6043,6 +6184,12 @@ static int vc1_decode_frame(AVCodecContext *avctx, void *data,
     s->me.qpel_put = s->dsp.put_qpel_pixels_tab;
     s->me.qpel_avg = s->dsp.avg_qpel_pixels_tab;
 
+    /* Field pictures parse the header of their second field, and anchor
+     * fields fill mv_f_next, while decoding the blocks; the next frame
+     * thread can only be set up once those are done. */
+    if (!v->field_mode)
+        ff_thread_finish_setup(avctx);
+
     if ((CONFIG_VC1_VDPAU_DECODER)
         &&s->avctx->codec->capabilities&CODEC_CAP_HWACCEL_VDPAU) {
         if (v->field_mode && buf_start_second_field) {
@@ -6225,6 +6372,9 @@ end:
     return buf_size;
 
 err:
+    /* do not leave other frame threads waiting on an unfinished picture */
+    if (frame_started)
+        ff_thread_report_progress(&s->current_picture_ptr->tf, INT_MAX, 0);
     av_free(buf2);
     for (i = 0; i < n_slices; i++)
         av_free(slices[i].buf);
@@ -6265,9 +6415,11 @@ AVCodec ff_vc1_decoder = {
     .close          = ff_vc1_decode_end,
     .decode         = vc1_decode_frame,
     .flush          = ff_mpeg_flush,
-    .capabilities   = CODEC_CAP_DR1 | CODEC_CAP_DELAY,
+    .capabilities   = CODEC_CAP_DR1 | CODEC_CAP_DELAY | CODEC_CAP_FRAME_THREADS,
     .pix_fmts       = vc1_hwaccel_pixfmt_list_420,
-    .profiles       = NULL_IF_CONFIG_SMALL(profiles)
+    .profiles       = NULL_IF_CONFIG_SMALL(profiles),
+    .init_thread_copy      = ONLY_IF_THREADS_ENABLED(vc1_init_thread_copy),
+    .update_thread_context = ONLY_IF_THREADS_ENABLED(vc1_update_thread_context),
 };
 
 #if CONFIG_WMV3_DECODER
@@ -6281,9 +6433,11 @@ AVCodec ff_wmv3_decoder = {
     .close          = ff_vc1_decode_end,
     .decode         = vc1_decode_frame,
     .flush          = ff_mpeg_flush,
-    .capabilities   = CODEC_CAP_DR1 | CODEC_CAP_DELAY,
+    .capabilities   = CODEC_CAP_DR1 | CODEC_CAP_DELAY | CODEC_CAP_FRAME_THREADS,
     .pix_fmts       = vc1_hwaccel_pixfmt_list_420,
-    .profiles       = NULL_IF_CONFIG_SMALL(profiles)
+    .profiles       = NULL_IF_CONFIG_SMALL(profiles),
+    .init_thread_copy      = ONLY_IF_THREADS_ENABLED(vc1_init_thread_copy),
+    .update_thread_context = ONLY_IF_THREADS_ENABLED(vc1_update_thread_context),
 };
 #endif
 
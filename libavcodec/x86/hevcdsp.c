@@ -0,0 +1,669 @@
+/*
+ * SIMD-optimized HEVC functions
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/attributes.h"
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86/asm.h"
+#include "libavutil/x86/cpu.h"
+#include "libavcodec/hevc.h"
+#include "libavcodec/hevcdsp.h"
+#include "constants.h"
+
+#if HAVE_SSE2_INLINE
+
+DECLARE_ALIGNED(16, static const xmm_reg, pw_1023) = { 0x03FF03FF03FF03FFULL, 0x03FF03FF03FF03FFULL };
+
+#define REP8(a)     { a, a, a, a, a, a, a, a }
+#define PAIR4(a, b) { a, b, a, b, a, b, a, b }
+
+/* Taps of the luma filters on 8-bit pixels, from the first non-zero one.
+ * The first one starts at src[x - 3], the last one at src[x - 2]. */
+DECLARE_ALIGNED(16, static const int16_t, qpel_taps)[3][8][8] = {
+    { REP8(-1), REP8(4), REP8(-10), REP8(58), REP8(17),  REP8(-5), REP8(1)  },
+    { REP8(-1), REP8(4), REP8(-11), REP8(40), REP8(40), REP8(-11), REP8(4), REP8(-1) },
+    { REP8(1), REP8(-5), REP8(17),  REP8(58), REP8(-10), REP8(4),  REP8(-1) },
+};
+static const int qpel_first[3] = { -3, -3, -2 };
+static const int qpel_ntaps[3] = {  7,  8,  7 };
+
+/* The same taps in pairs, for filtering the 16-bit output of the first pass
+ * with pmaddwd; the odd last tap is paired with a zero. */
+DECLARE_ALIGNED(16, static const int16_t, qpel_pairs)[3][4][8] = {
+    { PAIR4(-1,   4), PAIR4(-10, 58), PAIR4(17,  -5), PAIR4(1,  0) },
+    { PAIR4(-1,   4), PAIR4(-11, 40), PAIR4(40, -11), PAIR4(4, -1) },
+    { PAIR4( 1,  -5), PAIR4( 17, 58), PAIR4(-10,  4), PAIR4(-1, 0) },
+};
+
+#define EPEL_TAPS(a, b, c, d)  { REP8(a), REP8(b), REP8(c), REP8(d) }
+#define EPEL_PAIRS(a, b, c, d) { PAIR4(a, b), PAIR4(c, d) }
+
+/* ff_hevc_epel_filters, as 16-bit taps and pairs of taps */
+DECLARE_ALIGNED(16, static const int16_t, epel_taps)[7][4][8] = {
+    EPEL_TAPS(-2, 58, 10, -2), EPEL_TAPS(-4, 54, 16, -2),
+    EPEL_TAPS(-6, 46, 28, -4), EPEL_TAPS(-4, 36, 36, -4),
+    EPEL_TAPS(-4, 28, 46, -6), EPEL_TAPS(-2, 16, 54, -4),
+    EPEL_TAPS(-2, 10, 58, -2),
+};
+DECLARE_ALIGNED(16, static const int16_t, epel_pairs)[7][2][8] = {
+    EPEL_PAIRS(-2, 58, 10, -2), EPEL_PAIRS(-4, 54, 16, -2),
+    EPEL_PAIRS(-6, 46, 28, -4), EPEL_PAIRS(-4, 36, 36, -4),
+    EPEL_PAIRS(-4, 28, 46, -6), EPEL_PAIRS(-2, 16, 54, -4),
+    EPEL_PAIRS(-2, 10, 58, -2),
+};
+
+/*
+ * dst[i] = sum(taps[k] * src[i + k * step]) for 8 (or 4) pixels, where src
+ * points to the first tap. Sums of 8-bit pixels fit in 16 bits for all the
+ * HEVC filters.
+ */
+#define FILTER_8BIT(n, LOAD, STORE)                                         \
+static av_always_inline void filter_8bit_ ## n(int16_t *dst,                \
+                                               const uint8_t *src,          \
+                                               x86_reg step,                \
+                                               const int16_t (*taps)[8],    \
+                                               int ntaps)                   \
+{                                                                           \
+    __asm__ volatile(                                                       \
+        "pxor      %%xmm7, %%xmm7       \n\t"                               \
+        "pxor      %%xmm0, %%xmm0       \n\t"                               \
+        "1:                             \n\t"                               \
+        LOAD"      (%0),   %%xmm1       \n\t"                               \
+        "punpcklbw %%xmm7, %%xmm1       \n\t"                               \
+        "pmullw    (%1),   %%xmm1       \n\t"                               \
+        "paddw     %%xmm1, %%xmm0       \n\t"                               \
+        "add       %3,     %0           \n\t"                               \
+        "add       $16,    %1           \n\t"                               \
+        "dec       %2                   \n\t"                               \
+        "jg        1b                   \n\t"                               \
+        STORE"     %%xmm0, (%4)         \n\t"                               \
+        : "+r"(src), "+r"(taps), "+r"(ntaps)                                \
+        : "r"(step), "r"(dst)                                               \
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm7",) "memory");               \
+}
+
+FILTER_8BIT(8, "movq", "movdqu")
+FILTER_8BIT(4, "movd", "movq")
+
+/*
+ * dst[i] = sum(pairs[k] * (src[i + 2k * step], src[i + (2k + 1) * step])) >> 6
+ * for 8 (or 4) 16-bit values, with 32-bit intermediates.
+ */
+static av_always_inline void filter_16bit_8(int16_t *dst, const int16_t *src,
+                                            x86_reg step,
+                                            const int16_t (*pairs)[8],
+                                            int npairs)
+{
+    __asm__ volatile(
+        "pxor      %%xmm0, %%xmm0       \n\t"
+        "pxor      %%xmm1, %%xmm1       \n\t"
+        "1:                             \n\t"
+        "movdqu    (%0),   %%xmm2       \n\t"
+        "movdqu    (%0,%3), %%xmm3      \n\t"
+        "movdqa    %%xmm2, %%xmm4       \n\t"
+        "punpcklwd %%xmm3, %%xmm2       \n\t"
+        "punpckhwd %%xmm3, %%xmm4       \n\t"
+        "pmaddwd   (%1),   %%xmm2       \n\t"
+        "pmaddwd   (%1),   %%xmm4       \n\t"
+        "paddd     %%xmm2, %%xmm0       \n\t"
+        "paddd     %%xmm4, %%xmm1       \n\t"
+        "lea       (%0,%3,2), %0        \n\t"
+        "add       $16,    %1           \n\t"
+        "dec       %2                   \n\t"
+        "jg        1b                   \n\t"
+        "psrad     $6,     %%xmm0       \n\t"
+        "psrad     $6,     %%xmm1       \n\t"
+        "packssdw  %%xmm1, %%xmm0       \n\t"
+        "movdqu    %%xmm0, (%4)         \n\t"
+        : "+r"(src), "+r"(pairs), "+r"(npairs)
+        : "r"(step), "r"(dst)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4",) "memory");
+}
+
+static av_always_inline void filter_16bit_4(int16_t *dst, const int16_t *src,
+                                            x86_reg step,
+                                            const int16_t (*pairs)[8],
+                                            int npairs)
+{
+    __asm__ volatile(
+        "pxor      %%xmm0, %%xmm0       \n\t"
+        "1:                             \n\t"
+        "movq      (%0),   %%xmm2       \n\t"
+        "movq      (%0,%3), %%xmm3      \n\t"
+        "punpcklwd %%xmm3, %%xmm2       \n\t"
+        "pmaddwd   (%1),   %%xmm2       \n\t"
+        "paddd     %%xmm2, %%xmm0       \n\t"
+        "lea       (%0,%3,2), %0        \n\t"
+        "add       $16,    %1           \n\t"
+        "dec       %2                   \n\t"
+        "jg        1b                   \n\t"
+        "psrad     $6,     %%xmm0       \n\t"
+        "packssdw  %%xmm0, %%xmm0       \n\t"
+        "movq      %%xmm0, (%4)         \n\t"
+        : "+r"(src), "+r"(pairs), "+r"(npairs)
+        : "r"(step), "r"(dst)
+        : XMM_CLOBBERS("%xmm0", "%xmm2", "%xmm3",) "memory");
+}
+
+/* Filter a block of 8-bit pixels; the last width % 4 columns are done in C. */
+static av_always_inline void filter_block_8bit(int16_t *dst, ptrdiff_t dststride,
+                                               const uint8_t *src, ptrdiff_t srcstride,
+                                               x86_reg step, const int16_t (*taps)[8],
+                                               int ntaps, int width, int height)
+{
+    int x, y, k;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x + 8 <= width; x += 8)
+            filter_8bit_8(dst + x, src + x, step, taps, ntaps);
+        if (x + 4 <= width) {
+            filter_8bit_4(dst + x, src + x, step, taps, ntaps);
+            x += 4;
+        }
+        for (; x < width; x++) {
+            int sum = 0;
+            for (k = 0; k < ntaps; k++)
+                sum += taps[k][0] * src[x + k * step];
+            dst[x] = sum;
+        }
+        src += srcstride;
+        dst += dststride;
+    }
+}
+
+/* Second pass of the 2D filters, over rows of MAX_PB_SIZE 16-bit values. */
+static av_always_inline void filter_block_16bit(int16_t *dst, ptrdiff_t dststride,
+                                                const int16_t *src,
+                                                const int16_t (*pairs)[8],
+                                                int npairs, int width, int height)
+{
+    const x86_reg step = MAX_PB_SIZE * sizeof(*src);
+    int x, y, k;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x + 8 <= width; x += 8)
+            filter_16bit_8(dst + x, src + x, step, pairs, npairs);
+        if (x + 4 <= width) {
+            filter_16bit_4(dst + x, src + x, step, pairs, npairs);
+            x += 4;
+        }
+        for (; x < width; x++) {
+            int sum = 0;
+            for (k = 0; k < npairs; k++)
+                sum += pairs[k][0] * src[x + 2 * k * MAX_PB_SIZE] +
+                       pairs[k][1] * src[x + (2 * k + 1) * MAX_PB_SIZE];
+            dst[x] = sum >> 6;
+        }
+        src += MAX_PB_SIZE;
+        dst += dststride;
+    }
+}
+
+static void put_hevc_pixels_8_sse2(int16_t *dst, ptrdiff_t dststride,
+                                   uint8_t *src, ptrdiff_t srcstride,
+                                   int width, int height)
+{
+    int x, y;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x + 8 <= width; x += 8)
+            __asm__ volatile(
+                "pxor      %%xmm7, %%xmm7   \n\t"
+                "movq      (%0),   %%xmm0   \n\t"
+                "punpcklbw %%xmm7, %%xmm0   \n\t"
+                "psllw     $6,     %%xmm0   \n\t"
+                "movdqu    %%xmm0, (%1)     \n\t"
+                :: "r"(src + x), "r"(dst + x)
+                : XMM_CLOBBERS("%xmm0", "%xmm7",) "memory");
+        for (; x < width; x++)
+            dst[x] = src[x] << 6;
+        src += srcstride;
+        dst += dststride;
+    }
+}
+
+static void put_hevc_qpel_pixels_8_sse2(int16_t *dst, ptrdiff_t dststride,
+                                        uint8_t *src, ptrdiff_t srcstride,
+                                        int width, int height, int16_t *mcbuffer)
+{
+    put_hevc_pixels_8_sse2(dst, dststride, src, srcstride, width, height);
+}
+
+static void put_hevc_epel_pixels_8_sse2(int16_t *dst, ptrdiff_t dststride,
+                                        uint8_t *src, ptrdiff_t srcstride,
+                                        int width, int height, int mx, int my,
+                                        int16_t *mcbuffer)
+{
+    put_hevc_pixels_8_sse2(dst, dststride, src, srcstride, width, height);
+}
+
+#define PUT_HEVC_QPEL_H(H)                                                      \
+static void put_hevc_qpel_h ## H ## _8_sse2(int16_t *dst, ptrdiff_t dststride,  \
+                                            uint8_t *src, ptrdiff_t srcstride,  \
+                                            int width, int height,              \
+                                            int16_t *mcbuffer)                  \
+{                                                                               \
+    filter_block_8bit(dst, dststride, src + qpel_first[H - 1], srcstride, 1,    \
+                      qpel_taps[H - 1], qpel_ntaps[H - 1], width, height);      \
+}
+
+#define PUT_HEVC_QPEL_V(V)                                                      \
+static void put_hevc_qpel_v ## V ## _8_sse2(int16_t *dst, ptrdiff_t dststride,  \
+                                            uint8_t *src, ptrdiff_t srcstride,  \
+                                            int width, int height,              \
+                                            int16_t *mcbuffer)                  \
+{                                                                               \
+    filter_block_8bit(dst, dststride, src + qpel_first[V - 1] * srcstride,      \
+                      srcstride, srcstride, qpel_taps[V - 1],                   \
+                      qpel_ntaps[V - 1], width, height);                        \
+}
+
+#define PUT_HEVC_QPEL_HV(H, V)                                                  \
+static void put_hevc_qpel_h ## H ## v ## V ## _8_sse2(int16_t *dst,             \
+                                                      ptrdiff_t dststride,      \
+                                                      uint8_t *src,             \
+                                                      ptrdiff_t srcstride,      \
+                                                      int width, int height,    \
+                                                      int16_t *mcbuffer)        \
+{                                                                               \
+    /* one spare row for the zero tap paired with the last one */               \
+    DECLARE_ALIGNED(16, int16_t, tmp)[(MAX_PB_SIZE + 8) * MAX_PB_SIZE];         \
+                                                                                \
+    filter_block_8bit(tmp, MAX_PB_SIZE,                                         \
+                      src + qpel_first[V - 1] * srcstride + qpel_first[H - 1],  \
+                      srcstride, 1, qpel_taps[H - 1], qpel_ntaps[H - 1],        \
+                      width, height + ff_hevc_qpel_extra[V]);                   \
+    filter_block_16bit(dst, dststride, tmp, qpel_pairs[V - 1], 4,               \
+                       width, height);                                          \
+}
+
+PUT_HEVC_QPEL_H(1)
+PUT_HEVC_QPEL_H(2)
+PUT_HEVC_QPEL_H(3)
+PUT_HEVC_QPEL_V(1)
+PUT_HEVC_QPEL_V(2)
+PUT_HEVC_QPEL_V(3)
+PUT_HEVC_QPEL_HV(1, 1)
+PUT_HEVC_QPEL_HV(1, 2)
+PUT_HEVC_QPEL_HV(1, 3)
+PUT_HEVC_QPEL_HV(2, 1)
+PUT_HEVC_QPEL_HV(2, 2)
+PUT_HEVC_QPEL_HV(2, 3)
+PUT_HEVC_QPEL_HV(3, 1)
+PUT_HEVC_QPEL_HV(3, 2)
+PUT_HEVC_QPEL_HV(3, 3)
+
+static void put_hevc_epel_h_8_sse2(int16_t *dst, ptrdiff_t dststride,
+                                   uint8_t *src, ptrdiff_t srcstride,
+                                   int width, int height, int mx, int my,
+                                   int16_t *mcbuffer)
+{
+    filter_block_8bit(dst, dststride, src - 1, srcstride, 1,
+                      epel_taps[mx - 1], 4, width, height);
+}
+
+static void put_hevc_epel_v_8_sse2(int16_t *dst, ptrdiff_t dststride,
+                                   uint8_t *src, ptrdiff_t srcstride,
+                                   int width, int height, int mx, int my,
+                                   int16_t *mcbuffer)
+{
+    filter_block_8bit(dst, dststride, src - srcstride, srcstride, srcstride,
+                      epel_taps[my - 1], 4, width, height);
+}
+
+static void put_hevc_epel_hv_8_sse2(int16_t *dst, ptrdiff_t dststride,
+                                    uint8_t *src, ptrdiff_t srcstride,
+                                    int width, int height, int mx, int my,
+                                    int16_t *mcbuffer)
+{
+    DECLARE_ALIGNED(16, int16_t, tmp)[(MAX_PB_SIZE + 3) * MAX_PB_SIZE];
+
+    filter_block_8bit(tmp, MAX_PB_SIZE, src - EPEL_EXTRA_BEFORE * srcstride - 1,
+                      srcstride, 1, epel_taps[mx - 1], 4,
+                      width, height + EPEL_EXTRA);
+    filter_block_16bit(dst, dststride, tmp, epel_pairs[my - 1], 2,
+                       width, height);
+}
+
+/*
+ * Rounding, shifting and clipping the 14-bit predictions to pixels, for
+ * 8 pixels at a time; the last width % 8 columns are done in C.
+ */
+static void put_unweighted_pred_8_sse2(uint8_t *dst, ptrdiff_t dststride,
+                                       int16_t *src, ptrdiff_t srcstride,
+                                       int width, int height)
+{
+    int x, y;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x + 8 <= width; x += 8)
+            __asm__ volatile(
+                "movdqu    (%0),   %%xmm0   \n\t"
+                "paddsw    %2,     %%xmm0   \n\t"
+                "psraw     $6,     %%xmm0   \n\t"
+                "packuswb  %%xmm0, %%xmm0   \n\t"
+                "movq      %%xmm0, (%1)     \n\t"
+                :: "r"(src + x), "r"(dst + x), "m"(ff_pw_32)
+                : XMM_CLOBBERS("%xmm0",) "memory");
+        for (; x < width; x++)
+            dst[x] = av_clip_uint8((src[x] + 32) >> 6);
+        dst += dststride;
+        src += srcstride;
+    }
+}
+
+static void put_weighted_pred_avg_8_sse2(uint8_t *dst, ptrdiff_t dststride,
+                                         int16_t *src1, int16_t *src2,
+                                         ptrdiff_t srcstride,
+                                         int width, int height)
+{
+    int x, y;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x + 8 <= width; x += 8)
+            __asm__ volatile(
+                "movdqu    (%0),   %%xmm0   \n\t"
+                "movdqu    (%1),   %%xmm1   \n\t"
+                "paddsw    %%xmm1, %%xmm0   \n\t"
+                "paddsw    %3,     %%xmm0   \n\t"
+                "psraw     $7,     %%xmm0   \n\t"
+                "packuswb  %%xmm0, %%xmm0   \n\t"
+                "movq      %%xmm0, (%2)     \n\t"
+                :: "r"(src1 + x), "r"(src2 + x), "r"(dst + x), "m"(ff_pw_64)
+                : XMM_CLOBBERS("%xmm0", "%xmm1",) "memory");
+        for (; x < width; x++)
+            dst[x] = av_clip_uint8((src1[x] + src2[x] + 64) >> 7);
+        dst  += dststride;
+        src1 += srcstride;
+        src2 += srcstride;
+    }
+}
+
+static void put_hevc_pixels_10_sse2(int16_t *dst, ptrdiff_t dststride,
+                                    uint8_t *_src, ptrdiff_t _srcstride,
+                                    int width, int height)
+{
+    uint16_t *src       = (uint16_t *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(*src);
+    int x, y;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x + 8 <= width; x += 8)
+            __asm__ volatile(
+                "movdqu    (%0),   %%xmm0   \n\t"
+                "psllw     $4,     %%xmm0   \n\t"
+                "movdqu    %%xmm0, (%1)     \n\t"
+                :: "r"(src + x), "r"(dst + x)
+                : XMM_CLOBBERS("%xmm0",) "memory");
+        for (; x < width; x++)
+            dst[x] = src[x] << 4;
+        src += srcstride;
+        dst += dststride;
+    }
+}
+
+static void put_hevc_qpel_pixels_10_sse2(int16_t *dst, ptrdiff_t dststride,
+                                         uint8_t *src, ptrdiff_t srcstride,
+                                         int width, int height, int16_t *mcbuffer)
+{
+    put_hevc_pixels_10_sse2(dst, dststride, src, srcstride, width, height);
+}
+
+static void put_hevc_epel_pixels_10_sse2(int16_t *dst, ptrdiff_t dststride,
+                                         uint8_t *src, ptrdiff_t srcstride,
+                                         int width, int height, int mx, int my,
+                                         int16_t *mcbuffer)
+{
+    put_hevc_pixels_10_sse2(dst, dststride, src, srcstride, width, height);
+}
+
+static void put_unweighted_pred_10_sse2(uint8_t *_dst, ptrdiff_t _dststride,
+                                        int16_t *src, ptrdiff_t srcstride,
+                                        int width, int height)
+{
+    uint16_t *dst       = (uint16_t *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(*dst);
+    int x, y;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x + 8 <= width; x += 8)
+            __asm__ volatile(
+                "pxor      %%xmm7, %%xmm7   \n\t"
+                "movdqu    (%0),   %%xmm0   \n\t"
+                "paddsw    %2,     %%xmm0   \n\t"
+                "psraw     $4,     %%xmm0   \n\t"
+                "pmaxsw    %%xmm7, %%xmm0   \n\t"
+                "pminsw    %3,     %%xmm0   \n\t"
+                "movdqu    %%xmm0, (%1)     \n\t"
+                :: "r"(src + x), "r"(dst + x), "m"(ff_pw_8), "m"(pw_1023)
+                : XMM_CLOBBERS("%xmm0", "%xmm7",) "memory");
+        for (; x < width; x++)
+            dst[x] = av_clip_uintp2((src[x] + 8) >> 4, 10);
+        dst += dststride;
+        src += srcstride;
+    }
+}
+
+static void put_weighted_pred_avg_10_sse2(uint8_t *_dst, ptrdiff_t _dststride,
+                                          int16_t *src1, int16_t *src2,
+                                          ptrdiff_t srcstride,
+                                          int width, int height)
+{
+    uint16_t *dst       = (uint16_t *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(*dst);
+    int x, y;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x + 8 <= width; x += 8)
+            __asm__ volatile(
+                "pxor      %%xmm7, %%xmm7   \n\t"
+                "movdqu    (%0),   %%xmm0   \n\t"
+                "movdqu    (%1),   %%xmm1   \n\t"
+                "paddsw    %%xmm1, %%xmm0   \n\t"
+                "paddsw    %3,     %%xmm0   \n\t"
+                "psraw     $5,     %%xmm0   \n\t"
+                "pmaxsw    %%xmm7, %%xmm0   \n\t"
+                "pminsw    %4,     %%xmm0   \n\t"
+                "movdqu    %%xmm0, (%2)     \n\t"
+                :: "r"(src1 + x), "r"(src2 + x), "r"(dst + x),
+                   "m"(ff_pw_16), "m"(pw_1023)
+                : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm7",) "memory");
+        for (; x < width; x++)
+            dst[x] = av_clip_uintp2((src1[x] + src2[x] + 16) >> 5, 10);
+        dst  += dststride;
+        src1 += srcstride;
+        src2 += srcstride;
+    }
+}
+
+/*
+ * Chroma deblocking of 8 pixels along an edge, in two segments of 4 with
+ * their own tc and no_p/no_q flags. xmm0-xmm3 hold p1, p0, q0, q1 as words;
+ * the filtered p0 and q0 are left in xmm1 and xmm2.
+ */
+#define CHROMA_DEBLOCK                                                      \
+        "movdqa    %%xmm2, %%xmm4       \n\t"                               \
+        "psubw     %%xmm1, %%xmm4       \n\t"                               \
+        "psllw     $2,     %%xmm4       \n\t"                               \
+        "paddw     %%xmm0, %%xmm4       \n\t"                               \
+        "psubw     %%xmm3, %%xmm4       \n\t"                               \
+        "paddw     %[pw_4], %%xmm4      \n\t"                               \
+        "psraw     $3,     %%xmm4       \n\t"                               \
+        "pxor      %%xmm5, %%xmm5       \n\t"                               \
+        "psubw       (%[par]), %%xmm5   \n\t"                               \
+        "pminsw      (%[par]), %%xmm4   \n\t"                               \
+        "pmaxsw    %%xmm5, %%xmm4       \n\t"                               \
+        "movdqa    %%xmm4, %%xmm5       \n\t"                               \
+        "pand      16(%[par]), %%xmm4   \n\t"                               \
+        "pand      32(%[par]), %%xmm5   \n\t"                               \
+        "paddw     %%xmm4, %%xmm1       \n\t"                               \
+        "psubw     %%xmm5, %%xmm2       \n\t"
+
+/* tc, then the masks of the pixels to write on the p and q sides */
+static av_always_inline void chroma_deblock_params(int16_t (*par)[8], const int *tc,
+                                                   const uint8_t *no_p,
+                                                   const uint8_t *no_q)
+{
+    int i;
+
+    /* tc <= 0 leaves the pixels unchanged, as a tc of 0 does */
+    for (i = 0; i < 8; i++) {
+        par[0][i] = FFMAX(tc[i >> 2], 0);
+        par[1][i] = no_p[i >> 2] ? 0 : -1;
+        par[2][i] = no_q[i >> 2] ? 0 : -1;
+    }
+}
+
+static void hevc_h_loop_filter_chroma_8_sse2(uint8_t *pix, ptrdiff_t stride,
+                                             int *tc, uint8_t *no_p,
+                                             uint8_t *no_q)
+{
+    DECLARE_ALIGNED(16, int16_t, par)[3][8];
+    uint8_t *p1 = pix - 2 * stride;
+
+    chroma_deblock_params(par, tc, no_p, no_q);
+
+    __asm__ volatile(
+        "pxor      %%xmm7, %%xmm7       \n\t"
+        "movq      (%[p1]),             %%xmm0 \n\t"
+        "movq      (%[p1],%[stride]),   %%xmm1 \n\t"
+        "movq      (%[p1],%[stride],2), %%xmm2 \n\t"
+        "movq      (%[q1]),             %%xmm3 \n\t"
+        "punpcklbw %%xmm7, %%xmm0       \n\t"
+        "punpcklbw %%xmm7, %%xmm1       \n\t"
+        "punpcklbw %%xmm7, %%xmm2       \n\t"
+        "punpcklbw %%xmm7, %%xmm3       \n\t"
+        CHROMA_DEBLOCK
+        "packuswb  %%xmm1, %%xmm1       \n\t"
+        "packuswb  %%xmm2, %%xmm2       \n\t"
+        "movq      %%xmm1, (%[p1],%[stride])   \n\t"
+        "movq      %%xmm2, (%[p1],%[stride],2) \n\t"
+        :: [p1] "r"(p1), [q1] "r"(pix + stride), [stride] "r"((x86_reg)stride),
+           [par] "r"(par), [pw_4] "m"(ff_pw_4)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5",
+                       "%xmm7",) "memory");
+}
+
+static void hevc_v_loop_filter_chroma_8_sse2(uint8_t *pix, ptrdiff_t stride,
+                                             int *tc, uint8_t *no_p,
+                                             uint8_t *no_q)
+{
+    DECLARE_ALIGNED(16, int16_t, par)[3][8];
+    x86_reg tmp;
+
+    chroma_deblock_params(par, tc, no_p, no_q);
+
+    /* transpose the 4 pixels around the edge of 8 rows into p1, p0, q0, q1,
+     * and write p0 and q0 back 2 bytes per row */
+    __asm__ volatile(
+        "movd      -2(%[row0]),             %%xmm0 \n\t"
+        "movd      -2(%[row0],%[stride]),   %%xmm1 \n\t"
+        "movd      -2(%[row0],%[stride],2), %%xmm2 \n\t"
+        "movd      -2(%[row0],%[stride3]),  %%xmm3 \n\t"
+        "movd      -2(%[row4]),             %%xmm4 \n\t"
+        "movd      -2(%[row4],%[stride]),   %%xmm5 \n\t"
+        "movd      -2(%[row4],%[stride],2), %%xmm6 \n\t"
+        "movd      -2(%[row4],%[stride3]),  %%xmm7 \n\t"
+        "punpcklbw %%xmm1, %%xmm0       \n\t"
+        "punpcklbw %%xmm3, %%xmm2       \n\t"
+        "punpcklbw %%xmm5, %%xmm4       \n\t"
+        "punpcklbw %%xmm7, %%xmm6       \n\t"
+        "punpcklwd %%xmm2, %%xmm0       \n\t"
+        "punpcklwd %%xmm6, %%xmm4       \n\t"
+        "movdqa    %%xmm0, %%xmm2       \n\t"
+        "punpckldq %%xmm4, %%xmm0       \n\t"
+        "punpckhdq %%xmm4, %%xmm2       \n\t"
+        "pxor      %%xmm7, %%xmm7       \n\t"
+        "movdqa    %%xmm0, %%xmm1       \n\t"
+        "movdqa    %%xmm2, %%xmm3       \n\t"
+        "punpcklbw %%xmm7, %%xmm0       \n\t"
+        "punpckhbw %%xmm7, %%xmm1       \n\t"
+        "punpcklbw %%xmm7, %%xmm2       \n\t"
+        "punpckhbw %%xmm7, %%xmm3       \n\t"
+        CHROMA_DEBLOCK
+        "packuswb  %%xmm1, %%xmm1       \n\t"
+        "packuswb  %%xmm2, %%xmm2       \n\t"
+        "punpcklbw %%xmm2, %%xmm1       \n\t"
+#define STORE_ROW(i, addr)                                                  \
+        "pextrw    $"#i", %%xmm1, %k[tmp] \n\t"                             \
+        "mov       %w[tmp], -1"addr"    \n\t"
+        STORE_ROW(0, "(%[row0])")
+        STORE_ROW(1, "(%[row0],%[stride])")
+        STORE_ROW(2, "(%[row0],%[stride],2)")
+        STORE_ROW(3, "(%[row0],%[stride3])")
+        STORE_ROW(4, "(%[row4])")
+        STORE_ROW(5, "(%[row4],%[stride])")
+        STORE_ROW(6, "(%[row4],%[stride],2)")
+        STORE_ROW(7, "(%[row4],%[stride3])")
+#undef STORE_ROW
+        : [tmp] "=&r"(tmp)
+        : [row0] "r"(pix), [row4] "r"(pix + 4 * stride),
+          [stride] "r"((x86_reg)stride), [stride3] "r"((x86_reg)(3 * stride)),
+          [par] "r"(par), [pw_4] "m"(ff_pw_4)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5",
+                       "%xmm6", "%xmm7",) "memory");
+}
+
+#endif /* HAVE_SSE2_INLINE */
+
+av_cold void ff_hevc_dsp_init_x86(HEVCDSPContext *c, const int bit_depth)
+{
+#if HAVE_SSE2_INLINE
+    int cpu_flags = av_get_cpu_flags();
+
+    if (INLINE_SSE2(cpu_flags) && bit_depth == 8) {
+        c->put_hevc_qpel[0][0] = put_hevc_qpel_pixels_8_sse2;
+        c->put_hevc_qpel[0][1] = put_hevc_qpel_h1_8_sse2;
+        c->put_hevc_qpel[0][2] = put_hevc_qpel_h2_8_sse2;
+        c->put_hevc_qpel[0][3] = put_hevc_qpel_h3_8_sse2;
+        c->put_hevc_qpel[1][0] = put_hevc_qpel_v1_8_sse2;
+        c->put_hevc_qpel[1][1] = put_hevc_qpel_h1v1_8_sse2;
+        c->put_hevc_qpel[1][2] = put_hevc_qpel_h2v1_8_sse2;
+        c->put_hevc_qpel[1][3] = put_hevc_qpel_h3v1_8_sse2;
+        c->put_hevc_qpel[2][0] = put_hevc_qpel_v2_8_sse2;
+        c->put_hevc_qpel[2][1] = put_hevc_qpel_h1v2_8_sse2;
+        c->put_hevc_qpel[2][2] = put_hevc_qpel_h2v2_8_sse2;
+        c->put_hevc_qpel[2][3] = put_hevc_qpel_h3v2_8_sse2;
+        c->put_hevc_qpel[3][0] = put_hevc_qpel_v3_8_sse2;
+        c->put_hevc_qpel[3][1] = put_hevc_qpel_h1v3_8_sse2;
+        c->put_hevc_qpel[3][2] = put_hevc_qpel_h2v3_8_sse2;
+        c->put_hevc_qpel[3][3] = put_hevc_qpel_h3v3_8_sse2;
+
+        c->put_hevc_epel[0][0] = put_hevc_epel_pixels_8_sse2;
+        c->put_hevc_epel[0][1] = put_hevc_epel_h_8_sse2;
+        c->put_hevc_epel[1][0] = put_hevc_epel_v_8_sse2;
+        c->put_hevc_epel[1][1] = put_hevc_epel_hv_8_sse2;
+
+        c->put_unweighted_pred   = put_unweighted_pred_8_sse2;
+        c->put_weighted_pred_avg = put_weighted_pred_avg_8_sse2;
+
+        c->hevc_h_loop_filter_chroma = hevc_h_loop_filter_chroma_8_sse2;
+        c->hevc_v_loop_filter_chroma = hevc_v_loop_filter_chroma_8_sse2;
+    }
+    if (INLINE_SSE2(cpu_flags) && bit_depth == 10) {
+        c->put_hevc_qpel[0][0] = put_hevc_qpel_pixels_10_sse2;
+        c->put_hevc_epel[0][0] = put_hevc_epel_pixels_10_sse2;
+
+        c->put_unweighted_pred   = put_unweighted_pred_10_sse2;
+        c->put_weighted_pred_avg = put_weighted_pred_avg_10_sse2;
+    }
+#endif /* HAVE_SSE2_INLINE */
+}
@@ -0,0 +1,117 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stddef.h>
+
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "libavutil/intmath.h"
+#include "libavutil/x86/asm.h"
+#include "libavutil/x86/cpu.h"
+#include "libavcodec/startcode.h"
+
+/*
+ * Each iteration compares three overlapping loads at i, i + 1 and i + 2
+ * against 00, 00 and 01, so the loop only stops at a complete prefix.
+ * A block is only searched if a prefix starting in it is followed by at
+ * least one byte within size; the rest is left to the scalar loop.
+ */
+
+#if HAVE_SSE2_INLINE
+static int find_prefix_sse2(const uint8_t *buf, int size)
+{
+    x86_reg i = 0;
+    int mask = 0;
+
+    if (size >= 19) {
+        __asm__ volatile(
+            "pxor      %%xmm7,   %%xmm7     \n\t"
+            "pcmpeqb   %%xmm5,   %%xmm5     \n\t"
+            "pxor      %%xmm6,   %%xmm6     \n\t"
+            "psubb     %%xmm5,   %%xmm6     \n\t"
+            "1:                             \n\t"
+            "movdqu    (%2,%0),  %%xmm0     \n\t"
+            "movdqu   1(%2,%0),  %%xmm1     \n\t"
+            "movdqu   2(%2,%0),  %%xmm2     \n\t"
+            "pcmpeqb   %%xmm7,   %%xmm0     \n\t"
+            "pcmpeqb   %%xmm7,   %%xmm1     \n\t"
+            "pcmpeqb   %%xmm6,   %%xmm2     \n\t"
+            "pand      %%xmm1,   %%xmm0     \n\t"
+            "pand      %%xmm2,   %%xmm0     \n\t"
+            "pmovmskb  %%xmm0,   %1         \n\t"
+            "test      %1,       %1         \n\t"
+            "jnz       2f                   \n\t"
+            "add       $16,      %0         \n\t"
+            "cmp       %3,       %0         \n\t"
+            "jle       1b                   \n\t"
+            "2:                             \n\t"
+            : "+r"(i), "+r"(mask)
+            : "r"(buf), "r"((x86_reg)size - 19)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2",
+                           "%xmm5", "%xmm6", "%xmm7",) "memory");
+    }
+    return mask ? i + ff_ctz(mask) : i;
+}
+#endif /* HAVE_SSE2_INLINE */
+
+#if HAVE_AVX2_INLINE
+static int find_prefix_avx2(const uint8_t *buf, int size)
+{
+    x86_reg i = 0;
+    int mask = 0;
+
+    if (size >= 35) {
+        __asm__ volatile(
+            "vpxor     %%ymm7,   %%ymm7, %%ymm7 \n\t"
+            "vpcmpeqb  %%ymm5,   %%ymm5, %%ymm5 \n\t"
+            "vpsubb    %%ymm5,   %%ymm7, %%ymm6 \n\t"
+            "1:                                 \n\t"
+            "vpcmpeqb  (%2,%0),  %%ymm7, %%ymm0 \n\t"
+            "vpcmpeqb 1(%2,%0),  %%ymm7, %%ymm1 \n\t"
+            "vpcmpeqb 2(%2,%0),  %%ymm6, %%ymm2 \n\t"
+            "vpand     %%ymm1,   %%ymm0, %%ymm0 \n\t"
+            "vpand     %%ymm2,   %%ymm0, %%ymm0 \n\t"
+            "vpmovmskb %%ymm0,   %1             \n\t"
+            "test      %1,       %1             \n\t"
+            "jnz       2f                       \n\t"
+            "add       $32,      %0             \n\t"
+            "cmp       %3,       %0             \n\t"
+            "jle       1b                       \n\t"
+            "2:                                 \n\t"
+            "vzeroupper                         \n\t"
+            : "+r"(i), "+r"(mask)
+            : "r"(buf), "r"((x86_reg)size - 35)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2",
+                           "%xmm5", "%xmm6", "%xmm7",) "memory");
+    }
+    return mask ? i + ff_ctz(mask) : i;
+}
+#endif /* HAVE_AVX2_INLINE */
+
+av_cold startcode_find_prefix_func ff_startcode_find_prefix_x86(int cpu_flags)
+{
+#if HAVE_AVX2_INLINE
+    if (INLINE_AVX2(cpu_flags))
+        return find_prefix_avx2;
+#endif
+#if HAVE_SSE2_INLINE
+    if (INLINE_SSE2(cpu_flags))
+        return find_prefix_sse2;
+#endif
+    return NULL;
+}
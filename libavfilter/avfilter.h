@@ -860,6 +860,12 @@ struct AVFilterLink {
      * Number of past frames sent through the link.
      */
     int64_t frame_count;
+
+    /**
+     * Pool of buffers used by the default video buffer allocator.
+     * Private to the framework.
+     */
+    void *video_frame_pool;
 };
 
 /**
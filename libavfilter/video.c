@@ -27,6 +27,7 @@
 #include "libavutil/buffer.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/mem.h"
+#include "libavutil/pixdesc.h"
 
 #include "avfilter.h"
 #include "internal.h"
@@ -37,9 +38,108 @@ AVFrame *ff_null_get_video_buffer(AVFilterLink *link, int w, int h)
     return ff_get_video_buffer(link->dst->outputs[0], w, h);
 }
 
-/* TODO: set the buffer's priv member to a context structure for the whole
- * filter chain.  This will allow for a buffer pool instead of the constant
- * alloc & free cycle currently implemented. */
+#define POOL_ALIGN 32
+
+/**
+ * Pool of plane buffers for the default video allocator of one link.
+ * It is keyed by the frame geometry, so that steady-state filtering reuses
+ * the same buffers instead of allocating a new picture for every frame.
+ */
+typedef struct VideoFramePool {
+    int width;
+    int height;
+    enum AVPixelFormat format;
+    int linesize[4];
+    int plane_size[4];
+    AVBufferPool *pools[4];
+} VideoFramePool;
+
+void ff_video_frame_pool_uninit(void **ppool)
+{
+    VideoFramePool *pool = *ppool;
+    int i;
+
+    if (!pool)
+        return;
+    for (i = 0; i < 4; i++)
+        av_buffer_pool_uninit(&pool->pools[i]);
+    av_freep(ppool);
+}
+
+static int video_frame_pool_init(VideoFramePool *pool, int w, int h,
+                                 enum AVPixelFormat format)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    int i, ret;
+
+    for (i = 0; i < 4; i++)
+        av_buffer_pool_uninit(&pool->pools[i]);
+    memset(pool, 0, sizeof(*pool));
+
+    if (!desc || desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL |
+                                AV_PIX_FMT_FLAG_PSEUDOPAL))
+        return AVERROR(ENOSYS);
+    if ((ret = av_image_check_size(w, h, 0, NULL)) < 0)
+        return ret;
+
+    /* same layout as av_frame_get_buffer() */
+    for (i = 1; i <= POOL_ALIGN; i += i) {
+        ret = av_image_fill_linesizes(pool->linesize, format, FFALIGN(w, i));
+        if (ret < 0)
+            return ret;
+        if (!(pool->linesize[0] & (POOL_ALIGN - 1)))
+            break;
+    }
+
+    for (i = 0; i < 4 && pool->linesize[i]; i++) {
+        int ph = FFALIGN(h, 32);
+        if (i == 1 || i == 2)
+            ph = FF_CEIL_RSHIFT(ph, desc->log2_chroma_h);
+        pool->linesize[i]   = FFALIGN(pool->linesize[i], POOL_ALIGN);
+        pool->plane_size[i] = pool->linesize[i] * ph + 16 + 16 - 1;
+        pool->pools[i]      = av_buffer_pool_init(pool->plane_size[i], NULL);
+        if (!pool->pools[i])
+            return AVERROR(ENOMEM);
+    }
+
+    pool->width  = w;
+    pool->height = h;
+    pool->format = format;
+    return 0;
+}
+
+static int video_frame_pool_get(AVFilterLink *link, AVFrame *frame)
+{
+    VideoFramePool *pool = link->video_frame_pool;
+    int i, ret;
+
+    if (!pool) {
+        if (!(pool = av_mallocz(sizeof(*pool))))
+            return AVERROR(ENOMEM);
+        link->video_frame_pool = pool;
+    }
+
+    if (!pool->pools[0] || pool->width  != frame->width ||
+        pool->height != frame->height || pool->format != frame->format) {
+        if ((ret = video_frame_pool_init(pool, frame->width, frame->height,
+                                         frame->format)) < 0)
+            return ret;
+    }
+
+    for (i = 0; i < 4 && pool->pools[i]; i++) {
+        frame->buf[i] = av_buffer_pool_get(pool->pools[i]);
+        if (!frame->buf[i]) {
+            av_frame_unref(frame);
+            return AVERROR(ENOMEM);
+        }
+        frame->data[i]     = frame->buf[i]->data;
+        frame->linesize[i] = pool->linesize[i];
+    }
+    frame->extended_data = frame->data;
+
+    return 0;
+}
+
 AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
 {
     AVFrame *frame = av_frame_alloc();
@@ -52,7 +152,9 @@ AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
     frame->height = h;
     frame->format = link->format;
 
-    ret = av_frame_get_buffer(frame, 32);
+    ret = video_frame_pool_get(link, frame);
+    if (ret < 0)
+        ret = av_frame_get_buffer(frame, POOL_ALIGN);
     if (ret < 0)
         av_frame_free(&frame);
 
@@ -26,6 +26,12 @@
 AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h);
 AVFrame *ff_null_get_video_buffer(AVFilterLink *link, int w, int h);
 
+/**
+ * Free the buffer pool used by ff_default_get_video_buffer() on a link.
+ * Buffers still referenced by frames stay valid until they are released.
+ */
+void ff_video_frame_pool_uninit(void **pool);
+
 /**
  * Request a picture buffer with a specific set of permissions.
  *
@@ -0,0 +1,80 @@
+/*
+ * ADTS and LATM/LOAS header writing, shared by the muxers that frame raw AAC
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_AACENC_H
+#define AVFORMAT_AACENC_H
+
+#include <stdint.h>
+
+#include "libavcodec/mpeg4audio.h"
+#include "libavcodec/put_bits.h"
+
+#define ADTS_HEADER_SIZE 7
+#define ADTS_MAX_FRAME_BYTES ((1 << 13) - 1)
+
+#define LATM_MAX_FRAME_BYTES 0x1fff
+#define LATM_MAX_EXTRADATA_SIZE 1024
+
+typedef struct ADTSConfig {
+    int objecttype;         ///< MPEG-4 audio object type - 1
+    int sample_rate_index;
+    int channel_conf;
+    int pce_size;           ///< size of the PCE to send after the next header
+    uint8_t pce_data[MAX_PCE_SIZE];
+} ADTSConfig;
+
+typedef struct LATMConfig {
+    int off;                ///< size in bits of the AudioSpecificConfig
+    int channel_conf;
+    int object_type;
+} LATMConfig;
+
+/**
+ * Parse an AudioSpecificConfig and check that it can be signalled in ADTS.
+ * A program_config_element found in it is stored in adts->pce_data.
+ */
+int ff_adts_decode_extradata(void *logctx, ADTSConfig *adts,
+                             const uint8_t *buf, int size);
+
+/**
+ * Write the 7 byte ADTS header of a raw AAC frame of the given size,
+ * followed by pce_size bytes of PCE.
+ */
+int ff_adts_write_frame_header(void *logctx, const ADTSConfig *adts,
+                               uint8_t *buf, int size, int pce_size);
+
+/**
+ * Parse an AudioSpecificConfig and check that it can be carried in LATM.
+ */
+int ff_latm_decode_extradata(void *logctx, LATMConfig *latm,
+                             const uint8_t *buf, int size);
+
+/**
+ * Write the StreamMuxConfig of an AudioMuxElement with muxConfigPresent.
+ */
+void ff_latm_write_stream_mux_config(PutBitContext *pb, const LATMConfig *latm,
+                                     const uint8_t *extradata, int extradata_size);
+
+/**
+ * Write the PayloadLengthInfo and PayloadMux of one raw AAC frame.
+ */
+void ff_latm_write_payload(PutBitContext *pb, const uint8_t *data, int size);
+
+#endif /* AVFORMAT_AACENC_H */
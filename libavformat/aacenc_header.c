@@ -0,0 +1,205 @@
+/*
+ * ADTS and LATM/LOAS header writing, shared by the muxers that frame raw AAC
+ * Copyright (c) 2006 Baptiste Coudurier <baptiste.coudurier@smartjog.com>
+ *                    Mans Rullgard <mans@mansr.com>
+ * Copyright (c) 2011 Kieran Kunhya <kieran@kunhya.com>
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavcodec/get_bits.h"
+#include "libavcodec/put_bits.h"
+#include "libavcodec/mpeg4audio.h"
+#include "libavutil/log.h"
+#include "aacenc.h"
+
+int ff_adts_decode_extradata(void *logctx, ADTSConfig *adts,
+                             const uint8_t *buf, int size)
+{
+    GetBitContext gb;
+    PutBitContext pb;
+    MPEG4AudioConfig m4ac;
+    int off;
+
+    init_get_bits(&gb, buf, size * 8);
+    off = avpriv_mpeg4audio_get_config(&m4ac, buf, size * 8, 1);
+    if (off < 0)
+        return off;
+    skip_bits_long(&gb, off);
+    adts->objecttype        = m4ac.object_type - 1;
+    adts->sample_rate_index = m4ac.sampling_index;
+    adts->channel_conf      = m4ac.chan_config;
+
+    if (adts->objecttype > 3U) {
+        av_log(logctx, AV_LOG_ERROR, "MPEG-4 AOT %d is not allowed in ADTS\n", adts->objecttype+1);
+        return AVERROR_INVALIDDATA;
+    }
+    if (adts->sample_rate_index == 15) {
+        av_log(logctx, AV_LOG_ERROR, "Escape sample rate index illegal in ADTS\n");
+        return AVERROR_INVALIDDATA;
+    }
+    if (get_bits(&gb, 1)) {
+        av_log(logctx, AV_LOG_ERROR, "960/120 MDCT window is not allowed in ADTS\n");
+        return AVERROR_INVALIDDATA;
+    }
+    if (get_bits(&gb, 1)) {
+        av_log(logctx, AV_LOG_ERROR, "Scalable configurations are not allowed in ADTS\n");
+        return AVERROR_INVALIDDATA;
+    }
+    if (get_bits(&gb, 1)) {
+        av_log(logctx, AV_LOG_ERROR, "Extension flag is not allowed in ADTS\n");
+        return AVERROR_INVALIDDATA;
+    }
+    if (!adts->channel_conf) {
+        init_put_bits(&pb, adts->pce_data, MAX_PCE_SIZE);
+
+        put_bits(&pb, 3, 5); //ID_PCE
+        adts->pce_size = (avpriv_copy_pce_data(&pb, &gb) + 3) / 8;
+        flush_put_bits(&pb);
+    }
+
+    return 0;
+}
+
+int ff_adts_write_frame_header(void *logctx, const ADTSConfig *adts,
+                               uint8_t *buf, int size, int pce_size)
+{
+    PutBitContext pb;
+
+    unsigned full_frame_size = (unsigned)ADTS_HEADER_SIZE + size + pce_size;
+    if (full_frame_size > ADTS_MAX_FRAME_BYTES) {
+        av_log(logctx, AV_LOG_ERROR, "ADTS frame size too large: %u (max %d)\n",
+               full_frame_size, ADTS_MAX_FRAME_BYTES);
+        return AVERROR_INVALIDDATA;
+    }
+
+    init_put_bits(&pb, buf, ADTS_HEADER_SIZE);
+
+    /* adts_fixed_header */
+    put_bits(&pb, 12, 0xfff);   /* syncword */
+    put_bits(&pb, 1, 0);        /* ID */
+    put_bits(&pb, 2, 0);        /* layer */
+    put_bits(&pb, 1, 1);        /* protection_absent */
+    put_bits(&pb, 2, adts->objecttype); /* profile_objecttype */
+    put_bits(&pb, 4, adts->sample_rate_index);
+    put_bits(&pb, 1, 0);        /* private_bit */
+    put_bits(&pb, 3, adts->channel_conf); /* channel_configuration */
+    put_bits(&pb, 1, 0);        /* original_copy */
+    put_bits(&pb, 1, 0);        /* home */
+
+    /* adts_variable_header */
+    put_bits(&pb, 1, 0);        /* copyright_identification_bit */
+    put_bits(&pb, 1, 0);        /* copyright_identification_start */
+    put_bits(&pb, 13, full_frame_size); /* aac_frame_length */
+    put_bits(&pb, 11, 0x7ff);   /* adts_buffer_fullness */
+    put_bits(&pb, 2, 0);        /* number_of_raw_data_blocks_in_frame */
+
+    flush_put_bits(&pb);
+
+    return 0;
+}
+
+int ff_latm_decode_extradata(void *logctx, LATMConfig *latm,
+                             const uint8_t *buf, int size)
+{
+    MPEG4AudioConfig m4ac;
+
+    if (size > LATM_MAX_EXTRADATA_SIZE) {
+        av_log(logctx, AV_LOG_ERROR, "Extradata is larger than currently supported.\n");
+        return AVERROR_INVALIDDATA;
+    }
+    latm->off = avpriv_mpeg4audio_get_config(&m4ac, buf, size * 8, 1);
+    if (latm->off < 0)
+        return latm->off;
+
+    if (m4ac.object_type == AOT_ALS && (latm->off & 7)) {
+        // as long as avpriv_mpeg4audio_get_config works correctly this is impossible
+        av_log(logctx, AV_LOG_ERROR, "BUG: ALS offset is not byte-aligned\n");
+        return AVERROR_INVALIDDATA;
+    }
+    /* FIXME: are any formats not allowed in LATM? */
+
+    if (m4ac.object_type > AOT_SBR && m4ac.object_type != AOT_ALS) {
+        av_log(logctx, AV_LOG_ERROR, "Muxing MPEG-4 AOT %d in LATM is not supported\n", m4ac.object_type);
+        return AVERROR_INVALIDDATA;
+    }
+    latm->channel_conf = m4ac.chan_config;
+    latm->object_type  = m4ac.object_type;
+
+    return 0;
+}
+
+void ff_latm_write_stream_mux_config(PutBitContext *bs, const LATMConfig *latm,
+                                     const uint8_t *extradata, int extradata_size)
+{
+    put_bits(bs, 1, 0); /* audioMuxVersion */
+    put_bits(bs, 1, 1); /* allStreamsSameTimeFraming */
+    put_bits(bs, 6, 0); /* numSubFrames */
+    put_bits(bs, 4, 0); /* numProgram */
+    put_bits(bs, 3, 0); /* numLayer */
+
+    /* AudioSpecificConfig */
+    if (latm->object_type == AOT_ALS) {
+        int header_size = extradata_size - (latm->off >> 3);
+        avpriv_copy_bits(bs, &extradata[latm->off >> 3], header_size);
+    } else {
+        // + 3 assumes not scalable and dependsOnCoreCoder == 0,
+        // see decode_ga_specific_config in libavcodec/aacdec.c
+        avpriv_copy_bits(bs, extradata, latm->off + 3);
+
+        if (!latm->channel_conf) {
+            GetBitContext gb;
+            init_get_bits8(&gb, extradata, extradata_size);
+            skip_bits_long(&gb, latm->off + 3);
+            avpriv_copy_pce_data(bs, &gb);
+        }
+    }
+
+    put_bits(bs, 3, 0); /* frameLengthType */
+    put_bits(bs, 8, 0xff); /* latmBufferFullness */
+
+    put_bits(bs, 1, 0); /* otherDataPresent */
+    put_bits(bs, 1, 0); /* crcCheckPresent */
+}
+
+void ff_latm_write_payload(PutBitContext *bs, const uint8_t *data, int size)
+{
+    int i;
+
+    /* PayloadLengthInfo() */
+    for (i = 0; i <= size-255; i+=255)
+        put_bits(bs, 8, 255);
+
+    put_bits(bs, 8, size-i);
+
+    /* The LATM payload is written unaligned */
+
+    /* PayloadMux() */
+    if (size && (data[0] & 0xe1) == 0x81) {
+        // Convert byte-aligned DSE to non-aligned.
+        // Due to the input format encoding we know that
+        // it is naturally byte-aligned in the input stream,
+        // so there are no padding bits to account for.
+        // To avoid having to add padding bits and rearrange
+        // the whole stream we just remove the byte-align flag.
+        // This allows us to remux our FATE AAC samples into latm
+        // files that are still playable with minimal effort.
+        put_bits(bs, 8, data[0] & 0xfe);
+        avpriv_copy_bits(bs, data + 1, 8*size - 8);
+    } else
+        avpriv_copy_bits(bs, data, 8*size);
+}
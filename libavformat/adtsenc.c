@@ -25,120 +25,28 @@
 #include "libavcodec/avcodec.h"
 #include "libavcodec/mpeg4audio.h"
 #include "libavutil/opt.h"
+#include "aacenc.h"
 #include "avformat.h"
 #include "apetag.h"
 
-#define ADTS_HEADER_SIZE 7
-
 typedef struct {
     AVClass *class;
+    ADTSConfig cfg;
     int write_adts;
-    int objecttype;
-    int sample_rate_index;
-    int channel_conf;
-    int pce_size;
     int apetag;
-    uint8_t pce_data[MAX_PCE_SIZE];
 } ADTSContext;
 
-#define ADTS_MAX_FRAME_BYTES ((1 << 13) - 1)
-
-static int adts_decode_extradata(AVFormatContext *s, ADTSContext *adts, uint8_t *buf, int size)
-{
-    GetBitContext gb;
-    PutBitContext pb;
-    MPEG4AudioConfig m4ac;
-    int off;
-
-    init_get_bits(&gb, buf, size * 8);
-    off = avpriv_mpeg4audio_get_config(&m4ac, buf, size * 8, 1);
-    if (off < 0)
-        return off;
-    skip_bits_long(&gb, off);
-    adts->objecttype        = m4ac.object_type - 1;
-    adts->sample_rate_index = m4ac.sampling_index;
-    adts->channel_conf      = m4ac.chan_config;
-
-    if (adts->objecttype > 3U) {
-        av_log(s, AV_LOG_ERROR, "MPEG-4 AOT %d is not allowed in ADTS\n", adts->objecttype+1);
-        return -1;
-    }
-    if (adts->sample_rate_index == 15) {
-        av_log(s, AV_LOG_ERROR, "Escape sample rate index illegal in ADTS\n");
-        return -1;
-    }
-    if (get_bits(&gb, 1)) {
-        av_log(s, AV_LOG_ERROR, "960/120 MDCT window is not allowed in ADTS\n");
-        return -1;
-    }
-    if (get_bits(&gb, 1)) {
-        av_log(s, AV_LOG_ERROR, "Scalable configurations are not allowed in ADTS\n");
-        return -1;
-    }
-    if (get_bits(&gb, 1)) {
-        av_log(s, AV_LOG_ERROR, "Extension flag is not allowed in ADTS\n");
-        return -1;
-    }
-    if (!adts->channel_conf) {
-        init_put_bits(&pb, adts->pce_data, MAX_PCE_SIZE);
-
-        put_bits(&pb, 3, 5); //ID_PCE
-        adts->pce_size = (avpriv_copy_pce_data(&pb, &gb) + 3) / 8;
-        flush_put_bits(&pb);
-    }
-
-    adts->write_adts = 1;
-
-    return 0;
-}
-
 static int adts_write_header(AVFormatContext *s)
 {
     ADTSContext *adts = s->priv_data;
     AVCodecContext *avc = s->streams[0]->codec;
 
-    if (avc->extradata_size > 0 &&
-            adts_decode_extradata(s, adts, avc->extradata, avc->extradata_size) < 0)
-        return -1;
-
-    return 0;
-}
-
-static int adts_write_frame_header(ADTSContext *ctx,
-                                   uint8_t *buf, int size, int pce_size)
-{
-    PutBitContext pb;
-
-    unsigned full_frame_size = (unsigned)ADTS_HEADER_SIZE + size + pce_size;
-    if (full_frame_size > ADTS_MAX_FRAME_BYTES) {
-        av_log(NULL, AV_LOG_ERROR, "ADTS frame size too large: %u (max %d)\n",
-               full_frame_size, ADTS_MAX_FRAME_BYTES);
-        return AVERROR_INVALIDDATA;
+    if (avc->extradata_size > 0) {
+        if (ff_adts_decode_extradata(s, &adts->cfg, avc->extradata, avc->extradata_size) < 0)
+            return -1;
+        adts->write_adts = 1;
     }
 
-    init_put_bits(&pb, buf, ADTS_HEADER_SIZE);
-
-    /* adts_fixed_header */
-    put_bits(&pb, 12, 0xfff);   /* syncword */
-    put_bits(&pb, 1, 0);        /* ID */
-    put_bits(&pb, 2, 0);        /* layer */
-    put_bits(&pb, 1, 1);        /* protection_absent */
-    put_bits(&pb, 2, ctx->objecttype); /* profile_objecttype */
-    put_bits(&pb, 4, ctx->sample_rate_index);
-    put_bits(&pb, 1, 0);        /* private_bit */
-    put_bits(&pb, 3, ctx->channel_conf); /* channel_configuration */
-    put_bits(&pb, 1, 0);        /* original_copy */
-    put_bits(&pb, 1, 0);        /* home */
-
-    /* adts_variable_header */
-    put_bits(&pb, 1, 0);        /* copyright_identification_bit */
-    put_bits(&pb, 1, 0);        /* copyright_identification_start */
-    put_bits(&pb, 13, full_frame_size); /* aac_frame_length */
-    put_bits(&pb, 11, 0x7ff);   /* adts_buffer_fullness */
-    put_bits(&pb, 2, 0);        /* number_of_raw_data_blocks_in_frame */
-
-    flush_put_bits(&pb);
-
     return 0;
 }
 
@@ -151,14 +59,14 @@ static int adts_write_packet(AVFormatContext *s, AVPacket *pkt)
     if (!pkt->size)
         return 0;
     if (adts->write_adts) {
-        int err = adts_write_frame_header(adts, buf, pkt->size,
-                                             adts->pce_size);
+        int err = ff_adts_write_frame_header(s, &adts->cfg, buf, pkt->size,
+                                             adts->cfg.pce_size);
         if (err < 0)
             return err;
         avio_write(pb, buf, ADTS_HEADER_SIZE);
-        if (adts->pce_size) {
-            avio_write(pb, adts->pce_data, adts->pce_size);
-            adts->pce_size = 0;
+        if (adts->cfg.pce_size) {
+            avio_write(pb, adts->cfg.pce_data, adts->cfg.pce_size);
+            adts->cfg.pce_size = 0;
         }
     }
     avio_write(pb, pkt->data, pkt->size);
@@ -0,0 +1,136 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Annex B to length prefixed NAL unit conversion test: compares
+ * ff_avc_parse_nal_units() against a byte by byte conversion, on fixed
+ * buffers for the handling of the end of the input and on random ones.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/intreadwrite.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "avc.h"
+#include "avio.h"
+
+#define MAX_SIZE 1024
+#define NB_ITS   20000
+
+static AVLFG prng;
+
+/* A NAL unit starts after a 00 00 01 prefix that is followed by at least
+ * one byte and ends at the next such prefix, less one zero byte, or at the
+ * end of the buffer; a prefix in the last 3 bytes is part of the last NAL
+ * unit. Bytes before the first prefix are dropped. */
+static int parse_nal_units_ref(const uint8_t *buf, int size, uint8_t *out)
+{
+    int i, nal_start = -1, out_size = 0;
+
+    for (i = 0; i <= size; i++) {
+        int prefix = i + 3 < size && !buf[i] && !buf[i + 1] && buf[i + 2] == 1;
+        int nal_end = i;
+
+        if (!prefix && i < size)
+            continue;
+        if (nal_start >= 0) {
+            if (prefix && nal_end > nal_start && !buf[nal_end - 1])
+                nal_end--;
+            AV_WB32(out + out_size, nal_end - nal_start);
+            memcpy(out + out_size + 4, buf + nal_start, nal_end - nal_start);
+            out_size += 4 + nal_end - nal_start;
+        }
+        nal_start = i + 3;
+        i += 2;
+    }
+    return out_size;
+}
+
+static int test(const uint8_t *buf, int size)
+{
+    static uint8_t out_ref[MAX_SIZE * 4];
+    AVIOContext *pb;
+    uint8_t *out;
+    int ret, out_size, ref_size = parse_nal_units_ref(buf, size, out_ref);
+
+    if ((ret = avio_open_dyn_buf(&pb)) < 0)
+        return ret;
+    ret      = ff_avc_parse_nal_units(pb, buf, size);
+    out_size = avio_close_dyn_buf(pb, &out);
+
+    if (ret != ref_size || out_size != ref_size ||
+        memcmp(out, out_ref, ref_size)) {
+        int i;
+        printf("error: size %d: got %d/%d bytes, expected %d, input", size,
+               ret, out_size, ref_size);
+        for (i = 0; i < FFMIN(size, 32); i++)
+            printf(" %02x", buf[i]);
+        printf("\n");
+        ret = 1;
+    } else
+        ret = 0;
+    av_free(out);
+    return ret;
+}
+
+int main(void)
+{
+    static const uint8_t fixed[][12] = {
+        /* prefix in the last 3 bytes, with and without a 4th zero */
+        { 0, 0, 1, 0x65, 0xaa, 0, 0, 1 },
+        { 0, 0, 1, 0x65, 0xaa, 0, 0, 0, 1 },
+        /* prefix followed by one byte */
+        { 0, 0, 1, 0x65, 0xaa, 0, 0, 1, 0x41 },
+        { 0, 0, 0, 1, 0x65, 0xaa, 0, 0, 0, 1, 0x41 },
+        /* trailing zeros */
+        { 0, 0, 0, 1, 0x65, 0xaa, 0 },
+        { 0, 0, 1, 0x65, 0, 0, 0, 0, 0 },
+        /* only prefixes */
+        { 0, 0, 1 },
+        { 0, 0, 1, 0, 0, 1 },
+        { 0, 0, 1, 0, 0, 1, 0, 0, 1 },
+        /* no prefix, or data before it */
+        { 0x65, 0xaa, 0, 0, 2, 0 },
+        { 0x65, 0, 0, 1, 0x41, 0, 0, 1 },
+    };
+    static const int fixed_sizes[] = { 8, 9, 9, 11, 7, 9, 3, 6, 9, 6, 8 };
+    uint8_t buf[MAX_SIZE];
+    int i, it, err = 0;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(fixed); i++)
+        err |= test(fixed[i], fixed_sizes[i]);
+
+    av_lfg_init(&prng, 1);
+    for (it = 0; it < NB_ITS && !err; it++) {
+        int size = av_lfg_get(&prng) % (it < NB_ITS / 2 ? 24 : MAX_SIZE);
+
+        /* zeros and ones are frequent enough for dense start codes */
+        for (i = 0; i < size; i++) {
+            unsigned r = av_lfg_get(&prng);
+            buf[i] = r % 4 == 0 ? 0 : r % 4 == 1 ? 1 : r >> 8;
+        }
+        err |= test(buf, size);
+    }
+
+    if (!err)
+        printf("avc: all tests passed\n");
+    return err;
+}
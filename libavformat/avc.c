@@ -20,6 +20,7 @@
  */
 
 #include "libavutil/intreadwrite.h"
+#include "libavcodec/internal.h"
 #include "avformat.h"
 #include "avio.h"
 #include "avc.h"
@@ -67,26 +68,42 @@ const uint8_t *ff_avc_find_startcode(const uint8_t *p, const uint8_t *end){
     return out;
 }
 
+static int write_nal_unit(AVIOContext *pb, const uint8_t *nal, int size)
+{
+    avio_wb32(pb, size);
+    avio_write(pb, nal, size);
+    return 4 + size;
+}
+
 int ff_avc_parse_nal_units(AVIOContext *pb, const uint8_t *buf_in, int size)
 {
-    const uint8_t *p = buf_in;
-    const uint8_t *end = p + size;
-    const uint8_t *nal_start, *nal_end;
-
-    size = 0;
-    nal_start = ff_avc_find_startcode(p, end);
-    for (;;) {
-        while (nal_start < end && !*(nal_start++));
-        if (nal_start == end)
-            break;
-
-        nal_end = ff_avc_find_startcode(nal_start, end);
-        avio_wb32(pb, nal_end - nal_start);
-        avio_write(pb, nal_start, nal_end - nal_start);
-        size += 4 + nal_end - nal_start;
-        nal_start = nal_end;
-    }
-    return size;
+    int offsets[64];
+    int nb_offsets, i, pos = 0, nal_start = -1, out_size = 0;
+
+    /* Each NAL unit runs from the byte after its 00 00 01 prefix up to the
+     * next prefix, less one zero byte of a 4 byte start code. */
+    do {
+        nb_offsets = avpriv_find_start_codes(buf_in + pos, size - pos,
+                                             offsets, FF_ARRAY_ELEMS(offsets));
+        for (i = 0; i < nb_offsets; i++) {
+            int next = pos + offsets[i];
+            if (nal_start >= 0) {
+                int nal_end = next - 3;
+                if (nal_end > nal_start && !buf_in[nal_end - 1])
+                    nal_end--;
+                out_size += write_nal_unit(pb, buf_in + nal_start,
+                                           nal_end - nal_start);
+            }
+            nal_start = next;
+        }
+        if (nb_offsets)
+            pos = nal_start;
+    } while (nb_offsets == FF_ARRAY_ELEMS(offsets));
+
+    if (nal_start >= 0)
+        out_size += write_nal_unit(pb, buf_in + nal_start, size - nal_start);
+
+    return out_size;
 }
 
 int ff_avc_parse_nal_units_buf(const uint8_t *buf_in, uint8_t **buf, int *size)
@@ -24,19 +24,16 @@
 #include "libavcodec/avcodec.h"
 #include "libavcodec/mpeg4audio.h"
 #include "libavutil/opt.h"
+#include "aacenc.h"
 #include "avformat.h"
 #include "rawenc.h"
 
-#define MAX_EXTRADATA_SIZE 1024
-
 typedef struct {
     AVClass *av_class;
-    int off;
-    int channel_conf;
-    int object_type;
+    LATMConfig cfg;
     int counter;
     int mod;
-    uint8_t buffer[0x1fff + MAX_EXTRADATA_SIZE + 1024];
+    uint8_t buffer[0x1fff + LATM_MAX_EXTRADATA_SIZE + 1024];
 } LATMContext;
 
 static const AVOption options[] = {
@@ -52,35 +49,6 @@ static const AVClass latm_muxer_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
-static int latm_decode_extradata(LATMContext *ctx, uint8_t *buf, int size)
-{
-    MPEG4AudioConfig m4ac;
-
-    if (size > MAX_EXTRADATA_SIZE) {
-        av_log(ctx, AV_LOG_ERROR, "Extradata is larger than currently supported.\n");
-        return AVERROR_INVALIDDATA;
-    }
-    ctx->off = avpriv_mpeg4audio_get_config(&m4ac, buf, size * 8, 1);
-    if (ctx->off < 0)
-        return ctx->off;
-
-    if (ctx->object_type == AOT_ALS && (ctx->off & 7)) {
-        // as long as avpriv_mpeg4audio_get_config works correctly this is impossible
-        av_log(ctx, AV_LOG_ERROR, "BUG: ALS offset is not byte-aligned\n");
-        return AVERROR_INVALIDDATA;
-    }
-    /* FIXME: are any formats not allowed in LATM? */
-
-    if (m4ac.object_type > AOT_SBR && m4ac.object_type != AOT_ALS) {
-        av_log(ctx, AV_LOG_ERROR, "Muxing MPEG-4 AOT %d in LATM is not supported\n", m4ac.object_type);
-        return AVERROR_INVALIDDATA;
-    }
-    ctx->channel_conf = m4ac.chan_config;
-    ctx->object_type  = m4ac.object_type;
-
-    return 0;
-}
-
 static int latm_write_header(AVFormatContext *s)
 {
     LATMContext *ctx = s->priv_data;
@@ -90,7 +58,7 @@ static int latm_write_header(AVFormatContext *s)
         return 0;
 
     if (avctx->extradata_size > 0 &&
-        latm_decode_extradata(ctx, avctx->extradata, avctx->extradata_size) < 0)
+        ff_latm_decode_extradata(ctx, &ctx->cfg, avctx->extradata, avctx->extradata_size) < 0)
         return AVERROR_INVALIDDATA;
 
     return 0;
@@ -100,42 +68,13 @@ static void latm_write_frame_header(AVFormatContext *s, PutBitContext *bs)
 {
     LATMContext *ctx = s->priv_data;
     AVCodecContext *avctx = s->streams[0]->codec;
-    int header_size;
 
     /* AudioMuxElement */
     put_bits(bs, 1, !!ctx->counter);
 
-    if (!ctx->counter) {
-        /* StreamMuxConfig */
-        put_bits(bs, 1, 0); /* audioMuxVersion */
-        put_bits(bs, 1, 1); /* allStreamsSameTimeFraming */
-        put_bits(bs, 6, 0); /* numSubFrames */
-        put_bits(bs, 4, 0); /* numProgram */
-        put_bits(bs, 3, 0); /* numLayer */
-
-        /* AudioSpecificConfig */
-        if (ctx->object_type == AOT_ALS) {
-            header_size = avctx->extradata_size-(ctx->off >> 3);
-            avpriv_copy_bits(bs, &avctx->extradata[ctx->off >> 3], header_size);
-        } else {
-            // + 3 assumes not scalable and dependsOnCoreCoder == 0,
-            // see decode_ga_specific_config in libavcodec/aacdec.c
-            avpriv_copy_bits(bs, avctx->extradata, ctx->off + 3);
-
-            if (!ctx->channel_conf) {
-                GetBitContext gb;
-                init_get_bits8(&gb, avctx->extradata, avctx->extradata_size);
-                skip_bits_long(&gb, ctx->off + 3);
-                avpriv_copy_pce_data(bs, &gb);
-            }
-        }
-
-        put_bits(bs, 3, 0); /* frameLengthType */
-        put_bits(bs, 8, 0xff); /* latmBufferFullness */
-
-        put_bits(bs, 1, 0); /* otherDataPresent */
-        put_bits(bs, 1, 0); /* crcCheckPresent */
-    }
+    if (!ctx->counter)
+        ff_latm_write_stream_mux_config(bs, &ctx->cfg, avctx->extradata,
+                                        avctx->extradata_size);
 
     ctx->counter++;
     ctx->counter %= ctx->mod;
@@ -146,7 +85,7 @@ static int latm_write_packet(AVFormatContext *s, AVPacket *pkt)
     LATMContext *ctx = s->priv_data;
     AVIOContext *pb = s->pb;
     PutBitContext bs;
-    int i, len;
+    int len;
     uint8_t loas_header[] = "\x56\xe0\x00";
 
     if (s->streams[0]->codec->codec_id == AV_CODEC_ID_AAC_LATM)
@@ -168,32 +107,11 @@ static int latm_write_packet(AVFormatContext *s, AVPacket *pkt)
     if (pkt->size > 0x1fff)
         goto too_large;
 
-    init_put_bits(&bs, ctx->buffer, pkt->size+1024+MAX_EXTRADATA_SIZE);
+    init_put_bits(&bs, ctx->buffer, pkt->size+1024+LATM_MAX_EXTRADATA_SIZE);
 
     latm_write_frame_header(s, &bs);
 
-    /* PayloadLengthInfo() */
-    for (i = 0; i <= pkt->size-255; i+=255)
-        put_bits(&bs, 8, 255);
-
-    put_bits(&bs, 8, pkt->size-i);
-
-    /* The LATM payload is written unaligned */
-
-    /* PayloadMux() */
-    if (pkt->size && (pkt->data[0] & 0xe1) == 0x81) {
-        // Convert byte-aligned DSE to non-aligned.
-        // Due to the input format encoding we know that
-        // it is naturally byte-aligned in the input stream,
-        // so there are no padding bits to account for.
-        // To avoid having to add padding bits and rearrange
-        // the whole stream we just remove the byte-align flag.
-        // This allows us to remux our FATE AAC samples into latm
-        // files that are still playable with minimal effort.
-        put_bits(&bs, 8, pkt->data[0] & 0xfe);
-        avpriv_copy_bits(&bs, pkt->data + 1, 8*pkt->size - 8);
-    } else
-        avpriv_copy_bits(&bs, pkt->data, 8*pkt->size);
+    ff_latm_write_payload(&bs, pkt->data, pkt->size);
 
     avpriv_align_put_bits(&bs);
     flush_put_bits(&bs);
@@ -19,6 +19,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "libavutil/bprint.h"
 #include "libavutil/buffer.h"
 #include "libavutil/crc.h"
 #include "libavutil/intreadwrite.h"
@@ -104,6 +105,59 @@ struct Program {
     int pmt_found;
 };
 
+enum MpegTSPidType {
+    MPEGTS_PID_UNKNOWN,
+    MPEGTS_PID_PAT,
+    MPEGTS_PID_PMT,
+    MPEGTS_PID_NIT,
+    MPEGTS_PID_SDT,
+    MPEGTS_PID_EIT,
+    MPEGTS_PID_TOT,
+    MPEGTS_PID_PES,
+    MPEGTS_PID_NULL,
+};
+
+/* Per PID statistics of the transport stream analysis.
+ * PCRs and intervals are in 27 MHz units, positions in bytes. */
+typedef struct MpegTSPidStats {
+    enum MpegTSPidType type;
+    int64_t packets;
+    int last_cc;
+    int64_t cc_errors;
+    int64_t scrambled;
+
+    int64_t pcr_count;
+    int64_t last_pcr_value;             ///< last PCR as coded in the stream
+    int64_t first_pcr, first_pcr_pos;   ///< PCRs below are unwrapped
+    int64_t last_pcr, last_pcr_pos;
+    int64_t pcr_interval_max;
+    int64_t pcr_interval_errors;
+    int64_t pcr_accuracy_max;
+    int64_t pcr_accuracy_errors;
+
+    int64_t sections;
+    int64_t last_section_clock;
+    int64_t section_interval_min;
+    int64_t section_interval_max;
+    int64_t section_interval_errors;
+} MpegTSPidStats;
+
+/* Transport stream statistics gathered while the packets are read, when the
+ * ts_analysis option is set. The checks follow the TR 101 290 priority 1 and
+ * 2 indicators. */
+typedef struct MpegTSAnalysis {
+    MpegTSPidStats pids[NB_PID_MAX];
+    int packet_size;
+    int64_t packets;
+    int64_t sync_errors;    ///< number of times the packet sync was lost
+    int64_t first_pos;      ///< byte position of the first packet analyzed
+    int64_t pos;            ///< byte position of the packet being analyzed
+    int ref_pcr_pid;        ///< PID whose PCR is used as the clock, -1 if none yet
+    int64_t clock;          ///< last mux clock the sections were timed with
+    int eof;                ///< the end of the input was reached in sequence
+    int exported;           ///< the statistics were stored in the metadata
+} MpegTSAnalysis;
+
 struct MpegTSContext {
     const AVClass *class;
     /* user data */
@@ -148,6 +202,16 @@ struct MpegTSContext {
     /** filters for various streams specified by PMT + for the PAT and PMT */
     MpegTSFilter *pids[NB_PID_MAX];
     int current_pid;
+
+    /** user supplied list of pids to demux, all others are skipped */
+    char *pid_filter_str;
+    /** bitmap of the pids that pass the filter, valid if pid_filter is set */
+    uint32_t pid_filter_map[NB_PID_MAX / 32];
+    int pid_filter;
+
+    /** gather transport stream statistics, exported as format metadata */
+    int ts_analysis;
+    MpegTSAnalysis *analysis;
 };
 
 static const AVOption mpegtsraw_options[] = {
@@ -173,6 +237,10 @@ static const AVOption mpegts_options[] = {
      {.i64 = 1}, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     {"ts_packetsize", "Output option carrying the raw packet size.", offsetof(MpegTSContext, raw_packet_size), AV_OPT_TYPE_INT,
      {.i64 = 0}, 0, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    {"pid_filter", "Only demux the listed pids, separated by '|' or ','.", offsetof(MpegTSContext, pid_filter_str), AV_OPT_TYPE_STRING,
+     {.str = NULL}, 0, 0, AV_OPT_FLAG_DECODING_PARAM },
+    {"ts_analysis", "Gather PCR, continuity and table repetition statistics.", offsetof(MpegTSContext, ts_analysis), AV_OPT_TYPE_INT,
+     {.i64 = 0}, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { NULL },
 };
 
@@ -353,6 +421,43 @@ static int discard_pid(MpegTSContext *ts, unsigned int pid)
     return !used && discarded;
 }
 
+static av_always_inline void pid_filter_add(MpegTSContext *ts, unsigned int pid)
+{
+    ts->pid_filter_map[pid >> 5] |= 1U << (pid & 31);
+}
+
+/**
+ * @return 1 if a pid filter is set and the pid is not part of it
+ */
+static av_always_inline int pid_filtered(const MpegTSContext *ts, unsigned int pid)
+{
+    return ts->pid_filter && !(ts->pid_filter_map[pid >> 5] & (1U << (pid & 31)));
+}
+
+static int parse_pid_filter(MpegTSContext *ts)
+{
+    const char *p = ts->pid_filter_str;
+    char *end;
+    long pid;
+
+    memset(ts->pid_filter_map, 0, sizeof(ts->pid_filter_map));
+    while (*p) {
+        pid = strtol(p, &end, 0);
+        if (end == p || pid < 0 || pid >= NB_PID_MAX ||
+            (*end && *end != '|' && *end != ',')) {
+            av_log(ts->stream, AV_LOG_ERROR, "Invalid pid_filter '%s'\n",
+                   ts->pid_filter_str);
+            return AVERROR(EINVAL);
+        }
+        pid_filter_add(ts, pid);
+        p = *end ? end + 1 : end;
+    }
+    ts->pid_filter = 1;
+    return 0;
+}
+
+static void analyze_section(MpegTSContext *ts, int pid);
+
 /**
  *  Assemble PES packets out of TS packets, and then call the "section_cb"
  *  function when they are complete.
@@ -401,8 +506,11 @@ static void write_section_data(AVFormatContext *s, MpegTSFilter *tss1,
             }else
                 crc_valid = 2;
         }
-        if (crc_valid)
+        if (crc_valid) {
+            if (ts->analysis)
+                analyze_section(ts, tss1->pid);
             tss->section_cb(tss1, tss->section_buf, tss->section_h_size);
+        }
     }
 }
 
@@ -440,6 +548,8 @@ static MpegTSFilter *mpegts_open_section_filter(MpegTSContext *ts,
 
     if (!(filter = mpegts_open_filter(ts, pid, MPEGTS_SECTION)))
         return NULL;
+    /* sections (PMTs found in the PAT) always pass the pid filter */
+    pid_filter_add(ts, pid);
     sec = &filter->u.section_filter;
     sec->section_cb  = section_cb;
     sec->opaque      = opaque;
@@ -1776,6 +1886,17 @@ static void pmt_cb(MpegTSFilter *filter, const uint8_t *section, int section_len
         if (pid == ts->current_pid)
             goto out;
 
+        if (pid_filtered(ts, pid)) {
+            /* no stream is created for pids outside of the pid filter */
+            desc_list_len = get16(&p, p_end);
+            if (desc_list_len < 0)
+                goto out;
+            p += desc_list_len & 0xfff;
+            if (p > p_end)
+                goto out;
+            continue;
+        }
+
         /* now create stream */
         if (ts->pids[pid] && ts->pids[pid]->type == MPEGTS_PES) {
             pes = ts->pids[pid]->u.pes_filter.opaque;
@@ -1900,6 +2021,8 @@ static void pat_cb(MpegTSFilter *filter, const uint8_t *section, int section_len
 
             if (!ts->pids[pmt_pid])
                 mpegts_open_section_filter(ts, pmt_pid, pmt_cb, ts, 1);
+            if (ts->analysis)
+                ts->analysis->pids[pmt_pid].type = MPEGTS_PID_PMT;
             add_pat_entry(ts, sid);
             add_pid_to_pmt(ts, sid, 0); // add pat pid to program
             add_pid_to_pmt(ts, sid, pmt_pid);
@@ -1999,6 +2122,261 @@ static void sdt_cb(MpegTSFilter *filter, const uint8_t *section, int section_len
 static int parse_pcr(int64_t *ppcr_high, int *ppcr_low,
                      const uint8_t *packet);
 
+/* transport stream analysis, exported by export_analysis() */
+
+#define PCR_TIME_BASE 27000000
+#define PCR_WRAP      ((INT64_C(1) << 33) * 300)
+
+#define MAX_PCR_INTERVAL (PCR_TIME_BASE / 25)      /* 40 ms */
+#define MAX_PCR_ACCURACY (PCR_TIME_BASE / 2000000) /* 500 ns */
+
+/* maximum repetition interval of each table in seconds, as checked by
+ * ETSI TR 101 290 (PAT, PMT) and ABNT NBR 15603-2 (NIT, SDT, TOT) */
+static const double max_section_interval[] = {
+    [MPEGTS_PID_PAT] = 0.5,
+    [MPEGTS_PID_PMT] = 0.5,
+    [MPEGTS_PID_NIT] = 10,
+    [MPEGTS_PID_SDT] = 2,
+    [MPEGTS_PID_EIT] = 2,
+    [MPEGTS_PID_TOT] = 30,
+    [MPEGTS_PID_NULL] = 0,
+};
+
+static MpegTSAnalysis *alloc_analysis(void)
+{
+    MpegTSAnalysis *ta = av_mallocz(sizeof(*ta));
+    int i;
+
+    if (!ta)
+        return NULL;
+    for (i = 0; i < NB_PID_MAX; i++) {
+        ta->pids[i].last_cc            = -1;
+        ta->pids[i].last_section_clock = AV_NOPTS_VALUE;
+    }
+    ta->pids[PAT_PID].type = MPEGTS_PID_PAT;
+    ta->pids[NIT_PID].type = MPEGTS_PID_NIT;
+    ta->pids[SDT_PID].type = MPEGTS_PID_SDT;
+    ta->pids[EIT_PID].type = MPEGTS_PID_EIT;
+    ta->pids[TOT_PID].type = MPEGTS_PID_TOT;
+    ta->pids[0x1fff].type  = MPEGTS_PID_NULL;
+    ta->first_pos   = -1;
+    ta->ref_pcr_pid = -1;
+    ta->clock       = AV_NOPTS_VALUE;
+    return ta;
+}
+
+/* Mux clock at the current packet, interpolated from the reference PCR
+ * at the average rate seen so far; AV_NOPTS_VALUE until two PCRs are known.
+ * On variable rate streams the next PCR may be below the interpolated clock,
+ * so it is kept from going backwards. */
+static int64_t analysis_clock(MpegTSAnalysis *ta)
+{
+    const MpegTSPidStats *ref;
+    int64_t clock;
+
+    if (ta->ref_pcr_pid < 0)
+        return AV_NOPTS_VALUE;
+    ref = &ta->pids[ta->ref_pcr_pid];
+    if (ref->last_pcr_pos <= ref->first_pcr_pos)
+        return AV_NOPTS_VALUE;
+    clock = ref->last_pcr + av_rescale(ta->pos - ref->last_pcr_pos,
+                                       ref->last_pcr  - ref->first_pcr,
+                                       ref->last_pcr_pos - ref->first_pcr_pos);
+    if (ta->clock != AV_NOPTS_VALUE)
+        clock = FFMAX(clock, ta->clock);
+    return ta->clock = clock;
+}
+
+/* difference between two PCRs across the 2^33 * 300 wraparound, in the
+ * range [-PCR_WRAP / 2, PCR_WRAP / 2) */
+static int64_t pcr_diff(int64_t pcr, int64_t prev)
+{
+    int64_t diff = (pcr - prev + PCR_WRAP) % PCR_WRAP;
+    return diff >= PCR_WRAP / 2 ? diff - PCR_WRAP : diff;
+}
+
+static void analyze_pcr(MpegTSAnalysis *ta, int pid, int64_t pcr)
+{
+    MpegTSPidStats *ps = &ta->pids[pid];
+
+    if (ta->ref_pcr_pid < 0)
+        ta->ref_pcr_pid = pid;
+
+    if (ps->pcr_count++) {
+        int64_t interval = pcr_diff(pcr, ps->last_pcr_value);
+
+        ps->pcr_interval_max = FFMAX(ps->pcr_interval_max, interval);
+        if (interval > MAX_PCR_INTERVAL || interval < 0)
+            ps->pcr_interval_errors++;
+
+        /* difference to the PCR expected from the average transport rate */
+        if (ps->last_pcr_pos > ps->first_pcr_pos) {
+            int64_t expected = av_rescale(ta->pos - ps->last_pcr_pos,
+                                          ps->last_pcr - ps->first_pcr,
+                                          ps->last_pcr_pos - ps->first_pcr_pos);
+            int64_t accuracy = FFABS(interval - expected);
+            ps->pcr_accuracy_max = FFMAX(ps->pcr_accuracy_max, accuracy);
+            if (accuracy > MAX_PCR_ACCURACY)
+                ps->pcr_accuracy_errors++;
+        }
+        ps->last_pcr += interval;
+    } else {
+        ps->first_pcr     = pcr;
+        ps->first_pcr_pos = ta->pos;
+        ps->last_pcr      = pcr;
+    }
+    ps->last_pcr_value = pcr;
+    ps->last_pcr_pos   = ta->pos;
+}
+
+/* called for every complete section with a valid CRC */
+static void analyze_section(MpegTSContext *ts, int pid)
+{
+    MpegTSAnalysis *ta = ts->analysis;
+    MpegTSPidStats *ps = &ta->pids[pid];
+    int64_t clock = analysis_clock(ta), interval;
+    double max = max_section_interval[ps->type];
+
+    /* ends in a packet skipped by analyze_packet() */
+    if (avio_tell(ts->stream->pb) - TS_PACKET_SIZE != ta->pos)
+        return;
+    ps->sections++;
+    if (clock == AV_NOPTS_VALUE)
+        return;
+    if (ps->last_section_clock != AV_NOPTS_VALUE) {
+        interval = clock - ps->last_section_clock;
+        if (!ps->section_interval_min || interval < ps->section_interval_min)
+            ps->section_interval_min = interval;
+        ps->section_interval_max = FFMAX(ps->section_interval_max, interval);
+        if (max && interval > max * PCR_TIME_BASE)
+            ps->section_interval_errors++;
+    }
+    ps->last_section_clock = clock;
+}
+
+/* packet layer statistics, before the packet is filtered */
+static void analyze_packet(MpegTSContext *ts, const uint8_t *packet)
+{
+    MpegTSAnalysis *ta = ts->analysis;
+    int pid = AV_RB16(packet + 1) & 0x1fff;
+    int afc = (packet[3] >> 4) & 3, cc = packet[3] & 0xf;
+    const uint8_t *p = packet + 4;
+    MpegTSPidStats *ps = &ta->pids[pid];
+    int64_t pcr_h;
+    int pcr_l;
+
+    int64_t pos = avio_tell(ts->stream->pb) - TS_PACKET_SIZE;
+
+    /* only the packets read in sequence are analyzed, not the ones read
+     * again or skipped to when the duration is estimated or on seeks */
+    if (ta->first_pos >= 0 && pos != ta->pos + ta->packet_size)
+        return;
+    ta->pos = pos;
+    if (ta->first_pos < 0)
+        ta->first_pos = pos;
+    ta->packet_size = ts->raw_packet_size;
+    ta->packets++;
+
+    ps->packets++;
+    if (packet[3] & 0xc0)
+        ps->scrambled++;
+    if (afc & 2) {
+        if (p[0] > 0 && (p[1] & 0x80)) /* discontinuity_indicator */
+            ps->last_cc = -1;
+        if (parse_pcr(&pcr_h, &pcr_l, packet) == 0)
+            analyze_pcr(ta, pid, pcr_h * 300 + pcr_l);
+        p += p[0] + 1;
+    }
+    if (pid == 0x1fff)
+        return;
+
+    /* continuity counter, one duplicate packet is allowed */
+    if (ps->last_cc >= 0) {
+        int expected = (afc & 1) ? (ps->last_cc + 1) & 0xf : ps->last_cc;
+        if (cc != expected && !((afc & 1) && cc == ps->last_cc))
+            ps->cc_errors++;
+    }
+    ps->last_cc = cc;
+
+    if (ps->type == MPEGTS_PID_UNKNOWN && (packet[1] & 0x40) && (afc & 1) &&
+        p + 3 <= packet + TS_PACKET_SIZE && !p[0] && !p[1] && p[2] == 1)
+        ps->type = MPEGTS_PID_PES;
+}
+
+/* the sections of the analyzed tables the demuxer itself does not read
+ * are only counted */
+static void analysis_section_cb(MpegTSFilter *filter, const uint8_t *section,
+                                int section_len)
+{
+}
+
+static const char *const pid_type_names[] = {
+    [MPEGTS_PID_UNKNOWN] = "unknown",
+    [MPEGTS_PID_PAT]     = "pat",
+    [MPEGTS_PID_PMT]     = "pmt",
+    [MPEGTS_PID_NIT]     = "nit",
+    [MPEGTS_PID_SDT]     = "sdt",
+    [MPEGTS_PID_EIT]     = "eit",
+    [MPEGTS_PID_TOT]     = "tot",
+    [MPEGTS_PID_PES]     = "pes",
+    [MPEGTS_PID_NULL]    = "null",
+};
+
+/* Store the statistics in the format metadata, as a "ts_analysis" entry and
+ * one "ts_analysis_pid_<pid>" entry per PID found, each a list of key=value
+ * pairs separated by ':'. Times are in 27 MHz units. */
+static void export_analysis(AVFormatContext *s, const MpegTSAnalysis *ta)
+{
+    AVBPrint bp;
+    char key[32];
+    int64_t size = ta->pos + ta->packet_size - ta->first_pos;
+    int i;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_AUTOMATIC);
+    av_bprintf(&bp, "packet_size=%d:packets=%"PRId64":sync_errors=%"PRId64,
+               ta->packet_size, ta->packets, ta->sync_errors);
+    if (ta->ref_pcr_pid >= 0) {
+        const MpegTSPidStats *ref = &ta->pids[ta->ref_pcr_pid];
+        if (ref->last_pcr_pos > ref->first_pcr_pos &&
+            ref->last_pcr > ref->first_pcr) {
+            int64_t duration = av_rescale(size, ref->last_pcr - ref->first_pcr,
+                                          ref->last_pcr_pos - ref->first_pcr_pos);
+            if (duration > 0)
+                av_bprintf(&bp, ":duration=%"PRId64":bit_rate=%"PRId64, duration,
+                           av_rescale(size * 8, PCR_TIME_BASE, duration));
+        }
+    }
+    if (av_bprint_is_complete(&bp))
+        av_dict_set(&s->metadata, "ts_analysis", bp.str, 0);
+
+    for (i = 0; i < NB_PID_MAX; i++) {
+        const MpegTSPidStats *ps = &ta->pids[i];
+
+        if (!ps->packets)
+            continue;
+        av_bprint_clear(&bp);
+        av_bprintf(&bp, "type=%s:packets=%"PRId64":cc_errors=%"PRId64
+                   ":scrambled=%"PRId64, pid_type_names[ps->type],
+                   ps->packets, ps->cc_errors, ps->scrambled);
+        if (ps->pcr_count)
+            av_bprintf(&bp, ":pcr_count=%"PRId64":pcr_interval_max=%"PRId64
+                       ":pcr_interval_errors=%"PRId64":pcr_accuracy_max=%"PRId64
+                       ":pcr_accuracy_errors=%"PRId64, ps->pcr_count,
+                       ps->pcr_interval_max, ps->pcr_interval_errors,
+                       ps->pcr_accuracy_max, ps->pcr_accuracy_errors);
+        if (ps->sections)
+            av_bprintf(&bp, ":sections=%"PRId64":section_interval_min=%"PRId64
+                       ":section_interval_max=%"PRId64
+                       ":section_interval_errors=%"PRId64, ps->sections,
+                       ps->section_interval_min, ps->section_interval_max,
+                       ps->section_interval_errors);
+        snprintf(key, sizeof(key), "ts_analysis_pid_%d", i);
+        if (av_bprint_is_complete(&bp))
+            av_dict_set(&s->metadata, key, bp.str, 0);
+    }
+    av_bprint_finalize(&bp, NULL);
+}
+
 /* handle one TS packet */
 static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
 {
@@ -2009,7 +2387,12 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
     const uint8_t *p, *p_end;
     int64_t pos;
 
+    if (ts->analysis)
+        analyze_packet(ts, packet);
+
     pid = AV_RB16(packet + 1) & 0x1fff;
+    if (pid_filtered(ts, pid))
+        return 0;
     if (pid && discard_pid(ts, pid))
         return 0;
     is_start = packet[1] & 0x40;
@@ -2192,18 +2575,34 @@ static int read_packet(AVFormatContext *s, uint8_t *buf, int raw_packet_size,
 
     for (;;) {
         len = ffio_read_indirect(pb, buf, TS_PACKET_SIZE, data);
-        if (len != TS_PACKET_SIZE)
+        if (len != TS_PACKET_SIZE) {
+            MpegTSContext *ts = s->priv_data;
+            MpegTSAnalysis *ta = ts->analysis;
+
+            if (ta && ta->first_pos >= 0 &&
+                avio_tell(pb) - FFMAX(len, 0) == ta->pos + ta->packet_size)
+                ta->eof = 1;
             return len < 0 ? len : AVERROR_EOF;
+        }
         /* check packet sync byte */
         if ((*data)[0] != 0x47) {
             /* find a new packet start */
             uint64_t pos = avio_tell(pb);
+            MpegTSContext *ts = s->priv_data;
+            MpegTSAnalysis *ta = ts->analysis;
+            int in_sequence = ta && ta->first_pos >= 0 &&
+                              pos - TS_PACKET_SIZE == ta->pos + ta->packet_size;
+
+            if (in_sequence)
+                ta->sync_errors++;
             avio_seek(pb, -FFMIN(raw_packet_size, pos), SEEK_CUR);
 
             if (mpegts_resync(s) < 0)
                 return AVERROR(EAGAIN);
-            else
-                continue;
+            /* continue the analysis at the new packet start */
+            if (in_sequence)
+                ta->pos = avio_tell(pb) - ta->packet_size;
+            continue;
         } else {
             break;
         }
@@ -2222,6 +2621,7 @@ static void finished_reading_packet(AVFormatContext *s, int raw_packet_size)
 static int handle_packets(MpegTSContext *ts, int nb_packets)
 {
     AVFormatContext *s = ts->stream;
+    AVIOContext *pb = s->pb;
     uint8_t packet[TS_PACKET_SIZE + FF_INPUT_BUFFER_PADDING_SIZE];
     const uint8_t *data;
     int packet_num, ret = 0;
@@ -2241,6 +2641,8 @@ static int handle_packets(MpegTSContext *ts, int nb_packets)
                 ts->pids[i]->last_cc = -1;
                 ts->pids[i]->last_pcr = -1;
             }
+            if (ts->analysis)
+                ts->analysis->pids[i].last_cc = -1;
         }
     }
 
@@ -2257,11 +2659,25 @@ static int handle_packets(MpegTSContext *ts, int nb_packets)
         if (ts->stop_parse > 0)
             break;
 
-        ret = read_packet(s, packet, ts->raw_packet_size, &data);
-        if (ret != 0)
-            break;
-        ret = handle_packet(ts, data);
-        finished_reading_packet(s, ts->raw_packet_size);
+        if (pb->buf_end - pb->buf_ptr >= ts->raw_packet_size &&
+            pb->buf_ptr[0] == 0x47) {
+            /* the whole packet is in the I/O buffer, handle it in place
+             * like read_packet() and finished_reading_packet() would */
+            data = pb->buf_ptr;
+            if (!ts->analysis && pid_filtered(ts, AV_RB16(data + 1) & 0x1fff)) {
+                pb->buf_ptr += ts->raw_packet_size;
+                continue;
+            }
+            pb->buf_ptr += TS_PACKET_SIZE;
+            ret = handle_packet(ts, data);
+            pb->buf_ptr += ts->raw_packet_size - TS_PACKET_SIZE;
+        } else {
+            ret = read_packet(s, packet, ts->raw_packet_size, &data);
+            if (ret != 0)
+                break;
+            ret = handle_packet(ts, data);
+            finished_reading_packet(s, ts->raw_packet_size);
+        }
         if (ret != 0)
             break;
     }
@@ -2361,6 +2777,12 @@ static int mpegts_read_header(AVFormatContext *s)
     ts->stream     = s;
     ts->auto_guess = 0;
 
+    if (ts->pid_filter_str && *ts->pid_filter_str) {
+        int ret = parse_pid_filter(ts);
+        if (ret < 0)
+            return ret;
+    }
+
     if (s->iformat == &ff_mpegts_demuxer) {
         /* normal demux */
 
@@ -2379,6 +2801,15 @@ static int mpegts_read_header(AVFormatContext *s)
         av_dlog(ts->stream, "tuning done\n");
 
         s->ctx_flags |= AVFMTCTX_NOHEADER;
+
+        /* the packets read so far are read again from the start */
+        if (ts->ts_analysis) {
+            if (!(ts->analysis = alloc_analysis()))
+                return AVERROR(ENOMEM);
+            mpegts_open_section_filter(ts, NIT_PID, analysis_section_cb, ts, 1);
+            mpegts_open_section_filter(ts, EIT_PID, analysis_section_cb, ts, 1);
+            mpegts_open_section_filter(ts, TOT_PID, analysis_section_cb, ts, 1);
+        }
     } else {
         AVStream *st;
         int pcr_pid, pid, nb_packets, nb_pcrs, ret, pcr_l;
@@ -2494,6 +2925,10 @@ static int mpegts_read_packet(AVFormatContext *s, AVPacket *pkt)
     ts->pkt = pkt;
     ret = handle_packets(ts, 0);
     if (ret < 0) {
+        if (ts->analysis && ts->analysis->eof && !ts->analysis->exported) {
+            export_analysis(s, ts->analysis);
+            ts->analysis->exported = 1;
+        }
         av_free_packet(ts->pkt);
         /* flush pes data left */
         for (i = 0; i < NB_PID_MAX; i++)
@@ -2522,6 +2957,7 @@ static void mpegts_free(MpegTSContext *ts)
     for (i = 0; i < NB_PID_MAX; i++)
         if (ts->pids[i])
             mpegts_close_filter(ts, ts->pids[i]);
+    av_freep(&ts->analysis);
 }
 
 static int mpegts_read_close(AVFormatContext *s)
@@ -36,6 +36,7 @@
 #define PAT_PID                 0x0000
 #define NIT_PID                 0x0010
 #define SDT_PID                 0x0011
+#define EIT_PID                 0x0012
 #define TOT_PID                 0x0014
 
 /* table ids */
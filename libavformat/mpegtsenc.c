@@ -43,14 +43,20 @@ estendida do SI   */
 PAT,CAT,PMT,NIT (rede atual), SDT (feixe atual (?)), EIT (programa presente e futuro do feixe atual) e TOT. */
  
 
+#include "libavutil/avstring.h"
 #include "libavutil/bswap.h"
 #include "libavutil/crc.h"
 #include "libavutil/dict.h"
+#include "libavutil/fifo.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
+#include "libavutil/time.h"
 #include "libavutil/avassert.h"
 #include "libavcodec/internal.h"
+#include "libavcodec/mpeg4audio.h"
+#include "libavcodec/put_bits.h"
+#include "aacenc.h"
 #include "avformat.h"
 #include "internal.h"
 #include "mpegts.h"
@@ -71,6 +77,10 @@ typedef struct MpegTSSection {
     int cc;
     void (*write_packet)(struct MpegTSSection *s, const uint8_t *packet);
     void *opaque;
+    uint8_t *cache;             ///< TS packets of the last written section, resent as is
+    unsigned int cache_alloc;
+    int cache_size;             ///< bytes of valid packets in cache, 0 if nothing is cached
+    int cache_version;          ///< table version the cached section was built with
 } MpegTSSection;
 
 /* Representa um serviço e contém uma MpegTSSection pra sua PMT, um ID do serviço, o PCR PID e variáveis
@@ -84,9 +94,12 @@ typedef struct MpegTSService {
     int sid;           /* service ID */
     char *name;
     char *provider_name;
+    int service_type;  ///< service_type of the SDT and NIT service list descriptors
+    int oneseg;        ///< partial reception (1-seg) service
     int pcr_pid;
     int pcr_packet_count;
     int pcr_packet_period;
+    int64_t last_pcr;  ///< last PCR sent in T-STD mode, AV_NOPTS_VALUE if none yet
 } MpegTSService;
 
 typedef struct MpegTSWrite {
@@ -98,14 +111,23 @@ typedef struct MpegTSWrite {
     //aqui deve ser verificado se todas as tabelas necessárias para o padrão brasileiro já foram inclusas.
     //pode-se consultar o TCC do Lucas, lembrando que esse já é o arquivo modificado por ele.
     MpegTSService **services;
-    int sdt_packet_count;
-    int sdt_packet_period;
-    int nit_packet_count;
-    int nit_packet_period;
-	int tot_packet_count;
-    int tot_packet_period;
-    int pat_packet_count;
-    int pat_packet_period;
+    /* maximum SI repetition intervals in seconds */
+    double pat_period;
+    double pmt_period;
+    double sdt_period;
+    double nit_period;
+    double tot_period;
+    /* mux clock (PCR units) at which each table was last sent, AV_NOPTS_VALUE to send it asap */
+    int64_t last_pat_pcr;
+    int64_t last_pmt_pcr;
+    int64_t last_sdt_pcr;
+    int64_t last_nit_pcr;
+    int64_t last_tot_pcr;
+    int64_t packet_pcr_duration; ///< duration of one TS packet in PCR units, 0 when VBR
+
+    /* T-STD mode statistics */
+    int64_t tstd_null_packets;
+    int64_t tstd_max_pcr_interval;
     int nb_services;
     int final_nb_services;
     int area_code;
@@ -114,6 +136,7 @@ typedef struct MpegTSWrite {
     int physical_channel;
     int virtual_channel;
     int transmission_profile;
+    char *service_map;
     int onid;
     int tsid;
     int64_t first_pcr;
@@ -132,15 +155,32 @@ typedef struct MpegTSWrite {
 
 #define MPEGTS_FLAG_REEMIT_PAT_PMT  0x01
 #define MPEGTS_FLAG_AAC_LATM        0x02
+#define MPEGTS_FLAG_TSTD            0x04
     int flags;
     int copyts;
     int tables_version;
+
+    int64_t last_clock;     ///< last known position of the mux clock, see mpegts_get_clock()
+    int64_t tot_base_time;  ///< wall clock time (in seconds) of the first TOT
+    int64_t tot_first_pcr;  ///< mux clock when the first TOT was sent, -1 if none yet
+
+    int pkt_batch_size;  ///< number of TS packets gathered before a single avio_write()
+    int pkt_batch_len;   ///< bytes currently pending in pkt_batch
+    uint8_t *pkt_batch;
+
+    int latm_smc_interval; ///< number of LATM frames between two StreamMuxConfig
+
+    char *passthrough_pids;
+    struct TSPassthrough *passthrough; ///< set when MPEG-TS streams are forwarded
 } MpegTSWrite;
 
 /* a PES packet header is generated every DEFAULT_PES_HEADER_FREQ packets */
 #define DEFAULT_PES_HEADER_FREQ 16
 #define DEFAULT_PES_PAYLOAD_SIZE ((DEFAULT_PES_HEADER_FREQ - 1) * 184 + 170)
 
+/* 7 packets fill exactly one 1316 byte UDP datagram */
+#define DEFAULT_PKT_BATCH_SIZE 7
+
 static const AVOption options[] = {
     { "mpegts_transport_stream_id", "Set transport_stream_id field.",
       offsetof(MpegTSWrite, transport_stream_id), AV_OPT_TYPE_INT, {.i64 = 0x0001 }, 0x0001, 0xffff, AV_OPT_FLAG_ENCODING_PARAM},
@@ -162,6 +202,8 @@ static const AVOption options[] = {
       offsetof(MpegTSWrite, virtual_channel), AV_OPT_TYPE_INT, {.i64 = 0x0014 }, 0x0001, 0x0D45, AV_OPT_FLAG_ENCODING_PARAM},
     { "mpegts_transmission_profile", "Set transmission_profile field.",
       offsetof(MpegTSWrite, transmission_profile), AV_OPT_TYPE_INT, {.i64 = 0x0001 }, 0x0001, 0x0002, AV_OPT_FLAG_ENCODING_PARAM},
+    { "mpegts_service_map", "Describe the services of the multiplex, overrides mpegts_transmission_profile",
+      offsetof(MpegTSWrite, service_map), AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, AV_OPT_FLAG_ENCODING_PARAM},
     { "mpegts_pmt_start_pid", "Set the first pid of the PMT.",
       offsetof(MpegTSWrite, pmt_start_pid), AV_OPT_TYPE_INT, {.i64 = 0x1000 }, 0x0010, 0x1f00, AV_OPT_FLAG_ENCODING_PARAM},
     { "mpegts_start_pid", "Set the first pid.",
@@ -180,6 +222,9 @@ static const AVOption options[] = {
     { "latm", "Use LATM packetization for AAC",
       0, AV_OPT_TYPE_CONST, {.i64 = MPEGTS_FLAG_AAC_LATM}, 0, INT_MAX,
       AV_OPT_FLAG_ENCODING_PARAM, "mpegts_flags"},
+    { "tstd", "Schedule packets of all streams on a T-STD buffer model (requires muxrate)",
+      0, AV_OPT_TYPE_CONST, {.i64 = MPEGTS_FLAG_TSTD}, 0, INT_MAX,
+      AV_OPT_FLAG_ENCODING_PARAM, "mpegts_flags"},
     // backward compatibility
     { "resend_headers", "Reemit PAT/PMT before writing the next packet",
       offsetof(MpegTSWrite, reemit_pat_pmt), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
@@ -187,6 +232,23 @@ static const AVOption options[] = {
       offsetof(MpegTSWrite, copyts), AV_OPT_TYPE_INT, {.i64=-1}, -1, 1, AV_OPT_FLAG_ENCODING_PARAM},
     { "tables_version", "set PAT, PMT and SDT version",
       offsetof(MpegTSWrite, tables_version), AV_OPT_TYPE_INT, {.i64=0}, 0, 31, AV_OPT_FLAG_ENCODING_PARAM},
+    /* maximum repetition intervals, see ABNT NBR 15603-2 / ARIB TR-B14 */
+    { "pat_period", "Set maximum PAT retransmission interval in seconds",
+      offsetof(MpegTSWrite, pat_period), AV_OPT_TYPE_DOUBLE, {.dbl = 0.1}, 0.01, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
+    { "pmt_period", "Set maximum PMT retransmission interval in seconds",
+      offsetof(MpegTSWrite, pmt_period), AV_OPT_TYPE_DOUBLE, {.dbl = 0.1}, 0.01, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
+    { "sdt_period", "Set maximum SDT retransmission interval in seconds",
+      offsetof(MpegTSWrite, sdt_period), AV_OPT_TYPE_DOUBLE, {.dbl = 2}, 0.01, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
+    { "nit_period", "Set maximum NIT retransmission interval in seconds",
+      offsetof(MpegTSWrite, nit_period), AV_OPT_TYPE_DOUBLE, {.dbl = 10}, 0.01, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
+    { "tot_period", "Set maximum TOT retransmission interval in seconds",
+      offsetof(MpegTSWrite, tot_period), AV_OPT_TYPE_DOUBLE, {.dbl = 30}, 0.01, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
+    { "latm_smc_interval", "Number of LATM frames between two StreamMuxConfig",
+      offsetof(MpegTSWrite, latm_smc_interval), AV_OPT_TYPE_INT, {.i64 = 20}, 1, 0xffff, AV_OPT_FLAG_ENCODING_PARAM},
+    { "mpegts_packet_batch", "Number of TS packets gathered before writing them to the output",
+      offsetof(MpegTSWrite, pkt_batch_size), AV_OPT_TYPE_INT, {.i64 = DEFAULT_PKT_BATCH_SIZE}, 1, 4096, AV_OPT_FLAG_ENCODING_PARAM},
+    { "passthrough_pids", "Input PIDs forwarded from MPEG-TS streams, ',' separated in[=out] entries",
+      offsetof(MpegTSWrite, passthrough_pids), AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, AV_OPT_FLAG_ENCODING_PARAM},
     { NULL },
 };
 
@@ -212,6 +274,11 @@ static void mpegts_write_section(MpegTSSection *s, uint8_t *buf, int len)
     buf[len - 2] = (crc >> 8) & 0xff;
     buf[len - 1] = (crc) & 0xff;
 
+    /* keep the packetized section so that it can be resent without rebuilding it */
+    av_fast_malloc(&s->cache, &s->cache_alloc,
+                   (len + TS_PACKET_SIZE - 4) / (TS_PACKET_SIZE - 4) * TS_PACKET_SIZE);
+    s->cache_size = 0;
+
     /* send each packet */
     buf_ptr = buf;
     while (len > 0) {
@@ -238,12 +305,36 @@ static void mpegts_write_section(MpegTSSection *s, uint8_t *buf, int len)
             memset(q, 0xff, left);
 
         s->write_packet(s, packet);
+        if (s->cache) {
+            memcpy(s->cache + s->cache_size, packet, TS_PACKET_SIZE);
+            s->cache_size += TS_PACKET_SIZE;
+        }
 
         buf_ptr += len1;
         len -= len1;
     }
 }
 
+/* Send the cached packets of the last written section again, only the
+ * continuity counter needs to be updated. */
+static void mpegts_resend_section(MpegTSSection *s)
+{
+    uint8_t *packet;
+
+    for (packet = s->cache; packet < s->cache + s->cache_size; packet += TS_PACKET_SIZE) {
+        s->cc = (s->cc + 1) & 0xf;
+        packet[3] = 0x10 | s->cc;
+        s->write_packet(s, packet);
+    }
+}
+
+static void mpegts_free_section(MpegTSSection *s)
+{
+    av_freep(&s->cache);
+    s->cache_alloc = 0;
+    s->cache_size  = 0;
+}
+
 static inline void put16(uint8_t **q_ptr, int val)
 {
     uint8_t *q;
@@ -277,6 +368,7 @@ static int mpegts_write_section1(MpegTSSection *s, int tid, int id,
     memcpy(q, buf, len);
 
     mpegts_write_section(s, section, tot_len);
+    s->cache_version = version;
     return 0;
 }
 
@@ -290,17 +382,63 @@ static int mpegts_write_section1(MpegTSSection *s, int tid, int id,
 
 #define DEFAULT_NID		0x0640	// 1600d
 
-/* we retransmit the SI info at this rate */
-#define SDT_RETRANS_TIME 500
-#define NIT_RETRANS_TIME 50 //Arbitrary value, the brazilian standard requests the NIT to be send every 10 secs.
-#define TOT_RETRANS_TIME 100 //Arbitrary value, the brazilian standard requests the NIT to be send every 10 secs.
-#define PAT_RETRANS_TIME 100
+/* we retransmit the PCR at this rate, SI tables follow the *_period options */
 #define PCR_RETRANS_TIME 20
+
+/* TOT times are sent as UTC-3 */
+#define TOT_UTC_OFFSET (3 * 3600)
+/* TOT start time in bitexact mode: 2014-05-23 10:20:30 UTC-3 */
+#define TOT_BITEXACT_TIME INT64_C(1401024030)
 // TODO Add here the new tables retransmission rate
 
 /* Representa um ES que é enviado através do TS; tem um ponteiro pro serviço correspondente, o PID da stream,
 um continuity counter, os valores atuais das PTS e DTS da stream e os dados propriamente ditos */ 
 
+/* T-STD buffer model of one elementary stream (ISO 13818-1 2.4.2),
+ * a transport buffer TB leaking at Rx into an elementary buffer B from
+ * which access units are removed at their dts. */
+typedef struct TSTDBuffer {
+    AVFifoBuffer *packets;  ///< TSTDPacket queued for sending, in order
+    AVFifoBuffer *units;    ///< TSTDUnit waiting in B for their dts
+    int unit_size;          ///< payload bytes queued for the access unit being packetized
+    int64_t leak_rate;      ///< Rx in bytes per second
+    int tb_size;            ///< TB size in bytes
+    int bs_size;            ///< B size in bytes
+    int64_t tb_fill;        ///< TB fullness in bytes * PCR_TIME_BASE
+    int bs_fill;            ///< B fullness in bytes
+    int64_t last_update;    ///< mux clock of the last TB leak update
+    int last_cc;            ///< continuity counter of the last packet sent
+
+    /* statistics */
+    int64_t nb_packets;
+    int64_t tb_max;
+    int bs_max;
+    int64_t min_margin;     ///< smallest dts - arrival time seen, PCR units
+    int64_t late_packets;   ///< packets arriving after their dts (B underflow)
+    int64_t held_back;      ///< slots a due packet waited to avoid TB/B overflow
+} TSTDBuffer;
+
+typedef struct TSTDPacket {
+    int64_t dts;
+    int payload;
+    uint8_t data[TS_PACKET_SIZE];
+} TSTDPacket;
+
+typedef struct TSTDUnit {
+    int64_t dts;
+    int size;
+} TSTDUnit;
+
+/* ADTS or LATM/LOAS framing of raw AAC packets */
+typedef struct AACFramer {
+    int enabled;           ///< raw packets are framed, set once extradata was parsed
+    ADTSConfig adts;
+    LATMConfig latm;
+    int smc_counter;       ///< LATM frames since the last StreamMuxConfig
+    uint8_t *buf;          ///< LATM frame, reused for every packet
+    unsigned buf_size;
+} AACFramer;
+
 typedef struct MpegTSWriteStream {
     struct MpegTSService *service;
     int pid; /* stream associated pid */
@@ -312,9 +450,53 @@ typedef struct MpegTSWriteStream {
     int64_t payload_dts;
     int payload_flags;
     uint8_t *payload;
-    AVFormatContext *amux;
+    AACFramer aac;
+    TSTDBuffer tstd;
 } MpegTSWriteStream;
 
+#define PCR_WRAP ((INT64_C(1) << 33) * 300)
+#define PSI_MAX_SECTION_SIZE 1024
+
+/* PSI section of the passthrough input being reassembled */
+typedef struct TSPassthroughSection {
+    uint8_t buf[PSI_MAX_SECTION_SIZE];
+    int size;                   ///< bytes gathered so far, -1 until a section starts
+} TSPassthroughSection;
+
+/* program of the passthrough input, as announced by its PAT and PMT */
+typedef struct TSPassthroughProgram {
+    int sid;
+    int pmt_pid;
+    int pmt_version;            ///< version of the parsed PMT, -1 if none yet
+    int pcr_pid;
+    uint8_t es_info[PSI_MAX_SECTION_SIZE]; ///< elementary stream loop of the PMT
+    int es_info_size;
+    struct MpegTSService *service; ///< output service the program is muxed into
+    TSPassthroughSection pmt;
+
+    /* PCR restamping */
+    int64_t last_pcr;           ///< last input PCR, AV_NOPTS_VALUE if none yet
+    int64_t in_clock;           ///< input PCR without wraparounds
+    int64_t pcr_offset;         ///< input clock - mux clock, AV_NOPTS_VALUE if unset
+    int nb_resync;              ///< times the offset moved because the input clock fell behind
+} TSPassthroughProgram;
+
+/* Raw TS packets of AV_CODEC_ID_MPEG2TS streams are forwarded as is,
+ * only their PID, continuity counter and PCR are rewritten; the PSI/SI
+ * of the input are replaced by the tables of the muxer. */
+typedef struct TSPassthrough {
+    int16_t req_pid[NB_PID_MAX]; ///< output PID requested for an input PID, -1 if not requested
+    int nb_req_pids;             ///< 0 to forward every elementary stream
+    int16_t out_pid[NB_PID_MAX]; ///< output PID of an input PID, -1 to drop it
+    uint8_t cc[NB_PID_MAX];      ///< continuity counter of each output PID
+    TSPassthroughSection pat;
+    int pat_version;
+    TSPassthroughProgram **programs;
+    int nb_programs;
+    uint32_t layout_crc;         ///< CRC of the forwarded layout the tables were last built with
+    int layout_valid;
+} TSPassthrough;
+
 typedef enum {
 	GI1_32,
 	GI1_16,
@@ -402,6 +584,10 @@ static int mpegts_write_pmt(AVFormatContext *s, MpegTSService *service)
         AVStream *st = s->streams[i];
         MpegTSWriteStream *ts_st = st->priv_data;
 
+        /* forwarded streams are described by their input PMT, see below */
+        if (st->codec->codec_id == AV_CODEC_ID_MPEG2TS)
+            continue;
+
 	//av_log(s, AV_LOG_VERBOSE, "Stream SID: %d \t Service ID: %d\n", ts_st->service->sid, service->sid);
 	if( ts_st->service->sid == service->sid ) {
 
@@ -617,6 +803,47 @@ static int mpegts_write_pmt(AVFormatContext *s, MpegTSService *service)
         desc_length_ptr[1] = val;
     } //if stream service equal current service
     } //for all streams in the context
+
+    if (ts->passthrough) {
+        TSPassthrough *tp = ts->passthrough;
+        const uint8_t *p, *p_end;
+        int pid, len, desc_len, dropped = 0;
+
+        /* copy the elementary streams of the forwarded programs with their
+         * descriptors; descriptors that do not fit in the section are dropped */
+        for (i = 0; i < tp->nb_programs; i++) {
+            TSPassthroughProgram *prg = tp->programs[i];
+            if (prg->service != service)
+                continue;
+            p     = prg->es_info;
+            p_end = prg->es_info + prg->es_info_size;
+            for (; p + 5 <= p_end; p += 5 + len) {
+                pid = AV_RB16(p + 1) & 0x1fff;
+                len = FFMIN(AV_RB16(p + 3) & 0xfff, p_end - p - 5);
+                if (tp->out_pid[pid] < 0)
+                    continue;
+                if (q - data + 5 > sizeof(data) - 4) {
+                    av_log(s, AV_LOG_ERROR, "PMT of service 0x%04x is full, "
+                           "pid 0x%x not announced\n", service->sid, tp->out_pid[pid]);
+                    continue;
+                }
+                desc_len = len;
+                if (q - data + 5 + desc_len > sizeof(data) - 4) {
+                    dropped += desc_len;
+                    desc_len = 0;
+                }
+                *q++ = p[0];
+                put16(&q, 0xe000 | tp->out_pid[pid]);
+                put16(&q, 0xf000 | desc_len);
+                memcpy(q, p + 5, desc_len);
+                q += desc_len;
+            }
+        }
+        if (dropped)
+            av_log(s, AV_LOG_WARNING, "PMT of service 0x%04x is full, %d bytes "
+                   "of forwarded descriptors dropped\n", service->sid, dropped);
+    }
+
     mpegts_write_section1(&service->pmt, PMT_TID, service->sid, ts->tables_version, 0, 0,
                           data, q - data);
     return 0;
@@ -649,7 +876,7 @@ static void mpegts_write_sdt(AVFormatContext *s)
         *q++ = 0x48;
         desc_len_ptr = q;
         q++;
-        *q++ = 0x01; /* digital television service */
+        *q++ = service->service_type;
         putstr8(&q, service->provider_name);
         putstr8(&q, service->name);
         desc_len_ptr[0] = q - desc_len_ptr - 1;
@@ -669,7 +896,8 @@ static void mpegts_write_nit(AVFormatContext *s)
 	MpegTSWrite *ts = s->priv_data;
 	uint8_t data[1012], *q, *desc_len_ptr, *ts_loop_len_ptr, *transp_desc_len_ptr;
 	uint8_t *ts_info_desc_length_ptr, *service_list_desc_length_ptr, *part_rec_desc_length_ptr, *sys_mgmt_desc_length_ptr, *terr_del_sys_desc_length_ptr;
-	int i, temp_val, ts_loop_length_val, transp_desc_len_val;
+	uint8_t *nb_services_ptr;
+	int i, layer, temp_val, ts_loop_length_val, transp_desc_len_val, nb_types = 0;
 
 	q = data;
 	
@@ -721,38 +949,28 @@ static void mpegts_write_nit(AVFormatContext *s)
 	*q++; //length, filled later
 	*q++ = ts->virtual_channel; //remote control key id
 	//av_log(s, AV_LOG_VERBOSE, "==== virtual channel : %d physical channel %d \n", ts->virtual_channel, ts->physical_channel);
-	//length of ts name string, 6 bits | transmission type count, 2 bits
-	*q++ = strlen(DEFAULT_NETWORK_NAME) << 2 | 0x2;
+	//length of ts name string, 6 bits | transmission type count, 2 bits, patched below
+	*q++ = strlen(DEFAULT_NETWORK_NAME) << 2;
 	memcpy(q, DEFAULT_NETWORK_NAME, strlen(DEFAULT_NETWORK_NAME));
 	q += strlen(DEFAULT_NETWORK_NAME);
 
-	// transmission_profile: variável criada como modo de se alterar/escolher o número de serviços no TS.
-	switch (ts->transmission_profile) {
-		case 1:
-		default:
-			for(i = 0; i < ts->nb_services; i++) {
-			//	av_log(s, AV_LOG_VERBOSE, "==== service test fields: %x NW_ID:%x SVC_TYPE:%x PGM_NB:%x \n",
-			//		ts->services[i]->sid,
-			//		(( ts->services[i]->sid & 0xFFE0 ) >> 5 ),
-			//		(( ts->services[i]->sid & 0x18 ) >> 3 ),
-			//		(ts->services[i]->sid & 0x7 )
-			//	);
-				if( (ts->services[i]->sid & 0x18 >> 3 )) {//if true, is a 1-seg service
-					*q++ = 0xAF; //transmission type: 0xAF: C
-					*q++ = 0x01; //number of services of this transm. type
-					put16(&q, ts->services[i]->sid);//service_ID
-				}
-				else {
-					*q++ = 0x0F; //transmission type: 0x0F: A
-					*q++ = 0x01; //number of services of this transm. type
-					put16(&q, ts->services[i]->sid);//service_ID
-				}
+	// one transmission type for the full-seg services (A) and one for the 1-seg services (C)
+	for (layer = 0; layer < 2; layer++) {
+		nb_services_ptr = NULL;
+		for(i = 0; i < ts->nb_services; i++) {
+			if (ts->services[i]->oneseg != layer)
+				continue;
+			if (!nb_services_ptr) {
+				*q++ = layer ? 0xAF : 0x0F; //transmission type: 0xAF: C, 0x0F: A
+				nb_services_ptr = q;
+				*q++ = 0; //number of services of this transm. type
+				nb_types++;
 			}
-		break;
-		case 2:
-			
-		break;
+			(*nb_services_ptr)++;
+			put16(&q, ts->services[i]->sid);//service_ID
+		}
 	}
+	ts_info_desc_length_ptr[2] |= nb_types;
 
 	//Fill TS info descriptor length
 	ts_info_desc_length_ptr[0] = q - ts_info_desc_length_ptr - 1;
@@ -764,25 +982,26 @@ static void mpegts_write_nit(AVFormatContext *s)
 
 	for(i = 0; i < ts->nb_services; i++) {
 		put16(&q, ts->services[i]->sid);//service_ID
-		*q++ = 0x01; //service type 0x01 for Digital TV Service
+		*q++ = ts->services[i]->service_type;
 	}
 
 	//Fill Service list descriptor length
 	service_list_desc_length_ptr[0] = q - service_list_desc_length_ptr - 1;
 
+	// Partial Reception Descriptor, lists the 1-seg services
+	part_rec_desc_length_ptr = NULL;
 	for(i = 0; i < ts->nb_services; i++) {
-		//av_log(s, AV_LOG_VERBOSE, "==== 1-seg Service test: %x \n", (ts->services[i]->sid & 0x18) >> 3 );
-		if(((ts->services[i]->sid & 0x18) >> 3) == 0x3) {//if true, is a 1-seg service
-			//av_log(s, AV_LOG_VERBOSE, "==== 1-seg Service detected, creating partial reception desriptor.\n" );
-			// Partial Reception Descriptor
+		if (!ts->services[i]->oneseg)
+			continue;
+		if (!part_rec_desc_length_ptr) {
 			*q++ = 0xFB; //tag
 			part_rec_desc_length_ptr = q;
 			*q++; //length, filled later
-			put16(&q, ts->services[i]->sid);
-			//Fill  descriptor length
-			part_rec_desc_length_ptr[0] = q - part_rec_desc_length_ptr - 1;
 		}
+		put16(&q, ts->services[i]->sid);
 	}
+	if (part_rec_desc_length_ptr)
+		part_rec_desc_length_ptr[0] = q - part_rec_desc_length_ptr - 1;
 
 	//// Terrestrial System Delivery Descriptor
 	*q++ = 0xFA; //tag
@@ -828,12 +1047,33 @@ static void mpegts_write_nit(AVFormatContext *s)
                           data, q - data);
 }
 
-static void mpegts_write_tot(AVFormatContext *s)
+/* Current TOT time: UTC-3 (brazilian official time) in seconds, advancing
+ * with the mux clock from the time the first TOT was sent. */
+static int64_t mpegts_tot_time(MpegTSWrite *ts, int64_t pcr)
+{
+    if (ts->tot_first_pcr < 0)
+        ts->tot_first_pcr = pcr;
+    return ts->tot_base_time + (pcr - ts->tot_first_pcr) / PCR_TIME_BASE - TOT_UTC_OFFSET;
+}
+
+/* Write a time as 16 bit MJD followed by hours, minutes and seconds in BCD */
+static void put_mjd_bcd_time(uint8_t *q, int64_t t)
+{
+    int mjd  = t / 86400 + 40587;
+    int secs = t % 86400;
+
+    *q++ = mjd >> 8;
+    *q++ = mjd;
+    *q++ = ((secs / 3600) / 10) << 4 | (secs / 3600) % 10;
+    *q++ = ((secs / 60 % 60) / 10) << 4 | (secs / 60 % 60) % 10;
+    *q++ = ((secs % 60) / 10) << 4 | (secs % 60) % 10;
+}
+
+static void mpegts_write_tot(AVFormatContext *s, int64_t pcr)
 {
     MpegTSWrite *ts = s->priv_data;
-    MpegTSService *service;
     uint8_t section[1024], *q, *tot_length_ptr, *desc_len_ptr, *offset_desc_length_ptr;
-    int i, temp_val;
+    int temp_val;
 	unsigned int tot_length;
 
     q = section;
@@ -841,11 +1081,8 @@ static void mpegts_write_tot(AVFormatContext *s)
 	tot_length_ptr = q;
 	q += 2; //Filled later
 
-    *q++ = 0xDD; //UTC-3 byte#0; year
-    *q++ = 0xE2; //UTC-3 byte#1; year
-    *q++ = 0x10; //UTC-3 byte#2; hour
-    *q++ = 0x20; //UTC-3 byte#3; min
-    *q++ = 0x30; //UTC-3 byte#4; sec
+    put_mjd_bcd_time(q, mpegts_tot_time(ts, pcr)); //UTC-3; MJD + BCD hour, min, sec
+    q += 5;
 
 	//Descriptors...	
 	desc_len_ptr = q;
@@ -890,6 +1127,21 @@ static void mpegts_write_tot(AVFormatContext *s)
     mpegts_write_section(&ts->tot, section, tot_length + 3); // Add to tot_len the 1byte TID and the 2byte (flags | section_length)
 }
 
+/* Resend the cached TOT with only its time field and CRC updated;
+ * the whole section fits in the first packet right after the pointer field. */
+static void mpegts_resend_tot(AVFormatContext *s, int64_t pcr)
+{
+    MpegTSWrite *ts = s->priv_data;
+    uint8_t *section = ts->tot.cache + 5;
+    int len = 3 + (AV_RB16(section + 1) & 0xfff);
+    uint32_t crc;
+
+    put_mjd_bcd_time(section + 3, mpegts_tot_time(ts, pcr));
+    crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE), -1, section, len - 4);
+    AV_WB32(section + len - 4, av_bswap32(crc));
+    mpegts_resend_section(&ts->tot);
+}
+
 static MpegTSService *mpegts_add_service(MpegTSWrite *ts,
                                          int sid,
                                          const char *provider_name,
@@ -906,34 +1158,449 @@ static MpegTSService *mpegts_add_service(MpegTSWrite *ts,
     service->sid = sid;
     service->provider_name = av_strdup(provider_name);
     service->name = av_strdup(name);
+    service->service_type = 0x01; /* digital television service */
+    /* service type bits of the ISDB-T service_id, 0x3 is a 1-seg service */
+    service->oneseg = ((sid & 0x18) >> 3) == 0x3;
     service->pcr_pid = 0x1fff;
     dynarray_add(&ts->services, &ts->nb_services, service);
     return service;
 }
 
+/* parse a comma separated list of integers, return the number of entries */
+static int parse_int_list(const char *str, int *list, int max)
+{
+    char *end;
+    int n = 0;
+
+    while (*str) {
+        if (n == max)
+            return AVERROR(EINVAL);
+        list[n++] = strtol(str, &end, 0);
+        if (end == str || (*end && *end != ','))
+            return AVERROR(EINVAL);
+        str = *end ? end + 1 : end;
+    }
+    return n;
+}
+
+static int parse_service_int(AVFormatContext *s, AVDictionary *d, const char *key,
+                             int def, int min, int max, int *val)
+{
+    AVDictionaryEntry *e = av_dict_get(d, key, NULL, 0);
+    char *end;
+
+    if (!e) {
+        *val = def;
+        return 0;
+    }
+    *val = strtol(e->value, &end, 0);
+    if (end == e->value || *end || *val < min || *val > max) {
+        av_log(s, AV_LOG_ERROR, "Invalid service map value %s=%s\n", key, e->value);
+        return AVERROR(EINVAL);
+    }
+    return 0;
+}
+
+/**
+ * Check whether pid is used by a service PMT or by a stream, computing the
+ * stream PIDs the same way as mpegts_init().
+ */
+static int mpegts_pid_taken(AVFormatContext *s, const int *stream_pid, int pid)
+{
+    MpegTSWrite *ts = s->priv_data;
+    int i;
+
+    for (i = 0; i < ts->nb_services; i++)
+        if (ts->services[i]->pmt.pid == pid)
+            return 1;
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+
+        if (st->codec->codec_id == AV_CODEC_ID_MPEG2TS)
+            continue;
+        if (stream_pid[i] >= 0 ? stream_pid[i] == pid :
+            st->id < 16 ? ts->start_pid + i == pid : st->id == pid)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Create the services described by the mpegts_service_map option.
+ *
+ * Services are separated by '|', each one is a ':' separated list of
+ * key=value pairs: sid, name, provider, type, pmt_pid, pcr_pid, oneseg,
+ * streams (comma separated stream indexes) and pids (comma separated
+ * elementary stream PIDs, in the same order as streams).
+ *
+ * @param stream_service service index of each stream, -1 if unassigned
+ * @param stream_pid     PID requested for each stream, -1 if none
+ */
+static int mpegts_parse_service_map(AVFormatContext *s,
+                                    const char *provider_name,
+                                    const char *service_name,
+                                    int *stream_service, int *stream_pid)
+{
+    MpegTSWrite *ts = s->priv_data;
+    MpegTSService *service;
+    AVDictionary *d = NULL;
+    AVDictionaryEntry *e, *provider, *name;
+    char *map, *spec, *saveptr = NULL;
+    int *streams = NULL, *pids = NULL;
+    int i, sid, val, nb_streams, nb_pids, ret = 0;
+
+    map     = av_strdup(ts->service_map);
+    streams = av_malloc_array(s->nb_streams + 1, sizeof(*streams));
+    pids    = av_malloc_array(s->nb_streams + 1, sizeof(*pids));
+    if (!map || !streams || !pids) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    for (spec = av_strtok(map, "|", &saveptr); spec;
+         spec = av_strtok(NULL, "|", &saveptr)) {
+        av_dict_free(&d);
+        if ((ret = av_dict_parse_string(&d, spec, "=", ":", 0)) < 0) {
+            av_log(s, AV_LOG_ERROR, "Invalid service map entry '%s'\n", spec);
+            goto end;
+        }
+        if (!av_dict_get(d, "sid", NULL, 0)) {
+            av_log(s, AV_LOG_ERROR, "Service map entry '%s' has no sid\n", spec);
+            ret = AVERROR(EINVAL);
+            goto end;
+        }
+        if ((ret = parse_service_int(s, d, "sid", 0, 0x0001, 0xffff, &sid)) < 0)
+            goto end;
+        for (i = 0; i < ts->nb_services; i++)
+            if (ts->services[i]->sid == sid) {
+                av_log(s, AV_LOG_ERROR, "Duplicate service id 0x%04x\n", sid);
+                ret = AVERROR(EINVAL);
+                goto end;
+            }
+
+        provider = av_dict_get(d, "provider", NULL, 0);
+        name     = av_dict_get(d, "name", NULL, 0);
+        service  = mpegts_add_service(ts, sid,
+                                      provider ? provider->value : provider_name,
+                                      name     ? name->value     : service_name);
+        if (!service || !service->name || !service->provider_name) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+
+        if ((ret = parse_service_int(s, d, "type",    service->service_type, 0, 0xff,   &service->service_type)) < 0 ||
+            (ret = parse_service_int(s, d, "oneseg",  service->oneseg,       0, 1,      &service->oneseg))       < 0 ||
+            (ret = parse_service_int(s, d, "pmt_pid", -1,                 0x10, 0x1ffe, &service->pmt.pid))      < 0 ||
+            (ret = parse_service_int(s, d, "pcr_pid", service->pcr_pid,   0x10, 0x1fff, &service->pcr_pid))      < 0)
+            goto end;
+        for (i = 0; i < ts->nb_services - 1; i++)
+            if (service->pmt.pid >= 0 && ts->services[i]->pmt.pid == service->pmt.pid) {
+                av_log(s, AV_LOG_ERROR, "Duplicate PMT pid 0x%x\n", service->pmt.pid);
+                ret = AVERROR(EINVAL);
+                goto end;
+            }
+
+        nb_streams = nb_pids = 0;
+        if ((e = av_dict_get(d, "streams", NULL, 0)))
+            nb_streams = parse_int_list(e->value, streams, s->nb_streams);
+        if (nb_streams >= 0 && (e = av_dict_get(d, "pids", NULL, 0)))
+            nb_pids = parse_int_list(e->value, pids, s->nb_streams);
+        if (nb_streams < 0 || nb_pids < 0 || (nb_pids && nb_pids != nb_streams)) {
+            av_log(s, AV_LOG_ERROR, "Invalid stream list for service 0x%04x\n", sid);
+            ret = AVERROR(EINVAL);
+            goto end;
+        }
+        for (i = 0; i < nb_streams; i++) {
+            val = streams[i];
+            if (val < 0 || val >= s->nb_streams || stream_service[val] >= 0) {
+                av_log(s, AV_LOG_ERROR, "Stream %d of service 0x%04x is invalid "
+                       "or already assigned\n", val, sid);
+                ret = AVERROR(EINVAL);
+                goto end;
+            }
+            if (nb_pids && (pids[i] < 16 || pids[i] >= 0x1fff)) {
+                av_log(s, AV_LOG_ERROR, "Invalid pid 0x%x for stream %d\n", pids[i], val);
+                ret = AVERROR(EINVAL);
+                goto end;
+            }
+            stream_service[val] = ts->nb_services - 1;
+            stream_pid[val]     = nb_pids ? pids[i] : -1;
+        }
+    }
+
+    if (!ts->nb_services) {
+        av_log(s, AV_LOG_ERROR, "Empty service map\n");
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+    /* services without an explicit pmt_pid get the derived one, or the next
+     * PID not used by another service or by a stream, skipping the PIDs
+     * reserved for DVB SI tables */
+    for (i = 0; i < ts->nb_services; i++) {
+        int pid;
+
+        service = ts->services[i];
+        if (service->pmt.pid >= 0)
+            continue;
+        pid = 0x1FC8 + (service->sid & 0x03);
+        while (mpegts_pid_taken(s, stream_pid, pid))
+            pid = pid == 0x1ffe ? 0x20 : pid + 1;
+        if (pid != 0x1FC8 + (service->sid & 0x03))
+            av_log(s, AV_LOG_VERBOSE, "Service 0x%04x: PMT pid 0x%x is taken, using 0x%x\n",
+                   service->sid, 0x1FC8 + (service->sid & 0x03), pid);
+        service->pmt.pid = pid;
+    }
+    for (i = 0; i < s->nb_streams; i++)
+        if (stream_service[i] < 0 && s->streams[i]->codec->codec_id != AV_CODEC_ID_MPEG2TS) {
+            av_log(s, AV_LOG_ERROR, "Stream %d is not part of any service\n", i);
+            ret = AVERROR(EINVAL);
+            goto end;
+        }
+
+end:
+    av_dict_free(&d);
+    av_free(map);
+    av_free(streams);
+    av_free(pids);
+    return ret;
+}
+
+/* packets still pending in the batch count as already written */
 static int64_t get_pcr(const MpegTSWrite *ts, AVIOContext *pb)
 {
-    return av_rescale(avio_tell(pb) + 11, 8 * PCR_TIME_BASE, ts->mux_rate) +
+    return av_rescale(avio_tell(pb) + ts->pkt_batch_len + 11, 8 * PCR_TIME_BASE, ts->mux_rate) +
            ts->first_pcr;
 }
 
-static void mpegts_prefix_m2ts_header(AVFormatContext *s)
+/* write out all TS packets gathered so far */
+static void mpegts_flush_batch(AVFormatContext *s)
 {
     MpegTSWrite *ts = s->priv_data;
+
+    if (ts->pkt_batch_len > 0) {
+        avio_write(s->pb, ts->pkt_batch, ts->pkt_batch_len);
+        ts->pkt_batch_len = 0;
+    }
+}
+
+/* Return the next free TS packet of the batch, with its m2ts header
+ * already written if needed, so that packets can be built in place.
+ * Nothing else may be written before mpegts_commit_ts_packet(). */
+static uint8_t *mpegts_get_ts_packet(AVFormatContext *s)
+{
+    MpegTSWrite *ts = s->priv_data;
+    uint8_t *q = ts->pkt_batch + ts->pkt_batch_len;
+
     if (ts->m2ts_mode) {
-        int64_t pcr = get_pcr(s->priv_data, s->pb);
-        uint32_t tp_extra_header = pcr % 0x3fffffff;
-        tp_extra_header = AV_RB32(&tp_extra_header);
-        avio_write(s->pb, (unsigned char *) &tp_extra_header,
-                sizeof(tp_extra_header));
+        int64_t pcr = get_pcr(ts, s->pb);
+        AV_WB32(q, pcr % 0x3fffffff);
+        q += 4;
     }
+    return q;
+}
+
+/* Queue the packet returned by mpegts_get_ts_packet() for output;
+ * the batch is written out in one avio_write() once it is full. */
+static void mpegts_commit_ts_packet(AVFormatContext *s)
+{
+    MpegTSWrite *ts = s->priv_data;
+    int packet_size = TS_PACKET_SIZE + 4 * !!ts->m2ts_mode;
+
+    ts->pkt_batch_len += packet_size;
+    if (ts->pkt_batch_len >= ts->pkt_batch_size * packet_size)
+        mpegts_flush_batch(s);
+}
+
+/* Queue a single TS packet (with its m2ts header if needed) for output */
+static void mpegts_write_ts_packet(AVFormatContext *s, const uint8_t *packet)
+{
+    memcpy(mpegts_get_ts_packet(s), packet, TS_PACKET_SIZE);
+    mpegts_commit_ts_packet(s);
 }
 
 static void section_write_packet(MpegTSSection *s, const uint8_t *packet)
 {
     AVFormatContext *ctx = s->opaque;
-    mpegts_prefix_m2ts_header(ctx);
-    avio_write(ctx->pb, packet, TS_PACKET_SIZE);
+    mpegts_write_ts_packet(ctx, packet);
+}
+
+/* Set up the T-STD buffer model of a stream; rates and sizes follow
+ * ISO 13818-1 2.4.2.3, falling back to the mux rate when the stream
+ * does not tell its own. */
+static int tstd_init_stream(AVFormatContext *s, AVStream *st)
+{
+    MpegTSWrite *ts = s->priv_data;
+    TSTDBuffer *b = &((MpegTSWriteStream *)st->priv_data)->tstd;
+    int64_t rmax;
+
+    b->packets = av_fifo_alloc(16 * sizeof(TSTDPacket));
+    b->units   = av_fifo_alloc(16 * sizeof(TSTDUnit));
+    if (!b->packets || !b->units)
+        return AVERROR(ENOMEM);
+
+    b->tb_size = 512;
+    switch (st->codec->codec_type) {
+    case AVMEDIA_TYPE_VIDEO:
+        rmax = st->codec->rc_max_rate ? st->codec->rc_max_rate :
+               st->codec->bit_rate    ? st->codec->bit_rate    : ts->mux_rate;
+        b->leak_rate = rmax * 12 / (10 * 8);
+        if (st->codec->rc_buffer_size)
+            b->bs_size = st->codec->rc_buffer_size / 8;
+        else
+            b->bs_size = FFMAX(1835008 / 8, av_rescale(ts->mux_rate / 8, s->max_delay, AV_TIME_BASE));
+        b->bs_size += rmax / (8 * 250); /* BSmux, 4 ms at Rmax */
+        break;
+    case AVMEDIA_TYPE_AUDIO:
+        b->leak_rate = 2000000 / 8;
+        b->bs_size   = 3584;
+        break;
+    default:
+        b->leak_rate = 1000000 / 8;
+        b->bs_size   = 24576;
+        break;
+    }
+    b->bs_size    = FFMAX(b->bs_size, ts->pes_payload_size + TS_PACKET_SIZE);
+    b->last_cc    = 15;
+    b->min_margin = INT64_MAX;
+    return 0;
+}
+
+/* Parse the AudioSpecificConfig of a raw AAC stream so that its packets
+ * can be framed as ADTS or LATM/LOAS when they are written. */
+static int aac_framer_init(AVFormatContext *s, AVStream *st)
+{
+    MpegTSWrite *ts = s->priv_data;
+    AACFramer *f = &((MpegTSWriteStream *)st->priv_data)->aac;
+    AVCodecContext *avctx = st->codec;
+    int ret;
+
+    if (ts->flags & MPEGTS_FLAG_AAC_LATM)
+        ret = ff_latm_decode_extradata(s, &f->latm, avctx->extradata,
+                                       avctx->extradata_size);
+    else
+        ret = ff_adts_decode_extradata(s, &f->adts, avctx->extradata,
+                                       avctx->extradata_size);
+    if (ret < 0)
+        return ret;
+    f->enabled = 1;
+    return 0;
+}
+
+/* Write the ADTS header (and the pending PCE) of a raw AAC frame of
+ * the given size to hdr; the frame itself is not touched.
+ * Returns the header size. */
+static int aac_write_adts_header(AVFormatContext *s, AACFramer *f,
+                                 uint8_t *hdr, int size)
+{
+    int ret = ff_adts_write_frame_header(s, &f->adts, hdr, size, f->adts.pce_size);
+
+    if (ret < 0)
+        return ret;
+    if (f->adts.pce_size) {
+        memcpy(hdr + ADTS_HEADER_SIZE, f->adts.pce_data, f->adts.pce_size);
+        ret = f->adts.pce_size;
+        f->adts.pce_size = 0;
+    }
+    return ADTS_HEADER_SIZE + ret;
+}
+
+/* Build a LOAS AudioSyncStream frame around a raw AAC frame in f->buf,
+ * repeating the StreamMuxConfig every latm_smc_interval frames.
+ * The payload is not byte-aligned in an AudioMuxElement, so unlike
+ * ADTS it has to be copied. Returns the LOAS frame size. */
+static int aac_write_latm_frame(AVFormatContext *s, AVStream *st,
+                                const uint8_t *data, int size)
+{
+    MpegTSWrite *ts = s->priv_data;
+    AACFramer *f = &((MpegTSWriteStream *)st->priv_data)->aac;
+    AVCodecContext *avctx = st->codec;
+    PutBitContext pb;
+    int len;
+
+    if (size > LATM_MAX_FRAME_BYTES)
+        goto too_large;
+
+    av_fast_malloc(&f->buf, &f->buf_size,
+                   3 + size + 1024 + LATM_MAX_EXTRADATA_SIZE);
+    if (!f->buf)
+        return AVERROR(ENOMEM);
+    init_put_bits(&pb, f->buf + 3, f->buf_size - 3);
+
+    /* AudioMuxElement(1) */
+    put_bits(&pb, 1, !!f->smc_counter);  /* useSameStreamMux */
+    if (!f->smc_counter)
+        ff_latm_write_stream_mux_config(&pb, &f->latm, avctx->extradata,
+                                        avctx->extradata_size);
+    f->smc_counter = (f->smc_counter + 1) % ts->latm_smc_interval;
+
+    ff_latm_write_payload(&pb, data, size);
+
+    avpriv_align_put_bits(&pb);
+    flush_put_bits(&pb);
+
+    len = put_bits_count(&pb) >> 3;
+    if (len > LATM_MAX_FRAME_BYTES)
+        goto too_large;
+
+    /* AudioSyncStream() */
+    f->buf[0] = 0x56;
+    f->buf[1] = 0xe0 | (len >> 8);
+    f->buf[2] = len & 0xff;
+    return len + 3;
+
+too_large:
+    av_log(s, AV_LOG_ERROR, "LATM packet size larger than maximum size 0x1fff\n");
+    return AVERROR_INVALIDDATA;
+}
+
+/* Set up the forwarding of MPEG-TS streams; passthrough_pids lists the
+ * input PIDs to forward as in[=out] entries, every elementary stream of
+ * the input is forwarded with its own PID if it is not set. */
+static int passthrough_init(AVFormatContext *s)
+{
+    MpegTSWrite *ts = s->priv_data;
+    TSPassthrough *tp;
+    const char *p = ts->passthrough_pids;
+    char *end;
+    long in, out;
+
+    tp = ts->passthrough = av_mallocz(sizeof(*tp));
+    if (!tp)
+        return AVERROR(ENOMEM);
+    memset(tp->req_pid, -1, sizeof(tp->req_pid));
+    memset(tp->out_pid, -1, sizeof(tp->out_pid));
+    tp->pat.size    = -1;
+    tp->pat_version = -1;
+
+    while (p && *p) {
+        in = out = strtol(p, &end, 0);
+        if (end != p && *end == '=') {
+            p   = end + 1;
+            out = strtol(p, &end, 0);
+        }
+        if (end == p || (*end && *end != ',') ||
+            in < 0x10 || in >= 0x1fff || out < 0x10 || out >= 0x1fff) {
+            av_log(s, AV_LOG_ERROR, "Invalid passthrough_pids '%s'\n", ts->passthrough_pids);
+            return AVERROR(EINVAL);
+        }
+        tp->req_pid[in] = out;
+        tp->nb_req_pids++;
+        p = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+static void passthrough_free(MpegTSWrite *ts)
+{
+    TSPassthrough *tp = ts->passthrough;
+    int i;
+
+    if (!tp)
+        return;
+    for (i = 0; i < tp->nb_programs; i++)
+        av_free(tp->programs[i]);
+    av_free(tp->programs);
+    av_freep(&ts->passthrough);
 }
 
 static int mpegts_write_header(AVFormatContext *s)
@@ -946,7 +1613,7 @@ static int mpegts_write_header(AVFormatContext *s)
     int i, j;
     const char *service_name;
     const char *provider_name;
-    int *pids;
+    int *pids = NULL, *stream_service = NULL, *stream_pid = NULL;
     int ret;
 	int calculated_HD_service_ID, calculated_LD_service_ID;
 
@@ -969,6 +1636,21 @@ static int mpegts_write_header(AVFormatContext *s)
     provider = av_dict_get(s->metadata, "service_provider", NULL, 0);
     provider_name = provider ? provider->value : DEFAULT_PROVIDER_NAME;
 
+    stream_service = av_malloc_array(s->nb_streams + 1, sizeof(*stream_service));
+    stream_pid     = av_malloc_array(s->nb_streams + 1, sizeof(*stream_pid));
+    if (!stream_service || !stream_pid) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (i = 0; i < s->nb_streams; i++)
+        stream_service[i] = stream_pid[i] = -1;
+
+    if (ts->service_map) {
+        ret = mpegts_parse_service_map(s, provider_name, service_name,
+                                       stream_service, stream_pid);
+        if (ret < 0)
+            goto fail;
+    } else {
 	switch (ts->transmission_profile) {
 
 	case 1://One HD service and one LD service
@@ -978,17 +1660,11 @@ static int mpegts_write_header(AVFormatContext *s)
 		calculated_HD_service_ID = ( ts->onid & 0x7FF ) << 5 | 0x0 << 3 | 0x0;
 
 	    service = mpegts_add_service(ts, calculated_HD_service_ID, provider_name, service_name);
-	    service->pmt.write_packet = section_write_packet;
-	    service->pmt.opaque = s;
-	    service->pmt.cc = 15;
 
 		calculated_LD_service_ID = 0x0000; //Initialization necessary?
 		calculated_LD_service_ID = ( ts->onid & 0x7FF ) << 5 | 0x3 << 3 | 0x1;
 
 		service = mpegts_add_service(ts, calculated_LD_service_ID, provider_name, service_name);
-		service->pmt.write_packet = section_write_packet;
-		service->pmt.opaque = s;
-		service->pmt.cc = 15;
 
 		ts->final_nb_services = 2;
 	break;
@@ -997,6 +1673,21 @@ static int mpegts_write_header(AVFormatContext *s)
 	break;
 	}
 
+    if (ts->nb_services != ts->final_nb_services) {
+        ret = ts->nb_services ? AVERROR(ENOMEM) : AVERROR_PATCHWELCOME;
+        goto fail;
+    }
+    for (i = 0; i < s->nb_streams; i++)
+        stream_service[i] = i % ts->nb_services;
+    }
+
+    for (i = 0; i < ts->nb_services; i++) {
+        service = ts->services[i];
+        service->pmt.write_packet = section_write_packet;
+        service->pmt.opaque = s;
+        service->pmt.cc = 15;
+    }
+
 
 //    for(i = 0;i < ts->final_nb_services; i++) {
 //	    service = mpegts_add_service(ts, ts->service_id+i, provider_name, service_name);
@@ -1028,9 +1719,17 @@ static int mpegts_write_header(AVFormatContext *s)
     ts->tot.write_packet = section_write_packet;
     ts->tot.opaque = s;
 
+    ts->tot_first_pcr = -1;
+    if (s->nb_streams && s->streams[0]->codec->flags & CODEC_FLAG_BITEXACT)
+        ts->tot_base_time = TOT_BITEXACT_TIME;
+    else
+        ts->tot_base_time = av_gettime() / 1000000;
+
     pids = av_malloc(s->nb_streams * sizeof(*pids));
-    if (!pids)
-        return AVERROR(ENOMEM);
+    if (!pids) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
 
     /* assign pids to each stream */
     for(i = 0;i < s->nb_streams; i++) {
@@ -1048,11 +1747,28 @@ static int mpegts_write_header(AVFormatContext *s)
             goto fail;
         }
 
-	ts_st->service = ts->services[i % ts->final_nb_services] ; //TODO Potential point to modify the stream's owners.
+        ts_st->service = ts->services[FFMAX(stream_service[i], 0)];
+
+        if (st->codec->codec_id == AV_CODEC_ID_MPEG2TS) {
+            /* forwarded packets keep their own PIDs, see passthrough_update_layout();
+             * the PIDs of several inputs could collide */
+            if (ts->passthrough) {
+                av_log(s, AV_LOG_ERROR, "Only one MPEG-TS stream can be forwarded\n");
+                ret = AVERROR(EINVAL);
+                goto fail;
+            }
+            if ((ret = passthrough_init(s)) < 0)
+                goto fail;
+            ts_st->pid = 0x1fff;
+            pids[i] = -1;
+            continue;
+        }
 
         /* MPEG pid values < 16 are reserved. Applications which set st->id in
          * this range are assigned a calculated pid. */
-        if (st->id < 16) {
+        if (stream_pid[i] >= 0) {
+            ts_st->pid = stream_pid[i];
+        } else if (st->id < 16) {
             ts_st->pid = ts->start_pid + i;
         } else if (st->id < 0x1FFF) {
             ts_st->pid = st->id;
@@ -1061,11 +1777,12 @@ static int mpegts_write_header(AVFormatContext *s)
             ret = AVERROR(EINVAL);
             goto fail;
         }
-        if (ts_st->pid == ts_st->service->pmt.pid) {
-            av_log(s, AV_LOG_ERROR, "Duplicate stream id %d\n", ts_st->pid);
-            ret = AVERROR(EINVAL);
-            goto fail;
-        }
+        for (j = 0; j < ts->nb_services; j++)
+            if (ts_st->pid == ts->services[j]->pmt.pid) {
+                av_log(s, AV_LOG_ERROR, "Duplicate stream id %d\n", ts_st->pid);
+                ret = AVERROR(EINVAL);
+                goto fail;
+            }
         for (j = 0; j < i; j++)
             if (pids[j] == ts_st->pid) {
                 av_log(s, AV_LOG_ERROR, "Duplicate stream id %d\n", ts_st->pid);
@@ -1081,101 +1798,129 @@ static int mpegts_write_header(AVFormatContext *s)
         if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO &&
             ts_st->service->pcr_pid == 0x1fff) {
             ts_st->service->pcr_pid = ts_st->pid;
-            pcr_st = st;
         }
         if (st->codec->codec_id == AV_CODEC_ID_AAC &&
-            st->codec->extradata_size > 0)
-        {
-            AVStream *ast;
-            ts_st->amux = avformat_alloc_context();
-            if (!ts_st->amux) {
-                ret = AVERROR(ENOMEM);
-                goto fail;
-            }
-            ts_st->amux->oformat = av_guess_format((ts->flags & MPEGTS_FLAG_AAC_LATM) ? "latm" : "adts", NULL, NULL);
-            if (!ts_st->amux->oformat) {
-                ret = AVERROR(EINVAL);
-                goto fail;
-            }
-            ast = avformat_new_stream(ts_st->amux, NULL);
-            ret = avcodec_copy_context(ast->codec, st->codec);
-            if (ret != 0)
-                goto fail;
-            ret = avformat_write_header(ts_st->amux, NULL);
-            if (ret < 0)
-                goto fail;
-        }
+            st->codec->extradata_size > 0 &&
+            (ret = aac_framer_init(s, st)) < 0)
+            goto fail;
     }
 
-    av_free(pids);
+    av_freep(&pids);
+    av_freep(&stream_service);
+    av_freep(&stream_pid);
 
-    /* if no video stream, use the first stream as PCR */
-    if (ts_st->service->pcr_pid == 0x1fff && s->nb_streams > 0) {
-        pcr_st = s->streams[0];
-        ts_st = pcr_st->priv_data;
-        ts_st->service->pcr_pid = ts_st->pid;
+    if ((ts->flags & MPEGTS_FLAG_TSTD) && ts->passthrough) {
+        av_log(s, AV_LOG_WARNING, "T-STD scheduling is not supported with forwarded MPEG-TS streams, disabled\n");
+        ts->flags &= ~MPEGTS_FLAG_TSTD;
+    }
+    if ((ts->flags & MPEGTS_FLAG_TSTD) && ts->mux_rate <= 1) {
+        av_log(s, AV_LOG_WARNING, "T-STD scheduling requires a muxrate, disabled\n");
+        ts->flags &= ~MPEGTS_FLAG_TSTD;
+    }
+    if (ts->flags & MPEGTS_FLAG_TSTD) {
+        for (i = 0; i < s->nb_streams; i++)
+            if ((ret = tstd_init_stream(s, s->streams[i])) < 0)
+                goto fail;
+        for (i = 0; i < ts->nb_services; i++)
+            ts->services[i]->last_pcr = AV_NOPTS_VALUE;
     }
 
     if (ts->mux_rate > 1) {
-        ts_st->service->pcr_packet_period = (ts->mux_rate * PCR_RETRANS_TIME) /
-            (TS_PACKET_SIZE * 8 * 1000);
-        ts->sdt_packet_period      = (ts->mux_rate * SDT_RETRANS_TIME) /
-            (TS_PACKET_SIZE * 8 * 1000);
-		ts->nit_packet_period      = (ts->mux_rate * NIT_RETRANS_TIME) /
-             (TS_PACKET_SIZE * 8 * 1000);
-        ts->pat_packet_period      = (ts->mux_rate * PAT_RETRANS_TIME) /
-            (TS_PACKET_SIZE * 8 * 1000);
-        ts->tot_packet_period      = (ts->mux_rate * TOT_RETRANS_TIME) /
-            (TS_PACKET_SIZE * 8 * 1000);
-
-
-    //TODO Add something to new tables here.
+        ts->packet_pcr_duration = av_rescale(TS_PACKET_SIZE * 8, PCR_TIME_BASE, ts->mux_rate);
 
         if(ts->copyts < 1)
             ts->first_pcr = av_rescale(s->max_delay, PCR_TIME_BASE, AV_TIME_BASE);
-    } else {
-        /* Arbitrary values, PAT/PMT will also be written on video key frames */
-        ts->sdt_packet_period = 200;
-        ts->nit_packet_period = 200;
-        ts->tot_packet_period = 200;
-        ts->pat_packet_period = 40;
-	//TODO Add something to new tables here.
-        if (pcr_st->codec->codec_type == AVMEDIA_TYPE_AUDIO) {
-            if (!pcr_st->codec->frame_size) {
-                av_log(s, AV_LOG_WARNING, "frame size not set\n");
-                ts_st->service->pcr_packet_period =
-                    pcr_st->codec->sample_rate/(10*512);
-            } else {
-                ts_st->service->pcr_packet_period =
-                    pcr_st->codec->sample_rate/(10*pcr_st->codec->frame_size);
-            }
-        } else {
-            // max delta PCR 0.1s
-            ts_st->service->pcr_packet_period =
-                pcr_st->codec->time_base.den/(10*pcr_st->codec->time_base.num);
-        }
-        if(!ts_st->service->pcr_packet_period)
-            ts_st->service->pcr_packet_period = 1;
     }
 
-    // output a PCR as soon as possible
-    ts_st->service->pcr_packet_count = ts_st->service->pcr_packet_period;
-    ts->pat_packet_count = ts->pat_packet_period-1;
-    ts->sdt_packet_count = ts->sdt_packet_period-1;
-    ts->nit_packet_count = ts->nit_packet_period-1;
-    ts->tot_packet_count = ts->tot_packet_period-1;
-
     if (ts->mux_rate == 1)
         av_log(s, AV_LOG_VERBOSE, "muxrate VBR, ");
     else
         av_log(s, AV_LOG_VERBOSE, "muxrate %d, ", ts->mux_rate);
-    av_log(s, AV_LOG_VERBOSE, "pcr every %d pkts, "
-           "sdt every %d, nit every %d pkts,"
-	   "pat/pmt every %d pkts\n",
-           ts_st->service->pcr_packet_period,
-           ts->sdt_packet_period,
-	   ts->nit_packet_period,
-	   ts->pat_packet_period);
+    av_log(s, AV_LOG_VERBOSE, "pat every %g s, pmt every %g s, sdt every %g s, "
+           "nit every %g s, tot every %g s\n",
+           ts->pat_period, ts->pmt_period, ts->sdt_period,
+           ts->nit_period, ts->tot_period);
+
+    /* Without a service map, only the services with a video stream carry a
+     * PCR, plus the service of the first stream if the service of the last
+     * one has none; the others signal PCR pid 0x1fff. */
+    if (!ts->service_map && s->nb_streams > 0) {
+        ts_st = s->streams[s->nb_streams - 1]->priv_data;
+        if (ts_st->service->pcr_pid == 0x1fff) {
+            ts_st = s->streams[0]->priv_data;
+            ts_st->service->pcr_pid = ts_st->pid;
+        }
+    }
+
+    for (i = 0; i < ts->nb_services; i++) {
+        service = ts->services[i];
+
+        /* with a service map, if no video stream, use the first stream of
+         * the service as PCR */
+        pcr_st = NULL;
+        for (j = 0; j < s->nb_streams; j++) {
+            ts_st = s->streams[j]->priv_data;
+            if (ts_st->service != service ||
+                s->streams[j]->codec->codec_id == AV_CODEC_ID_MPEG2TS)
+                continue;
+            if (service->pcr_pid == 0x1fff && ts->service_map)
+                service->pcr_pid = ts_st->pid;
+            if (ts_st->pid == service->pcr_pid) {
+                pcr_st = s->streams[j];
+                break;
+            }
+        }
+        if (!pcr_st) {
+            /* the PCR of the forwarded programs is used */
+            if (ts->passthrough)
+                continue;
+            if (service->pcr_pid != 0x1fff) {
+                av_log(s, AV_LOG_ERROR, "PCR pid 0x%x of service 0x%04x is not "
+                       "one of its streams\n", service->pcr_pid, service->sid);
+                ret = AVERROR(EINVAL);
+                goto fail;
+            }
+            if (ts->service_map)
+                av_log(s, AV_LOG_WARNING, "Service 0x%04x has no streams\n", service->sid);
+            continue;
+        }
+
+        if (ts->mux_rate > 1) {
+            service->pcr_packet_period = (ts->mux_rate * PCR_RETRANS_TIME) /
+                (TS_PACKET_SIZE * 8 * 1000);
+        } else {
+            /* SI tables follow the timestamps being muxed, PAT/PMT will also be written on video key frames */
+            if (pcr_st->codec->codec_type == AVMEDIA_TYPE_AUDIO) {
+                if (!pcr_st->codec->frame_size) {
+                    av_log(s, AV_LOG_WARNING, "frame size not set\n");
+                    service->pcr_packet_period =
+                        pcr_st->codec->sample_rate/(10*512);
+                } else {
+                    service->pcr_packet_period =
+                        pcr_st->codec->sample_rate/(10*pcr_st->codec->frame_size);
+                }
+            } else {
+                // max delta PCR 0.1s
+                service->pcr_packet_period =
+                    pcr_st->codec->time_base.den/(10*pcr_st->codec->time_base.num);
+            }
+            if(!service->pcr_packet_period)
+                service->pcr_packet_period = 1;
+        }
+
+        // output a PCR as soon as possible
+        service->pcr_packet_count = service->pcr_packet_period;
+
+        av_log(s, AV_LOG_VERBOSE, "service 0x%04x: pmt pid 0x%x, pcr pid 0x%x every %d pkts\n",
+               service->sid, service->pmt.pid, service->pcr_pid, service->pcr_packet_period);
+    }
+
+    // and all SI tables with the first packet
+    ts->last_pat_pcr = AV_NOPTS_VALUE;
+    ts->last_pmt_pcr = AV_NOPTS_VALUE;
+    ts->last_sdt_pcr = AV_NOPTS_VALUE;
+    ts->last_nit_pcr = AV_NOPTS_VALUE;
+    ts->last_tot_pcr = AV_NOPTS_VALUE;
 
     if (ts->m2ts_mode == -1) {
         if (av_match_ext(s->filename, "m2ts")) {
@@ -1185,58 +1930,106 @@ static int mpegts_write_header(AVFormatContext *s)
         }
     }
 
+    ts->pkt_batch = av_malloc(ts->pkt_batch_size * (TS_PACKET_SIZE + 4));
+    if (!ts->pkt_batch) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
     avio_flush(s->pb);
 
     return 0;
 
  fail:
     av_free(pids);
+    av_free(stream_service);
+    av_free(stream_pid);
     for(i = 0;i < s->nb_streams; i++) {
         MpegTSWriteStream *ts_st;
         st = s->streams[i];
         ts_st = st->priv_data;
         if (ts_st) {
             av_freep(&ts_st->payload);
-            if (ts_st->amux) {
-                avformat_free_context(ts_st->amux);
-                ts_st->amux = NULL;
-            }
+            av_fifo_free(ts_st->tstd.packets);
+            av_fifo_free(ts_st->tstd.units);
+            av_freep(&ts_st->aac.buf);
         }
         av_freep(&st->priv_data);
     }
+    passthrough_free(ts);
+    av_freep(&ts->pkt_batch);
     return ret;
 }
 
-/* send SDT, PAT and PMT tables regulary */
-static void retransmit_si_info(AVFormatContext *s, int force_pat)
+/* the cached packets of a table can be resent as long as its version did not change */
+static int section_cached(const MpegTSWrite *ts, const MpegTSSection *sec)
+{
+    return sec->cache_size && sec->cache_version == ts->tables_version;
+}
+
+/* Check whether a table last sent at *last_pcr is due at the mux clock pcr.
+ * A table is sent with the last packet that still keeps it within its
+ * repetition interval. */
+static int si_table_due(const MpegTSWrite *ts, int64_t *last_pcr, double period, int64_t pcr)
+{
+    if (*last_pcr != AV_NOPTS_VALUE &&
+        pcr >= *last_pcr &&
+        pcr + ts->packet_pcr_duration < *last_pcr + (int64_t)(period * PCR_TIME_BASE))
+        return 0;
+    *last_pcr = pcr;
+    return 1;
+}
+
+/* send PAT, PMT, SDT, NIT and TOT tables regulary, scheduled on the mux clock;
+ * tables are built once and then resent from their cache */
+static void retransmit_si_info(AVFormatContext *s, int force_pat, int64_t pcr)
 {
     MpegTSWrite *ts = s->priv_data;
     int i;
 
-    if (++ts->sdt_packet_count == ts->sdt_packet_period) {
-        ts->sdt_packet_count = 0;
-        mpegts_write_sdt(s);
-    }
-    
-    //av_log(s, AV_LOG_VERBOSE, "Entering retransmit si info, nit\n");
-    if (++ts->nit_packet_count == ts->nit_packet_period) {
-        ts->nit_packet_count = 0;
-        mpegts_write_nit(s);
+    if (force_pat) {
+        ts->last_pat_pcr = AV_NOPTS_VALUE;
+        ts->last_pmt_pcr = AV_NOPTS_VALUE;
     }
 
-    //av_log(s, AV_LOG_VERBOSE, "Entering retransmit si info, tot\n");
-    if (++ts->tot_packet_count == ts->tot_packet_period) {
-        ts->tot_packet_count = 0;
-        mpegts_write_tot(s);
+    if (si_table_due(ts, &ts->last_pat_pcr, ts->pat_period, pcr)) {
+        if (section_cached(ts, &ts->pat))
+            mpegts_resend_section(&ts->pat);
+        else
+            mpegts_write_pat(s);
     }
 
-    if (++ts->pat_packet_count == ts->pat_packet_period || force_pat) {
-        ts->pat_packet_count = 0;
-        mpegts_write_pat(s);
+    if (si_table_due(ts, &ts->last_pmt_pcr, ts->pmt_period, pcr)) {
         for(i = 0; i < ts->nb_services; i++) {
-            mpegts_write_pmt(s, ts->services[i]);
+            if (section_cached(ts, &ts->services[i]->pmt))
+                mpegts_resend_section(&ts->services[i]->pmt);
+            else
+                mpegts_write_pmt(s, ts->services[i]);
         }
     }
+
+    if (si_table_due(ts, &ts->last_sdt_pcr, ts->sdt_period, pcr)) {
+        if (section_cached(ts, &ts->sdt))
+            mpegts_resend_section(&ts->sdt);
+        else
+            mpegts_write_sdt(s);
+    }
+
+    //av_log(s, AV_LOG_VERBOSE, "Entering retransmit si info, nit\n");
+    if (si_table_due(ts, &ts->last_nit_pcr, ts->nit_period, pcr)) {
+        if (section_cached(ts, &ts->nit))
+            mpegts_resend_section(&ts->nit);
+        else
+            mpegts_write_nit(s);
+    }
+
+    //av_log(s, AV_LOG_VERBOSE, "Entering retransmit si info, tot\n");
+    if (si_table_due(ts, &ts->last_tot_pcr, ts->tot_period, pcr)) {
+        if (ts->tot.cache_size)
+            mpegts_resend_tot(s, pcr);
+        else
+            mpegts_write_tot(s, pcr);
+    }
 }
 
 static int write_pcr_bits(uint8_t *buf, int64_t pcr)
@@ -1253,6 +2046,20 @@ static int write_pcr_bits(uint8_t *buf, int64_t pcr)
     return 6;
 }
 
+/* Current position of the mux clock in PCR units: derived from the amount of
+ * data written in CBR mode, from the timestamps being muxed in VBR mode. */
+static int64_t mpegts_get_clock(AVFormatContext *s, int64_t dts)
+{
+    MpegTSWrite *ts = s->priv_data;
+
+    if (ts->mux_rate > 1)
+        ts->last_clock = get_pcr(ts, s->pb);
+    else if (dts != AV_NOPTS_VALUE)
+        ts->last_clock = FFMAX(ts->last_clock,
+                               (dts - av_rescale(s->max_delay, 90000, AV_TIME_BASE)) * 300);
+    return ts->last_clock;
+}
+
 /* Write a single null transport stream packet */
 static void mpegts_insert_null_packet(AVFormatContext *s)
 {
@@ -1265,12 +2072,11 @@ static void mpegts_insert_null_packet(AVFormatContext *s)
     *q++ = 0xff;
     *q++ = 0x10;
     memset(q, 0x0FF, TS_PACKET_SIZE - (q - buf));
-    mpegts_prefix_m2ts_header(s);
-    avio_write(s->pb, buf, TS_PACKET_SIZE);
+    mpegts_write_ts_packet(s, buf);
 }
 
 /* Write a single transport stream packet with a PCR and no payload */
-static void mpegts_insert_pcr_only(AVFormatContext *s, AVStream *st)
+static void mpegts_insert_pcr_only(AVFormatContext *s, AVStream *st, int cc)
 {
     MpegTSWrite *ts = s->priv_data;
     MpegTSWriteStream *ts_st = st->priv_data;
@@ -1281,7 +2087,7 @@ static void mpegts_insert_pcr_only(AVFormatContext *s, AVStream *st)
     *q++ = 0x47;
     *q++ = ts_st->pid >> 8;
     *q++ = ts_st->pid;
-    *q++ = 0x20 | ts_st->cc;   /* Adaptation only */
+    *q++ = 0x20 | cc;          /* Adaptation only */
     /* Continuity Count field does not increment (see 13818-1 section 2.4.3.3) */
     *q++ = TS_PACKET_SIZE - 5; /* Adaptation Field Length */
     *q++ = 0x10;               /* Adaptation flags: PCR present */
@@ -1291,8 +2097,7 @@ static void mpegts_insert_pcr_only(AVFormatContext *s, AVStream *st)
 
     /* stuffing bytes */
     memset(q, 0xFF, TS_PACKET_SIZE - (q - buf));
-    mpegts_prefix_m2ts_header(s);
-    avio_write(s->pb, buf, TS_PACKET_SIZE);
+    mpegts_write_ts_packet(s, buf);
 }
 
 static void write_pts(uint8_t *q, int fourbits, int64_t pts)
@@ -1342,52 +2147,242 @@ static uint8_t *get_ts_payload_start(uint8_t *pkt)
         return pkt + 4;
 }
 
-/* Add a pes header to the front of payload, and segment into an integer number of
- * ts packets. The final ts packet is padded using an over-sized adaptation header
- * to exactly fill the last ts packet.
- * NOTE: 'payload' contains a complete PES payload.
+/* Let TB leak and remove the access units whose dts has passed from B */
+static void tstd_update(TSTDBuffer *b, int64_t pcr)
+{
+    if (pcr > b->last_update) {
+        b->tb_fill = FFMAX(0, b->tb_fill - b->leak_rate * (pcr - b->last_update));
+        b->last_update = pcr;
+    }
+    /* entries never wrap around the fifo end, the fifo sizes are
+     * multiples of the entry sizes */
+    while (av_fifo_size(b->units)) {
+        const TSTDUnit *unit = (const TSTDUnit *)av_fifo_peek2(b->units, 0);
+        if (unit->dts != AV_NOPTS_VALUE && unit->dts * 300 > pcr)
+            break;
+        b->bs_fill = FFMAX(0, b->bs_fill - unit->size);
+        av_fifo_drain(b->units, sizeof(*unit));
+    }
+}
+
+static int tstd_queue_packet(TSTDBuffer *b, const uint8_t *buf, int payload, int64_t dts)
+{
+    TSTDPacket pkt;
+
+    if (av_fifo_space(b->packets) < sizeof(pkt) &&
+        av_fifo_realloc2(b->packets, 2 * av_fifo_size(b->packets)) < 0)
+        return AVERROR(ENOMEM);
+    pkt.dts     = dts;
+    pkt.payload = payload;
+    memcpy(pkt.data, buf, TS_PACKET_SIZE);
+    av_fifo_generic_write(b->packets, &pkt, sizeof(pkt), NULL);
+    b->unit_size += payload;
+    return 0;
+}
+
+/* the access unit just packetized enters B once its last byte arrived */
+static int tstd_queue_unit(TSTDBuffer *b, int64_t dts)
+{
+    TSTDUnit unit = { dts, b->unit_size };
+
+    if (av_fifo_space(b->units) < sizeof(unit) &&
+        av_fifo_realloc2(b->units, 2 * av_fifo_size(b->units)) < 0)
+        return AVERROR(ENOMEM);
+    av_fifo_generic_write(b->units, &unit, sizeof(unit), NULL);
+    b->unit_size = 0;
+    return 0;
+}
+
+static int tstd_pending(AVFormatContext *s)
+{
+    int i;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        MpegTSWriteStream *ts_st = s->streams[i]->priv_data;
+        if (av_fifo_size(ts_st->tstd.packets))
+            return 1;
+    }
+    return 0;
+}
+
+/* Fill the next packet slot of the CBR multiplex: due SI tables and PCR
+ * first, then the queued packet with the earliest deadline that fits into
+ * its buffers, null packets when nothing can be sent. */
+static void tstd_send_slot(AVFormatContext *s)
+{
+    MpegTSWrite *ts = s->priv_data;
+    int64_t delay = av_rescale(s->max_delay, 90000, AV_TIME_BASE);
+    int64_t pcr_period = PCR_RETRANS_TIME * (PCR_TIME_BASE / 1000);
+    int64_t pcr, best_dts = 0;
+    AVStream *best = NULL;
+    TSTDPacket pkt;
+    int i;
+
+    retransmit_si_info(s, 0, get_pcr(ts, s->pb));
+    pcr = get_pcr(ts, s->pb);
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        MpegTSWriteStream *ts_st = st->priv_data;
+        MpegTSService *service = ts_st->service;
+
+        if (ts_st->pid != service->pcr_pid)
+            continue;
+        if (service->last_pcr == AV_NOPTS_VALUE ||
+            pcr + ts->packet_pcr_duration >= service->last_pcr + pcr_period) {
+            if (service->last_pcr != AV_NOPTS_VALUE)
+                ts->tstd_max_pcr_interval = FFMAX(ts->tstd_max_pcr_interval,
+                                                  pcr - service->last_pcr);
+            service->last_pcr = pcr;
+            mpegts_insert_pcr_only(s, st, ts_st->tstd.last_cc);
+            return;
+        }
+    }
+
+    for (i = 0; i < s->nb_streams; i++) {
+        TSTDBuffer *b = &((MpegTSWriteStream *)s->streams[i]->priv_data)->tstd;
+        int64_t dts;
+
+        if (!av_fifo_size(b->packets))
+            continue;
+        tstd_update(b, pcr);
+        dts = ((const TSTDPacket *)av_fifo_peek2(b->packets, 0))->dts;
+        if (dts != AV_NOPTS_VALUE && (dts - delay) * 300 > pcr)
+            continue;
+        if (b->tb_fill + (int64_t)TS_PACKET_SIZE * PCR_TIME_BASE > (int64_t)b->tb_size * PCR_TIME_BASE ||
+            b->bs_fill + TS_PACKET_SIZE - 4 > b->bs_size) {
+            b->held_back++;
+            continue;
+        }
+        if (!best || dts < best_dts) {
+            best     = s->streams[i];
+            best_dts = dts;
+        }
+    }
+
+    if (!best) {
+        ts->tstd_null_packets++;
+        mpegts_insert_null_packet(s);
+        return;
+    }
+
+    {
+        TSTDBuffer *b = &((MpegTSWriteStream *)best->priv_data)->tstd;
+
+        av_fifo_generic_read(b->packets, &pkt, sizeof(pkt), NULL);
+        b->tb_fill += (int64_t)TS_PACKET_SIZE * PCR_TIME_BASE;
+        b->bs_fill += pkt.payload;
+        b->tb_max   = FFMAX(b->tb_max, b->tb_fill);
+        b->bs_max   = FFMAX(b->bs_max, b->bs_fill);
+        b->last_cc  = pkt.data[3] & 0xf;
+        b->nb_packets++;
+        if (pkt.dts != AV_NOPTS_VALUE) {
+            b->min_margin = FFMIN(b->min_margin, pkt.dts * 300 - pcr);
+            if (pkt.dts * 300 < pcr)
+                b->late_packets++;
+        }
+        mpegts_write_ts_packet(s, pkt.data);
+    }
+}
+
+/* Run the multiplex until the mux clock reaches until, or until all
+ * queued packets are sent when draining. */
+static void tstd_schedule(AVFormatContext *s, int64_t until, int drain)
+{
+    MpegTSWrite *ts = s->priv_data;
+
+    while (get_pcr(ts, s->pb) < until || (drain && tstd_pending(s)))
+        tstd_send_slot(s);
+}
+
+static void tstd_report(AVFormatContext *s)
+{
+    MpegTSWrite *ts = s->priv_data;
+    int64_t total = (avio_tell(s->pb) + ts->pkt_batch_len) /
+                    (TS_PACKET_SIZE + 4 * !!ts->m2ts_mode);
+    int i;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        MpegTSWriteStream *ts_st = s->streams[i]->priv_data;
+        TSTDBuffer *b = &ts_st->tstd;
+
+        av_log(s, AV_LOG_INFO, "T-STD pid 0x%x: %"PRId64" packets, "
+               "TB max %"PRId64"/%d bytes, B max %d/%d bytes (%.1f%%), "
+               "min buffer delay %.3f ms, %"PRId64" late packets, "
+               "%"PRId64" slots held back\n",
+               ts_st->pid, b->nb_packets,
+               b->tb_max / PCR_TIME_BASE, b->tb_size,
+               b->bs_max, b->bs_size, 100.0 * b->bs_max / b->bs_size,
+               b->min_margin == INT64_MAX ? 0.0 : b->min_margin / (PCR_TIME_BASE / 1000.0),
+               b->late_packets, b->held_back);
+    }
+    av_log(s, AV_LOG_INFO, "T-STD: %"PRId64" null packets (%.2f%% of the mux), "
+           "max PCR interval %.3f ms\n",
+           ts->tstd_null_packets, total ? 100.0 * ts->tstd_null_packets / total : 0.0,
+           ts->tstd_max_pcr_interval / (PCR_TIME_BASE / 1000.0));
+}
+
+/* Add a pes header to the front of prefix + payload, and segment into an
+ * integer number of ts packets. The final ts packet is padded using an
+ * over-sized adaptation header to exactly fill the last ts packet.
+ * The ts packets are built in place in the output batch, so each payload
+ * byte is copied only once.
+ * NOTE: prefix followed by 'payload' contains a complete PES payload.
  */
-static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
-                             const uint8_t *payload, int payload_size,
-                             int64_t pts, int64_t dts, int key)
+static int mpegts_write_pes(AVFormatContext *s, AVStream *st,
+                            const uint8_t *prefix, int prefix_size,
+                            const uint8_t *payload, int payload_size,
+                            int64_t pts, int64_t dts, int key)
 {
     MpegTSWriteStream *ts_st = st->priv_data;
     MpegTSWrite *ts = s->priv_data;
-    uint8_t buf[TS_PACKET_SIZE];
-    uint8_t *q;
+    uint8_t tstd_buf[TS_PACKET_SIZE];
+    uint8_t *buf, *q;
     int val, is_start, len, header_len, write_pcr, is_dvb_subtitle, is_dvb_teletext, flags;
+    int copy_len, ret;
     int afc_len, stuffing_len;
     int64_t pcr = -1; /* avoid warning */
     int64_t delay = av_rescale(s->max_delay, 90000, AV_TIME_BASE);
     int force_pat = st->codec->codec_type == AVMEDIA_TYPE_VIDEO && key && !ts_st->prev_payload_key;
+    int tstd = ts->flags & MPEGTS_FLAG_TSTD;
 
+    if (tstd && force_pat) {
+        /* sent with the next slot, PCR is inserted by the scheduler */
+        ts->last_pat_pcr = AV_NOPTS_VALUE;
+        ts->last_pmt_pcr = AV_NOPTS_VALUE;
+    }
+
+    payload_size += prefix_size;
     is_start = 1;
     while (payload_size > 0) {
-        retransmit_si_info(s, force_pat);
-        force_pat = 0;
-
         write_pcr = 0;
-        if (ts_st->pid == ts_st->service->pcr_pid) {
-            if (ts->mux_rate > 1 || is_start) // VBR pcr period is based on frames
-                ts_st->service->pcr_packet_count++;
-            if (ts_st->service->pcr_packet_count >=
-                ts_st->service->pcr_packet_period) {
-                ts_st->service->pcr_packet_count = 0;
-                write_pcr = 1;
+        if (!tstd) {
+            retransmit_si_info(s, force_pat, mpegts_get_clock(s, dts));
+            force_pat = 0;
+
+            if (ts_st->pid == ts_st->service->pcr_pid) {
+                if (ts->mux_rate > 1 || is_start) // VBR pcr period is based on frames
+                    ts_st->service->pcr_packet_count++;
+                if (ts_st->service->pcr_packet_count >=
+                    ts_st->service->pcr_packet_period) {
+                    ts_st->service->pcr_packet_count = 0;
+                    write_pcr = 1;
+                }
             }
-        }
 
-        if (ts->mux_rate > 1 && dts != AV_NOPTS_VALUE &&
-            (dts - get_pcr(ts, s->pb)/300) > delay) {
-            /* pcr insert gets priority over null packet insert */
-            if (write_pcr)
-                mpegts_insert_pcr_only(s, st);
-            else
-                mpegts_insert_null_packet(s);
-            continue; /* recalculate write_pcr and possibly retransmit si_info */
+            if (ts->mux_rate > 1 && dts != AV_NOPTS_VALUE &&
+                (dts - get_pcr(ts, s->pb)/300) > delay) {
+                /* pcr insert gets priority over null packet insert */
+                if (write_pcr)
+                    mpegts_insert_pcr_only(s, st, ts_st->cc);
+                else
+                    mpegts_insert_null_packet(s);
+                continue; /* recalculate write_pcr and possibly retransmit si_info */
+            }
         }
 
         /* prepare packet header */
+        buf = tstd ? tstd_buf : mpegts_get_ts_packet(s);
         q = buf;
         *q++ = 0x47;
         val = (ts_st->pid >> 8);
@@ -1399,7 +2394,7 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
         *q++ = 0x10 | ts_st->cc; // payload indicator + CC
         if (key && is_start && pts != AV_NOPTS_VALUE) {
             // set Random Access for key frames
-            if (ts_st->pid == ts_st->service->pcr_pid)
+            if (ts_st->pid == ts_st->service->pcr_pid && !tstd)
                 write_pcr = 1;
             set_af_flag(buf, 0x40);
             q = get_ts_payload_start(buf);
@@ -1576,20 +2571,38 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
             }
         }
 
+        q = buf + TS_PACKET_SIZE - len;
+        copy_len = len;
         if (is_dvb_subtitle && payload_size == len) {
-            memcpy(buf + TS_PACKET_SIZE - len, payload, len - 1);
             buf[TS_PACKET_SIZE - 1] = 0xff; /* end_of_PES_data_field_marker: an 8-bit field with fixed contents 0xff for DVB subtitle */
-        } else {
-            memcpy(buf + TS_PACKET_SIZE - len, payload, len);
+            copy_len--;
         }
+        if (prefix_size) {
+            val = FFMIN(copy_len, prefix_size);
+            memcpy(q, prefix, val);
+            prefix      += val;
+            prefix_size -= val;
+            q           += val;
+            copy_len    -= val;
+        }
+        memcpy(q, payload, copy_len);
 
-        payload += len;
+        payload += copy_len;
         payload_size -= len;
-        mpegts_prefix_m2ts_header(s);
-        avio_write(s->pb, buf, TS_PACKET_SIZE);
+        if (tstd) {
+            if ((ret = tstd_queue_packet(&ts_st->tstd, buf, len, dts)) < 0)
+                return ret;
+        } else
+            mpegts_commit_ts_packet(s);
+    }
+    if (tstd) {
+        if ((ret = tstd_queue_unit(&ts_st->tstd, dts)) < 0)
+            return ret;
+        if (dts != AV_NOPTS_VALUE)
+            tstd_schedule(s, (dts - delay) * 300, 0);
     }
-    avio_flush(s->pb);
     ts_st->prev_payload_key = key;
+    return 0;
 }
 
 int ff_check_h264_startcode(AVFormatContext *s, const AVStream *st, const AVPacket *pkt)
@@ -1605,16 +2618,353 @@ int ff_check_h264_startcode(AVFormatContext *s, const AVStream *st, const AVPack
     return 0;
 }
 
+/* Gather the payload of an input PSI packet. *pos is the offset in the
+ * packet to continue at, 0 for a new packet; it is set to TS_PACKET_SIZE
+ * once the packet is used up. Return the size of the section completed in
+ * sec->buf, or 0. Call again until the packet is used up, as a packet may
+ * hold several sections up to the 0xFF stuffing. */
+static int passthrough_feed_section(TSPassthroughSection *sec, const uint8_t *packet,
+                                    int *pos)
+{
+    const uint8_t *p = packet + *pos, *p_end = packet + TS_PACKET_SIZE;
+    const uint8_t *end = p_end;
+    int size, len;
+
+    *pos = TS_PACKET_SIZE;
+    if (p == packet) {
+        if (!(packet[3] & 0x10))
+            return 0;
+        p += 4;
+        if (packet[3] & 0x20)
+            p += p[0] + 1;
+        if (p >= p_end)
+            return 0;
+        if (packet[1] & 0x40) {
+            /* the bytes up to the pointed section end the previous one */
+            end = p + 1 + p[0];
+            p++;
+            if (end > p_end)
+                return 0;
+            if (sec->size <= 0 || end == p) {
+                sec->size = 0;
+                p   = end;
+                end = p_end;
+            } else {
+                *pos = end - packet;
+            }
+        }
+    } else {
+        /* a new section follows the previous one */
+        sec->size = 0;
+    }
+    if (sec->size < 0 || p >= end || (!sec->size && *p == 0xff))
+        return 0;
+
+    size = sec->size;
+    len  = FFMIN(end - p, PSI_MAX_SECTION_SIZE - size);
+    memcpy(sec->buf + size, p, len);
+    sec->size += len;
+    if (sec->size < 3)
+        return 0;
+    len = 3 + (AV_RB16(sec->buf + 1) & 0xfff);
+    if (len > PSI_MAX_SECTION_SIZE || len < 12) {
+        sec->size = -1;
+        return 0;
+    }
+    if (sec->size < len)
+        return 0;
+    sec->size = -1;
+    if (end == p_end)
+        *pos = p + len - size - packet;
+    if (av_crc(av_crc_get_table(AV_CRC_32_IEEE), -1, sec->buf, len))
+        return 0;
+    return len;
+}
+
+static void passthrough_map_pid(AVFormatContext *s, uint8_t *used, int pid)
+{
+    TSPassthrough *tp = ((MpegTSWrite *)s->priv_data)->passthrough;
+    int out = tp->req_pid[pid] >= 0 ? tp->req_pid[pid] : pid;
+
+    if (tp->out_pid[pid] >= 0)
+        return;
+    if (used[out]) {
+        av_log(s, AV_LOG_ERROR, "Output pid 0x%x of input pid 0x%x is "
+               "already in use, not forwarded\n", out, pid);
+        return;
+    }
+    used[out] = 1;
+    tp->out_pid[pid] = out;
+}
+
+/* Decide which input PIDs are forwarded and under which output PID,
+ * then send the updated PAT and PMT. */
+static void passthrough_update_layout(AVFormatContext *s)
+{
+    MpegTSWrite *ts = s->priv_data;
+    TSPassthrough *tp = ts->passthrough;
+    uint8_t used[NB_PID_MAX] = { 0 };
+    const uint8_t *p, *p_end;
+    uint32_t crc;
+    int i, j, pid, own_pcr, selected;
+
+    used[PAT_PID] = used[SDT_PID] = used[NIT_PID] = used[TOT_PID] = 1;
+    for (i = 0; i < ts->nb_services; i++)
+        used[ts->services[i]->pmt.pid] = 1;
+    for (i = 0; i < s->nb_streams; i++) {
+        MpegTSWriteStream *ts_st = s->streams[i]->priv_data;
+        if (ts_st->pid < 0x1fff)
+            used[ts_st->pid] = 1;
+    }
+
+    memset(tp->out_pid, -1, sizeof(tp->out_pid));
+    for (i = 0; i < tp->nb_programs; i++) {
+        TSPassthroughProgram *prg = tp->programs[i];
+        if (prg->pmt_version < 0)
+            continue;
+        p     = prg->es_info;
+        p_end = prg->es_info + prg->es_info_size;
+        selected = 0;
+        for (; p + 5 <= p_end; p += 5 + (AV_RB16(p + 3) & 0xfff)) {
+            pid = AV_RB16(p + 1) & 0x1fff;
+            if (!tp->nb_req_pids || tp->req_pid[pid] >= 0) {
+                passthrough_map_pid(s, used, pid);
+                selected = 1;
+            }
+        }
+        if (!selected)
+            continue;
+        /* the PCR pid of a program is forwarded even if it is not selected */
+        if (prg->pcr_pid < 0x1fff)
+            passthrough_map_pid(s, used, prg->pcr_pid);
+
+        /* services made of forwarded streams only take the PCR of their first program */
+        own_pcr = 0;
+        for (j = 0; j < s->nb_streams; j++) {
+            MpegTSWriteStream *ts_st = s->streams[j]->priv_data;
+            if (ts_st->service == prg->service && ts_st->pid == prg->service->pcr_pid)
+                own_pcr = 1;
+        }
+        for (j = 0; j < i; j++)
+            if (tp->programs[j]->service == prg->service)
+                break;
+        if (!own_pcr && j == i)
+            prg->service->pcr_pid = prg->pcr_pid < 0x1fff && tp->out_pid[prg->pcr_pid] >= 0 ?
+                                    tp->out_pid[prg->pcr_pid] : 0x1fff;
+    }
+
+    /* the PMTs only change with the PID mapping, the PCR PIDs and the
+     * stream loops of the forwarded programs */
+    crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE), -1,
+                 (const uint8_t *)tp->out_pid, sizeof(tp->out_pid));
+    for (i = 0; i < ts->nb_services; i++)
+        crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE), crc,
+                     (const uint8_t *)&ts->services[i]->pcr_pid,
+                     sizeof(ts->services[i]->pcr_pid));
+    for (i = 0; i < tp->nb_programs; i++) {
+        TSPassthroughProgram *prg = tp->programs[i];
+        if (prg->pmt_version < 0)
+            continue;
+        crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE), crc,
+                     (const uint8_t *)&prg->sid, sizeof(prg->sid));
+        crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE), crc,
+                     prg->es_info, prg->es_info_size);
+    }
+    if (tp->layout_valid && crc == tp->layout_crc)
+        return;
+    tp->layout_crc   = crc;
+    tp->layout_valid = 1;
+
+    /* let the receivers notice the new layout, the version set by the user
+     * is kept until a PMT built with another layout was sent */
+    for (i = 0; i < ts->nb_services; i++)
+        if (ts->services[i]->pmt.cache_size)
+            break;
+    if (i < ts->nb_services)
+        ts->tables_version = (ts->tables_version + 1) & 0x1f;
+    ts->last_pat_pcr = AV_NOPTS_VALUE;
+    ts->last_pmt_pcr = AV_NOPTS_VALUE;
+}
+
+static int passthrough_parse_pat(AVFormatContext *s, const uint8_t *section, int len)
+{
+    MpegTSWrite *ts = s->priv_data;
+    TSPassthrough *tp = ts->passthrough;
+    TSPassthroughProgram *prg;
+    const uint8_t *p;
+    int i, k, sid, version = (section[5] >> 1) & 0x1f;
+
+    if (section[0] != PAT_TID || !(section[5] & 1) || version == tp->pat_version)
+        return 0;
+    tp->pat_version = version;
+
+    for (i = 0; i < tp->nb_programs; i++)
+        av_free(tp->programs[i]);
+    av_freep(&tp->programs);
+    tp->nb_programs = 0;
+
+    for (p = section + 8; p + 4 <= section + len - 4; p += 4) {
+        sid = AV_RB16(p);
+        if (!sid) /* NIT */
+            continue;
+        prg = av_mallocz(sizeof(*prg));
+        if (!prg)
+            return AVERROR(ENOMEM);
+        prg->sid         = sid;
+        prg->pmt_pid     = AV_RB16(p + 2) & 0x1fff;
+        prg->pmt_version = -1;
+        prg->pcr_pid     = 0x1fff;
+        prg->pmt.size    = -1;
+        prg->last_pcr    = AV_NOPTS_VALUE;
+        prg->pcr_offset  = AV_NOPTS_VALUE;
+        /* a service with the same id, else the services in turn */
+        prg->service = ts->services[tp->nb_programs % ts->nb_services];
+        for (k = 0; k < ts->nb_services; k++)
+            if (ts->services[k]->sid == sid)
+                prg->service = ts->services[k];
+        dynarray_add(&tp->programs, &tp->nb_programs, prg);
+        if (!tp->programs)
+            return AVERROR(ENOMEM);
+    }
+    passthrough_update_layout(s);
+    return 0;
+}
+
+static void passthrough_parse_pmt(AVFormatContext *s, TSPassthroughProgram *prg,
+                                  const uint8_t *section, int len)
+{
+    int version = (section[5] >> 1) & 0x1f, info_len;
+
+    if (section[0] != PMT_TID || !(section[5] & 1) || len < 16 ||
+        AV_RB16(section + 3) != prg->sid || version == prg->pmt_version)
+        return;
+    info_len = AV_RB16(section + 10) & 0xfff;
+    if (12 + info_len > len - 4)
+        return;
+    prg->pmt_version  = version;
+    prg->pcr_pid      = AV_RB16(section + 8) & 0x1fff;
+    prg->es_info_size = len - 4 - 12 - info_len;
+    memcpy(prg->es_info, section + 12 + info_len, prg->es_info_size);
+    passthrough_update_layout(s);
+}
+
+/* Move the PCR of a forwarded packet onto the mux clock, the offset
+ * between both clocks being fixed by the first PCR. The PCR is kept close
+ * to the input timing in both directions: null packets are inserted when
+ * the input clock runs ahead, and the offset is moved when the mux clock
+ * gets more than a PCR period ahead because the muxrate is too low for the
+ * input. PTS and DTS are forwarded untouched, so the output PCR stays
+ * between one packet duration before and PCR_RETRANS_TIME ms after the input
+ * PCR, and the PCR-to-PTS offset of the program moves by no more than that.
+ * Returns the input clock. */
+static int64_t passthrough_restamp_pcr(AVFormatContext *s, TSPassthroughProgram *prg,
+                                       uint8_t *packet)
+{
+    MpegTSWrite *ts = s->priv_data;
+    int64_t pcr = ((int64_t)AV_RB32(packet + 6) << 1 | packet[10] >> 7) * 300 +
+                  ((packet[10] & 1) << 8 | packet[11]);
+    int64_t mux_clock, max_lag = PCR_RETRANS_TIME * (PCR_TIME_BASE / 1000);
+
+    if (prg->last_pcr == AV_NOPTS_VALUE)
+        prg->in_clock = pcr;
+    else
+        prg->in_clock += (pcr - prg->last_pcr + PCR_WRAP) % PCR_WRAP;
+    prg->last_pcr = pcr;
+
+    if (ts->mux_rate > 1) {
+        if (prg->pcr_offset == AV_NOPTS_VALUE)
+            prg->pcr_offset = prg->in_clock - get_pcr(ts, s->pb);
+        while (prg->in_clock - prg->pcr_offset > get_pcr(ts, s->pb) + ts->packet_pcr_duration)
+            mpegts_insert_null_packet(s);
+        mux_clock = get_pcr(ts, s->pb);
+        if (prg->in_clock - prg->pcr_offset < mux_clock - max_lag) {
+            if (!prg->nb_resync++)
+                av_log(s, AV_LOG_WARNING, "muxrate too low for forwarded program "
+                       "0x%04x, PCR follows the input clock\n", prg->sid);
+            prg->pcr_offset = prg->in_clock - mux_clock + max_lag;
+        }
+        write_pcr_bits(packet + 6, (mux_clock + prg->pcr_offset) % PCR_WRAP);
+    }
+    return prg->in_clock;
+}
+
+/* forward the raw TS packets of an AV_CODEC_ID_MPEG2TS stream */
+static int mpegts_write_passthrough(AVFormatContext *s, const AVPacket *pkt)
+{
+    MpegTSWrite *ts = s->priv_data;
+    TSPassthrough *tp = ts->passthrough;
+    const uint8_t *data;
+    uint8_t packet[TS_PACKET_SIZE];
+    int i, pid, out, pos, len, ret;
+
+    if (pkt->size % TS_PACKET_SIZE) {
+        av_log(s, AV_LOG_ERROR, "MPEG-TS packet size %d is not a multiple of %d\n",
+               pkt->size, TS_PACKET_SIZE);
+        return AVERROR_INVALIDDATA;
+    }
+
+    for (data = pkt->data; data < pkt->data + pkt->size; data += TS_PACKET_SIZE) {
+        if (data[0] != 0x47)
+            continue;
+        pid = AV_RB16(data + 1) & 0x1fff;
+
+        /* the input PSI is only read, the muxer sends its own */
+        if (pid == PAT_PID) {
+            for (pos = 0; pos < TS_PACKET_SIZE;)
+                if ((len = passthrough_feed_section(&tp->pat, data, &pos)) &&
+                    (ret = passthrough_parse_pat(s, tp->pat.buf, len)) < 0)
+                    return ret;
+            continue;
+        }
+        for (i = 0; i < tp->nb_programs; i++) {
+            TSPassthroughProgram *prg = tp->programs[i];
+            if (pid != prg->pmt_pid)
+                continue;
+            for (pos = 0; pos < TS_PACKET_SIZE;)
+                if ((len = passthrough_feed_section(&prg->pmt, data, &pos)))
+                    passthrough_parse_pmt(s, prg, prg->pmt.buf, len);
+        }
+
+        if ((out = tp->out_pid[pid]) < 0)
+            continue;
+        memcpy(packet, data, TS_PACKET_SIZE);
+
+        if ((packet[3] & 0x20) && packet[4] >= 7 && (packet[5] & 0x10)) {
+            for (i = 0; i < tp->nb_programs; i++)
+                if (tp->programs[i]->pcr_pid == pid) {
+                    int64_t clock = passthrough_restamp_pcr(s, tp->programs[i], packet);
+                    if (ts->mux_rate <= 1)
+                        ts->last_clock = FFMAX(ts->last_clock, clock);
+                    break;
+                }
+        }
+        retransmit_si_info(s, 0, mpegts_get_clock(s, AV_NOPTS_VALUE));
+
+        packet[1] = (packet[1] & 0xe0) | out >> 8;
+        packet[2] = out;
+        /* the continuity counter only increments with a payload */
+        if (packet[3] & 0x10)
+            tp->cc[out] = (tp->cc[out] + 1) & 0xf;
+        packet[3] = (packet[3] & 0xf0) | tp->cc[out];
+        mpegts_write_ts_packet(s, packet);
+    }
+    return 0;
+}
+
 static int mpegts_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
 {
     AVStream *st = s->streams[pkt->stream_index];
     int size = pkt->size;
     uint8_t *buf= pkt->data;
-    uint8_t *data= NULL;
+    uint8_t aud[6];
+    uint8_t adts[ADTS_HEADER_SIZE + MAX_PCE_SIZE];
+    const uint8_t *prefix = NULL;
+    int prefix_size = 0;
     MpegTSWrite *ts = s->priv_data;
     MpegTSWriteStream *ts_st = st->priv_data;
     const int64_t delay = av_rescale(s->max_delay, 90000, AV_TIME_BASE)*2;
     int64_t dts = pkt->dts, pts = pkt->pts;
+    int ret;
 
     if (ts->reemit_pat_pmt) {
         av_log(s, AV_LOG_WARNING, "resend_headers option is deprecated, use -mpegts_flags resend_headers\n");
@@ -1623,13 +2973,17 @@ static int mpegts_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
     }
 
     if (ts->flags & MPEGTS_FLAG_REEMIT_PAT_PMT) {
-        ts->pat_packet_count = ts->pat_packet_period - 1;
-        ts->sdt_packet_count = ts->sdt_packet_period - 1;
-        ts->nit_packet_count = ts->nit_packet_period - 1;
-        ts->tot_packet_count = ts->tot_packet_period - 1;
+        ts->last_pat_pcr = AV_NOPTS_VALUE;
+        ts->last_pmt_pcr = AV_NOPTS_VALUE;
+        ts->last_sdt_pcr = AV_NOPTS_VALUE;
+        ts->last_nit_pcr = AV_NOPTS_VALUE;
+        ts->last_tot_pcr = AV_NOPTS_VALUE;
         ts->flags &= ~MPEGTS_FLAG_REEMIT_PAT_PMT;
     }
 
+    if (st->codec->codec_id == AV_CODEC_ID_MPEG2TS)
+        return mpegts_write_passthrough(s, pkt);
+
     if(ts->copyts < 1){
         if (pts != AV_NOPTS_VALUE)
             pts += delay;
@@ -1646,7 +3000,7 @@ static int mpegts_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
     if (st->codec->codec_id == AV_CODEC_ID_H264) {
         const uint8_t *p = buf, *buf_end = p+size;
         uint32_t state = -1;
-        int ret = ff_check_h264_startcode(s, st, pkt);
+        ret = ff_check_h264_startcode(s, st, pkt);
         if (ret < 0)
             return ret;
 
@@ -1656,16 +3010,12 @@ static int mpegts_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
         } while (p < buf_end && (state & 0x1f) != 9 &&
                  (state & 0x1f) != 5 && (state & 0x1f) != 1);
 
-        if ((state & 0x1f) != 9) { // AUD NAL
-            data = av_malloc(pkt->size+6);
-            if (!data)
-                return AVERROR(ENOMEM);
-            memcpy(data+6, pkt->data, pkt->size);
-            AV_WB32(data, 0x00000001);
-            data[4] = 0x09;
-            data[5] = 0xf0; // any slice type (0xe) + rbsp stop one bit
-            buf  = data;
-            size = pkt->size+6;
+        if ((state & 0x1f) != 9) { // AUD NAL, written in front of the packet data
+            AV_WB32(aud, 0x00000001);
+            aud[4] = 0x09;
+            aud[5] = 0xf0; // any slice type (0xe) + rbsp stop one bit
+            prefix      = aud;
+            prefix_size = sizeof(aud);
         }
     } else if (st->codec->codec_id == AV_CODEC_ID_AAC) {
         if (pkt->size < 2) {
@@ -1673,32 +3023,25 @@ static int mpegts_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
             return AVERROR_INVALIDDATA;
         }
         if ((AV_RB16(pkt->data) & 0xfff0) != 0xfff0) {
-            int ret;
-            AVPacket pkt2;
-
-            if (!ts_st->amux) {
+            if (!ts_st->aac.enabled) {
                 av_log(s, AV_LOG_ERROR, "AAC bitstream not in ADTS format "
                        "and extradata missing\n");
                 return AVERROR_INVALIDDATA;
             }
 
-            av_init_packet(&pkt2);
-            pkt2.data = pkt->data;
-            pkt2.size = pkt->size;
-            ret = avio_open_dyn_buf(&ts_st->amux->pb);
-            if (ret < 0)
-                return AVERROR(ENOMEM);
-
-            ret = av_write_frame(ts_st->amux, &pkt2);
-            if (ret < 0) {
-                avio_close_dyn_buf(ts_st->amux->pb, &data);
-                ts_st->amux->pb = NULL;
-                av_free(data);
-                return ret;
+            if (ts->flags & MPEGTS_FLAG_AAC_LATM) {
+                ret = aac_write_latm_frame(s, st, pkt->data, pkt->size);
+                if (ret < 0)
+                    return ret;
+                buf  = ts_st->aac.buf;
+                size = ret;
+            } else {
+                ret = aac_write_adts_header(s, &ts_st->aac, adts, pkt->size);
+                if (ret < 0)
+                    return ret;
+                prefix      = adts;
+                prefix_size = ret;
             }
-            size = avio_close_dyn_buf(ts_st->amux->pb, &data);
-            ts_st->amux->pb = NULL;
-            buf = data;
         }
     }
 
@@ -1709,27 +3052,30 @@ static int mpegts_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
             MpegTSWriteStream *ts_st2 = st2->priv_data;
             if(   ts_st2->payload_size
                && (ts_st2->payload_dts == AV_NOPTS_VALUE || dts - ts_st2->payload_dts > delay/2)){
-                mpegts_write_pes(s, st2, ts_st2->payload, ts_st2->payload_size,
-                                ts_st2->payload_pts, ts_st2->payload_dts,
-                                ts_st2->payload_flags & AV_PKT_FLAG_KEY);
+                ret = mpegts_write_pes(s, st2, NULL, 0, ts_st2->payload, ts_st2->payload_size,
+                                       ts_st2->payload_pts, ts_st2->payload_dts,
+                                       ts_st2->payload_flags & AV_PKT_FLAG_KEY);
                 ts_st2->payload_size = 0;
+                if (ret < 0)
+                    return ret;
             }
         }
     }
 
-    if (ts_st->payload_size && ts_st->payload_size + size > ts->pes_payload_size) {
-        mpegts_write_pes(s, st, ts_st->payload, ts_st->payload_size,
-                         ts_st->payload_pts, ts_st->payload_dts,
-                         ts_st->payload_flags & AV_PKT_FLAG_KEY);
+    if (ts_st->payload_size && ts_st->payload_size + prefix_size + size > ts->pes_payload_size) {
+        ret = mpegts_write_pes(s, st, NULL, 0, ts_st->payload, ts_st->payload_size,
+                               ts_st->payload_pts, ts_st->payload_dts,
+                               ts_st->payload_flags & AV_PKT_FLAG_KEY);
         ts_st->payload_size = 0;
+        if (ret < 0)
+            return ret;
     }
 
-    if (st->codec->codec_type != AVMEDIA_TYPE_AUDIO || size > ts->pes_payload_size) {
+    if (st->codec->codec_type != AVMEDIA_TYPE_AUDIO || prefix_size + size > ts->pes_payload_size) {
         av_assert0(!ts_st->payload_size);
         // for video and subtitle, write a single pes packet
-        mpegts_write_pes(s, st, buf, size, pts, dts, pkt->flags & AV_PKT_FLAG_KEY);
-        av_free(data);
-        return 0;
+        return mpegts_write_pes(s, st, prefix, prefix_size, buf, size, pts, dts,
+                                pkt->flags & AV_PKT_FLAG_KEY);
     }
 
     if (!ts_st->payload_size) {
@@ -1738,37 +3084,44 @@ static int mpegts_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
         ts_st->payload_flags = pkt->flags;
     }
 
-    memcpy(ts_st->payload + ts_st->payload_size, buf, size);
-    ts_st->payload_size += size;
-
-    av_free(data);
+    if (prefix_size)
+        memcpy(ts_st->payload + ts_st->payload_size, prefix, prefix_size);
+    memcpy(ts_st->payload + ts_st->payload_size + prefix_size, buf, size);
+    ts_st->payload_size += prefix_size + size;
 
     return 0;
 }
 
-static void mpegts_write_flush(AVFormatContext *s)
+static int mpegts_write_flush(AVFormatContext *s)
 {
-    int i;
+    MpegTSWrite *ts = s->priv_data;
+    int i, ret;
 
     /* flush current packets */
     for(i = 0; i < s->nb_streams; i++) {
         AVStream *st = s->streams[i];
         MpegTSWriteStream *ts_st = st->priv_data;
         if (ts_st->payload_size > 0) {
-            mpegts_write_pes(s, st, ts_st->payload, ts_st->payload_size,
-                             ts_st->payload_pts, ts_st->payload_dts,
-                             ts_st->payload_flags & AV_PKT_FLAG_KEY);
+            ret = mpegts_write_pes(s, st, NULL, 0, ts_st->payload, ts_st->payload_size,
+                                   ts_st->payload_pts, ts_st->payload_dts,
+                                   ts_st->payload_flags & AV_PKT_FLAG_KEY);
             ts_st->payload_size = 0;
+            if (ret < 0)
+                return ret;
         }
     }
+    if (ts->flags & MPEGTS_FLAG_TSTD)
+        tstd_schedule(s, 0, 1);
+    mpegts_flush_batch(s);
     avio_flush(s->pb);
+    return 0;
 }
 
 static int mpegts_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     if (!pkt) {
-        mpegts_write_flush(s);
-        return 1;
+        int ret = mpegts_write_flush(s);
+        return ret < 0 ? ret : 1;
     } else {
         return mpegts_write_packet_internal(s, pkt);
     }
@@ -1778,29 +3131,39 @@ static int mpegts_write_end(AVFormatContext *s)
 {
     MpegTSWrite *ts = s->priv_data;
     MpegTSService *service;
-    int i;
+    int i, ret;
+
+    ret = mpegts_write_flush(s);
 
-    mpegts_write_flush(s);
+    if (ts->flags & MPEGTS_FLAG_TSTD)
+        tstd_report(s);
 
     for(i = 0; i < s->nb_streams; i++) {
         AVStream *st = s->streams[i];
         MpegTSWriteStream *ts_st = st->priv_data;
         av_freep(&ts_st->payload);
-        if (ts_st->amux) {
-            avformat_free_context(ts_st->amux);
-            ts_st->amux = NULL;
-        }
+        av_fifo_free(ts_st->tstd.packets);
+        av_fifo_free(ts_st->tstd.units);
+        av_freep(&ts_st->aac.buf);
     }
 
+    mpegts_free_section(&ts->pat);
+    mpegts_free_section(&ts->sdt);
+    mpegts_free_section(&ts->nit);
+    mpegts_free_section(&ts->tot);
+
     for(i = 0; i < ts->nb_services; i++) {
         service = ts->services[i];
+        mpegts_free_section(&service->pmt);
         av_freep(&service->provider_name);
         av_freep(&service->name);
         av_free(service);
     }
     av_free(ts->services);
+    av_freep(&ts->pkt_batch);
+    passthrough_free(ts);
 
-    return 0;
+    return ret;
 }
 
 AVOutputFormat ff_mpegts_muxer = {
@@ -122,6 +122,22 @@ enc_dec_pcm(){
     ffmpeg -flags +bitexact -i ${encfile} -c:a pcm_${pcm_fmt} -f ${dec_fmt} -
 }
 
+transcode_chunks(){
+    nb_chunks=$1
+    out_fmt=$2
+    shift 2
+    srcfile="${outdir}/${test}.src.nut"
+    encfile="${outdir}/${test}.${out_fmt}"
+    cleanfiles="$srcfile $encfile"
+    tsrcfile=$(target_path $srcfile)
+    tencfile=$(target_path $encfile)
+    ffmpeg -f lavfi -i testsrc=d=4:r=10:s=64x48 -f lavfi -i sine=d=4 \
+        -c:v mpeg4 -g 10 -c:a pcm_s16le -flags +bitexact -y $tsrcfile || return
+    ffmpeg -chunk_parallel $nb_chunks -i $tsrcfile "$@" -flags +bitexact \
+        -f $out_fmt -y $tencfile || return
+    run ffprobe -show_entries packet=stream_index,pts,dts,duration -of compact=p=0 -v 0 $tencfile
+}
+
 FLAGS="-flags +bitexact -sws_flags +accurate_rnd+bitexact"
 DEC_OPTS="-threads $threads -idct simple $FLAGS"
 ENC_OPTS="-threads 1        -idct simple -dct fastint"
@@ -68,6 +68,12 @@ FATE_ACODEC-$(call ENCDEC, MP2, MP2 MP3) += fate-acodec-mp2
 fate-acodec-mp2: FMT = mp2
 fate-acodec-mp2: CMP_SHIFT = -1924
 
+FATE_ACODEC-$(call ENCDEC, MP2, MP2 MP3) += fate-acodec-mp2-frame-threads
+fate-acodec-mp2-frame-threads: CODEC = mp2
+fate-acodec-mp2-frame-threads: FMT = mp2
+fate-acodec-mp2-frame-threads: CMP_SHIFT = -1924
+fate-acodec-mp2-frame-threads: ENCOPTS = -threads 4 -thread_type frame
+
 FATE_ACODEC-$(call ENCDEC, MP2FIXED MP2 , MP2 MP3) += fate-acodec-mp2fixed
 fate-acodec-mp2fixed: FMT = mp2
 fate-acodec-mp2fixed: CMP_SHIFT = -1924
@@ -28,6 +28,15 @@ fate-force_key_frames: CMD = enc_dec \
   avi "-c mpeg4 -g 240 -qscale 10 -force_key_frames 0.5,0:00:01.5" \
   framecrc "" "" "-skip_frame nokey"
 
+# AAC starts each chunk with a priming packet that overlaps the previous chunk
+ifdef HAVE_FORK
+FATE_CHUNKS-$(call ALLYES, FFPROBE LAVFI_INDEV TESTSRC_FILTER SINE_FILTER MPEG4_ENCODER MPEG4_DECODER PCM_S16LE_ENCODER PCM_S16LE_DECODER NUT_MUXER NUT_DEMUXER AAC_ENCODER MATROSKA_MUXER MATROSKA_DEMUXER) += fate-ffmpeg-chunk_parallel-aac
+endif
+fate-ffmpeg-chunk_parallel-aac: CMD = transcode_chunks 2 matroska -c:v mpeg4 -c:a aac -strict experimental
+
+$(FATE_CHUNKS-yes): ffprobe$(EXESUF)
+FATE_FFMPEG += $(FATE_CHUNKS-yes)
+
 FATE_SAMPLES_FFMPEG-$(call ALLYES, VOBSUB_DEMUXER DVDSUB_DECODER AVFILTER OVERLAY_FILTER DVDSUB_ENCODER) += fate-sub2video
 fate-sub2video: tests/data/vsynth2.yuv
 fate-sub2video: CMD = framecrc \
@@ -198,8 +198,36 @@ FATE_H264-$(call DEMDEC,  MOV, H264) += fate-h264-crop-to-container
 FATE_H264-$(call DEMDEC,  MOV, H264) += fate-h264-interlace-crop
 FATE_H264-$(call ALLYES, MOV_DEMUXER H264_MP4TOANNEXB_BSF) += fate-h264-bsf-mp4toannexb
 
+# multi-slice, MBAFF and PAFF conformance samples decoded with frame threads
+# that each decode the slices of their frame in parallel; the output has to
+# match the conformance references
+FATE_H264_HYBRID_THREADS := ba1_ft_c                                    \
+                            sl1_sva_b                                   \
+                            cabast3_sony_e                              \
+                            cabastbr3_sony_b                            \
+                            cabac_mot_mbaff0_full                       \
+                            camp_mot_mbaff_l31                          \
+                            cavlc_mot_mbaff0_full_b                     \
+                            cvma1_toshiba_b                             \
+                            capama3_sand_f                              \
+                            cabac_mot_picaff0_full                      \
+                            cavlc_mot_picaff0_full_b                    \
+                            cvpa1_toshiba_b                             \
+                            sharp_mp_paff_1r2                           \
+                            cvmp_mot_fld_l30_b                          \
+                            frext-hpcafl_bcrm_c                         \
+
+FATE_H264_HYBRID_THREADS := $(FATE_H264_HYBRID_THREADS:%=fate-h264-hybrid-threads-%)
+
+$(FATE_H264_HYBRID_THREADS): THREADS = 2
+$(FATE_H264_HYBRID_THREADS): THREAD_TYPE = frame+slice
+$(FATE_H264_HYBRID_THREADS): REF = $(SRC_PATH)/tests/ref/fate/$(@:fate-h264-hybrid-threads-%=h264-conformance-%)
+
+FATE_H264-$(call DEMDEC, H264, H264) += $(FATE_H264_HYBRID_THREADS)
+
 FATE_SAMPLES_AVCONV += $(FATE_H264-yes)
 fate-h264: $(FATE_H264-yes)
+fate-h264-hybrid-threads: $(FATE_H264_HYBRID_THREADS)
 
 fate-h264-conformance-aud_mw_e:                   CMD = framecrc -vsync drop -i $(TARGET_SAMPLES)/h264-conformance/AUD_MW_E.264
 fate-h264-conformance-ba1_ft_c:                   CMD = framecrc -vsync drop -i $(TARGET_SAMPLES)/h264-conformance/BA1_FT_C.264
@@ -386,6 +414,22 @@ fate-h264-conformance-sva_fm1_e:                  CMD = framecrc -vsync drop -i
 fate-h264-conformance-sva_nl1_b:                  CMD = framecrc -vsync drop -i $(TARGET_SAMPLES)/h264-conformance/SVA_NL1_B.264
 fate-h264-conformance-sva_nl2_e:                  CMD = framecrc -vsync drop -i $(TARGET_SAMPLES)/h264-conformance/SVA_NL2_E.264
 
+fate-h264-hybrid-threads-ba1_ft_c:                 CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/BA1_FT_C.264
+fate-h264-hybrid-threads-sl1_sva_b:                CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/SL1_SVA_B.264
+fate-h264-hybrid-threads-cabast3_sony_e:           CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/CABAST3_Sony_E.jsv
+fate-h264-hybrid-threads-cabastbr3_sony_b:         CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/CABASTBR3_Sony_B.jsv
+fate-h264-hybrid-threads-cabac_mot_mbaff0_full:    CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/camp_mot_mbaff0_full.26l
+fate-h264-hybrid-threads-camp_mot_mbaff_l31:       CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/CAMP_MOT_MBAFF_L31.26l
+fate-h264-hybrid-threads-cavlc_mot_mbaff0_full_b:  CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/cvmp_mot_mbaff0_full_B.26l
+fate-h264-hybrid-threads-cvma1_toshiba_b:          CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/CVMA1_TOSHIBA_B.264
+fate-h264-hybrid-threads-capama3_sand_f:           CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/CAPAMA3_Sand_F.264
+fate-h264-hybrid-threads-cabac_mot_picaff0_full:   CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/camp_mot_picaff0_full.26l
+fate-h264-hybrid-threads-cavlc_mot_picaff0_full_b: CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/cvmp_mot_picaff0_full_B.26l
+fate-h264-hybrid-threads-cvpa1_toshiba_b:          CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/CVPA1_TOSHIBA_B.264
+fate-h264-hybrid-threads-sharp_mp_paff_1r2:        CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/Sharp_MP_PAFF_1r2.jvt
+fate-h264-hybrid-threads-cvmp_mot_fld_l30_b:       CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/CVMP_MOT_FLD_L30_B.26l
+fate-h264-hybrid-threads-frext-hpcafl_bcrm_c:      CMD = framecrc -vsync drop -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/FRext/HPCAFL_BRCM_C.264 -vsync drop
+
 fate-h264-bsf-mp4toannexb:                        CMD = md5 -i $(TARGET_SAMPLES)/h264/interlaced_crop.mp4 -vcodec copy -bsf h264_mp4toannexb -f h264
 fate-h264-crop-to-container:                      CMD = framemd5 -i $(TARGET_SAMPLES)/h264/crop-to-container-dims-canon.mov
 fate-h264-extreme-plane-pred:                     CMD = framemd5 -i $(TARGET_SAMPLES)/h264/extreme-plane-pred.h264
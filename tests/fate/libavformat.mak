@@ -1,3 +1,9 @@
+FATE_LIBAVFORMAT-$(CONFIG_MATROSKA_MUXER) += fate-avc
+fate-avc: libavformat/avc-test$(EXESUF)
+fate-avc: CMD = run libavformat/avc-test
+fate-avc: CMP = null
+fate-avc: REF = /dev/null
+
 FATE_LIBAVFORMAT-$(CONFIG_NETWORK) += fate-noproxy
 fate-noproxy: libavformat/noproxy-test$(EXESUF)
 fate-noproxy: CMD = run libavformat/noproxy-test
@@ -83,9 +83,22 @@ $(eval $(call FATE_VP9_SUITE,parallelmode-akiyo,$(1),$(2)))
 $(eval $(call FATE_VP9_SUITE,segmentation-aq-akiyo,$(1),$(2)))
 $(eval $(call FATE_VP9_SUITE,segmentation-sf-akiyo,$(1),$(2)))
 $(eval $(call FATE_VP9_SUITE,tiling-pedestrian,$(1),$(2)))
+
+# 16x16 chroma transforms with all 256 coefficients coded
+FATE_VP9-$(CONFIG_IVF_DEMUXER) += fate-vp9$(1)-16x16-chroma-eob
+fate-vp9$(1)-16x16-chroma-eob: CMD = framemd5 $(2) -i $(TARGET_SAMPLES)/vp9/16x16-chroma-eob.ivf
+fate-vp9$(1)-16x16-chroma-eob: REF = $(SRC_PATH)/tests/ref/fate/vp9-16x16-chroma-eob
 endef
 
 $(eval $(call FATE_VP9_FULL))
 
+# the same streams with the tile columns and the loopfilter decoded in
+# parallel; the output has to match the single threaded references
+$(eval $(call FATE_VP9_FULL,-slice-threads))
+FATE_VP9_SLICE_THREADS := $(filter fate-vp9-slice-threads-%,$(FATE_VP9-yes))
+$(FATE_VP9_SLICE_THREADS): THREADS = 3
+$(FATE_VP9_SLICE_THREADS): THREAD_TYPE = slice
+
 FATE_SAMPLES_AVCONV-$(CONFIG_VP9_DECODER) += $(FATE_VP9-yes)
 fate-vp9: $(FATE_VP9-yes)
+fate-vp9-slice-threads: $(FATE_VP9_SLICE_THREADS)